@@ -0,0 +1,290 @@
+#pragma once
+
+#include "EigenInclude.h"
+#include "types.h"
+#include "constants.h"
+#include "triads.h"
+#include "postproc.h"
+#include "linear.h"
+
+#include <iostream>
+
+// Discrete adjoint of UVLM::Steady::solver.
+// The converged steady solution satisfies the residual
+//      R(gamma, zeta) = AIC(zeta) gamma - RHS(zeta) = 0
+// where the wake circulation is the trailing edge one (all rows) and the
+// wake vertices translate with the trailing edge. With the objectives
+// J(forces(gamma, zeta), zeta), the adjoint variables come from one
+// solve with the transposed AIC,
+//      AIC^T lambda = (dJ/dforces dforces/dgamma)^T
+// and the total derivatives are
+//      dJ/dzeta = dJ/dforces dforces/dzeta + dJ/dzeta|_forces - lambda^T dR/dzeta
+// for all the objectives at once.
+// The wake shape is taken as frozen relative to the trailing edge, so
+// the gradients of a rolled-up wake (n_rollup > 0) do not include the
+// sensitivity of the rollup.
+//
+// Objectives (in this order):
+//  0: drag, along flightconditions.uinf_direction
+//  1: side force
+//  2: lift, normal to the drag and the y axis
+//  3-5: moment of the vertex forces about reference_point
+namespace UVLM
+{
+    namespace Adjoint
+    {
+        const uint n_objectives = 6;
+
+        // DECLARATIONS
+        template <typename t_zeta,
+                  typename t_zeta_star,
+                  typename t_gamma,
+                  typename t_gamma_star,
+                  typename t_uext>
+        void steady
+        (
+            const t_zeta& zeta,
+            const t_zeta_star& zeta_star,
+            const t_gamma& gamma,
+            const t_gamma_star& gamma_star,
+            const t_uext& uext,
+            const UVLM::Types::Vector3& reference_point,
+            const UVLM::Types::VMopts& options,
+            const UVLM::Types::FlightConditions& flightconditions,
+            UVLM::Types::VectorX& objectives,
+            UVLM::Types::MatrixX& dobjectives_dzeta
+        );
+
+        void wind_axes
+        (
+            const UVLM::Types::FlightConditions& flightconditions,
+            UVLM::Types::Matrix3& axes
+        );
+
+        template <typename t_zeta,
+                  typename t_forces>
+        void objectives
+        (
+            const t_zeta& zeta,
+            const t_forces& forces,
+            const UVLM::Types::Vector3& reference_point,
+            const UVLM::Types::FlightConditions& flightconditions,
+            UVLM::Types::VectorX& objectives
+        );
+
+        UVLM::Types::SparseMatrixX steady_wake_shedding
+        (
+            const UVLM::Linear::Indices& indices
+        );
+    }
+}
+
+
+// Rows: drag, side and lift directions
+inline void UVLM::Adjoint::wind_axes
+(
+    const UVLM::Types::FlightConditions& flightconditions,
+    UVLM::Types::Matrix3& axes
+)
+{
+    UVLM::Types::Vector3 drag(flightconditions.uinf_direction);
+    drag.normalize();
+    UVLM::Types::Vector3 lift = drag.cross(UVLM::Types::Vector3::UnitY());
+    lift.normalize();
+    const UVLM::Types::Vector3 side = lift.cross(drag);
+    axes.row(0) = drag.transpose();
+    axes.row(1) = side.transpose();
+    axes.row(2) = lift.transpose();
+}
+
+
+// Objectives of the vertex forces (see above)
+template <typename t_zeta,
+          typename t_forces>
+void UVLM::Adjoint::objectives
+(
+    const t_zeta& zeta,
+    const t_forces& forces,
+    const UVLM::Types::Vector3& reference_point,
+    const UVLM::Types::FlightConditions& flightconditions,
+    UVLM::Types::VectorX& objectives
+)
+{
+    UVLM::Types::Matrix3 axes;
+    UVLM::Adjoint::wind_axes(flightconditions, axes);
+    objectives.setZero(UVLM::Adjoint::n_objectives);
+    for (uint i_surf=0; i_surf<zeta.size(); ++i_surf)
+    {
+        for (uint i=0; i<zeta[i_surf][0].rows(); ++i)
+        {
+            for (uint j=0; j<zeta[i_surf][0].cols(); ++j)
+            {
+                UVLM::Types::Vector3 f;
+                UVLM::Types::Vector3 r;
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    f(i_dim) = forces[i_surf][i_dim](i, j);
+                    r(i_dim) = zeta[i_surf][i_dim](i, j) - reference_point(i_dim);
+                }
+                objectives.template head<3>() += axes*f;
+                objectives.template tail<3>() += r.cross(f);
+            }
+        }
+    }
+}
+
+
+// Every wake row takes the circulation of the trailing edge panel of its
+// column (UVLM::Wake::Horseshoe::circulation_transfer).
+inline UVLM::Types::SparseMatrixX UVLM::Adjoint::steady_wake_shedding
+(
+    const UVLM::Linear::Indices& indices
+)
+{
+    const uint n_surf = indices.dimensions.size();
+    std::vector<Eigen::Triplet<UVLM::Types::Real>> triplets;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        const uint M = indices.dimensions[i_surf].first;
+        const uint N = indices.dimensions[i_surf].second;
+        for (uint i=0; i<indices.dimensions_star[i_surf].first; ++i)
+        {
+            for (uint j=0; j<N; ++j)
+            {
+                triplets.push_back(Eigen::Triplet<UVLM::Types::Real>
+                (
+                    indices.gamma_star_offset[i_surf] + i*N + j,
+                    indices.gamma_offset[i_surf] + (M - 1)*N + j,
+                    1.0
+                ));
+            }
+        }
+    }
+    UVLM::Types::SparseMatrixX shedding(indices.K_star, indices.K);
+    shedding.setFromTriplets(triplets.begin(), triplets.end());
+    return shedding;
+}
+
+
+// zeta, zeta_star, gamma and gamma_star are the output of
+// UVLM::Steady::solver.
+// objectives: n_objectives
+// dobjectives_dzeta: n_objectives x 3*K_zeta, with the vertices ordered
+// as in linear.h
+template <typename t_zeta,
+          typename t_zeta_star,
+          typename t_gamma,
+          typename t_gamma_star,
+          typename t_uext>
+void UVLM::Adjoint::steady
+(
+    const t_zeta& zeta,
+    const t_zeta_star& zeta_star,
+    const t_gamma& gamma,
+    const t_gamma_star& gamma_star,
+    const t_uext& uext,
+    const UVLM::Types::Vector3& reference_point,
+    const UVLM::Types::VMopts& options,
+    const UVLM::Types::FlightConditions& flightconditions,
+    UVLM::Types::VectorX& objectives,
+    UVLM::Types::MatrixX& dobjectives_dzeta
+)
+{
+    // steady forces only depend on uext
+    UVLM::Types::VecVecMatrixX zeta_dot;
+    UVLM::Types::allocate_VecVecMat(zeta_dot, zeta);
+    const UVLM::Types::VectorX rbm_velocity =
+        UVLM::Types::VectorX::Zero(2*UVLM::Constants::NDIM);
+
+    UVLM::Linear::Linearisation lin;
+    UVLM::Linear::linearise(zeta,
+                            zeta_dot,
+                            uext,
+                            zeta_star,
+                            gamma,
+                            gamma_star,
+                            rbm_velocity,
+                            flightconditions,
+                            lin,
+                            -1,
+                            options.horseshoe);
+    const UVLM::Linear::Indices& indices = lin.indices;
+    const uint K_zeta = indices.K_zeta;
+    const uint n_surf = zeta.size();
+
+    UVLM::Types::VecVecMatrixX forces;
+    UVLM::Types::allocate_VecVecMat(forces, zeta);
+    UVLM::PostProc::calculate_static_forces(zeta,
+                                            zeta_star,
+                                            gamma,
+                                            gamma_star,
+                                            uext,
+                                            forces,
+                                            options,
+                                            flightconditions);
+
+    // objectives and their partial derivatives
+    UVLM::Types::Matrix3 axes;
+    UVLM::Adjoint::wind_axes(flightconditions, axes);
+    objectives.setZero(UVLM::Adjoint::n_objectives);
+    UVLM::Types::MatrixX dobjectives_dforces =
+        UVLM::Types::MatrixX::Zero(UVLM::Adjoint::n_objectives, 3*K_zeta);
+    dobjectives_dzeta.setZero(UVLM::Adjoint::n_objectives, 3*K_zeta);
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        for (uint i=0; i<indices.dimensions[i_surf].first + 1; ++i)
+        {
+            for (uint j=0; j<indices.dimensions[i_surf].second + 1; ++j)
+            {
+                const uint col = 3*indices.vertex(i_surf, i, j);
+                UVLM::Types::Vector3 f;
+                UVLM::Types::Vector3 r;
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    f(i_dim) = forces[i_surf][i_dim](i, j);
+                    r(i_dim) = zeta[i_surf][i_dim](i, j) - reference_point(i_dim);
+                }
+                objectives.template head<3>() += axes*f;
+                objectives.template tail<3>() += r.cross(f);
+                dobjectives_dforces.block(0, col, 3, 3) = axes;
+                dobjectives_dforces.block(3, col, 3, 3) = UVLM::Triads::skew(r);
+                dobjectives_dzeta.block(3, col, 3, 3) = -UVLM::Triads::skew(f);
+            }
+        }
+    }
+
+    // without rollup iterations, Steady::solver keeps the circulation of
+    // the horseshoe solution and only uses the discretised wake for the
+    // forces
+    UVLM::Linear::Linearisation lin_horseshoe;
+    if (!options.horseshoe && options.n_rollup == 0)
+    {
+        UVLM::Linear::linearise(zeta,
+                                zeta_dot,
+                                uext,
+                                zeta_star,
+                                gamma,
+                                gamma_star,
+                                rbm_velocity,
+                                flightconditions,
+                                lin_horseshoe,
+                                -1,
+                                true);
+    }
+    const UVLM::Linear::Linearisation& lin_residual =
+        (!options.horseshoe && options.n_rollup == 0) ? lin_horseshoe:lin;
+
+    // adjoint solve
+    const UVLM::Types::SparseMatrixX shedding =
+        UVLM::Adjoint::steady_wake_shedding(indices);
+    const UVLM::Types::MatrixX aic = lin_residual.aic_body +
+                                     lin_residual.aic_wake*shedding;
+    const UVLM::Types::MatrixX dforces_dgamma =
+        lin.dforces_dgamma + lin.dforces_dgamma_star*shedding;
+    Eigen::PartialPivLU<UVLM::Types::MatrixX> aic_lu(aic);
+    const UVLM::Types::MatrixX adjoint = aic_lu.transpose().solve(
+        UVLM::Types::MatrixX((dobjectives_dforces*dforces_dgamma).transpose()));
+
+    dobjectives_dzeta += dobjectives_dforces*lin.dforces_dzeta
+                       - adjoint.transpose()*lin_residual.dres_dzeta;
+}
@@ -0,0 +1,388 @@
+#pragma once
+
+#include "EigenInclude.h"
+#include "types.h"
+#include "dual.h"
+#include "constants.h"
+#include "geometry.h"
+#include "biotsavart.h"
+#include "matrix.h"
+#include "wake.h"
+#include "postproc.h"
+#include "linear_solver.h"
+#include "linear.h"
+
+#include <algorithm>
+#include <iostream>
+
+// Forward-mode derivatives of the steady VLM.
+// UVLM::AutoDiff::steady is UVLM::Steady::solver (without wake rollup)
+// templated on the scalar type of its containers. Instantiated with
+// UVLM::Types::Dual it returns, together with the solution, its
+// derivatives along every tangent direction seeded in zeta and uext.
+// The AIC is factorised only once for the values; the tangents of the
+// circulation come from
+//      gamma' = AIC^{-1} (rhs' - AIC' gamma)
+// (see UVLM::LinearSolver::solve_system).
+// Seeds, gamma and force derivatives are ordered as in linear.h.
+namespace UVLM
+{
+    namespace AutoDiff
+    {
+        // DECLARATIONS
+        template <typename t_zeta,
+                  typename t_uext,
+                  typename t_zeta_star,
+                  typename t_gamma,
+                  typename t_gamma_star,
+                  typename t_forces>
+        void steady
+        (
+            const t_zeta& zeta,
+            const t_uext& uext,
+            t_zeta_star& zeta_star,
+            t_gamma& gamma,
+            t_gamma_star& gamma_star,
+            t_forces& forces,
+            const UVLM::Types::VMopts& options,
+            const UVLM::Types::FlightConditions& flightconditions
+        );
+
+        template <uint t_n,
+                  typename t_zeta,
+                  typename t_uext,
+                  typename t_zeta_star,
+                  typename t_gamma,
+                  typename t_gamma_star,
+                  typename t_forces>
+        void steady_batch
+        (
+            const t_zeta& zeta,
+            const t_uext& uext,
+            t_zeta_star& zeta_star,
+            t_gamma& gamma,
+            t_gamma_star& gamma_star,
+            t_forces& forces,
+            const UVLM::Types::MatrixX& seeds,
+            const uint& first_direction,
+            UVLM::Types::MatrixX& dgamma,
+            UVLM::Types::MatrixX& dforces,
+            const UVLM::Types::VMopts& options,
+            const UVLM::Types::FlightConditions& flightconditions
+        );
+
+        template <typename t_zeta,
+                  typename t_uext,
+                  typename t_zeta_star,
+                  typename t_gamma,
+                  typename t_gamma_star,
+                  typename t_forces>
+        void steady_derivatives
+        (
+            const t_zeta& zeta,
+            const t_uext& uext,
+            t_zeta_star& zeta_star,
+            t_gamma& gamma,
+            t_gamma_star& gamma_star,
+            t_forces& forces,
+            const UVLM::Types::MatrixX& seeds,
+            UVLM::Types::MatrixX& dgamma,
+            UVLM::Types::MatrixX& dforces,
+            const UVLM::Types::VMopts& options,
+            const UVLM::Types::FlightConditions& flightconditions
+        );
+    }
+}
+
+
+// Same steps as UVLM::Steady::solver with n_rollup = 0:
+// horseshoe solution, then the discretised wake for the forces if
+// !options.horseshoe.
+template <typename t_zeta,
+          typename t_uext,
+          typename t_zeta_star,
+          typename t_gamma,
+          typename t_gamma_star,
+          typename t_forces>
+void UVLM::AutoDiff::steady
+(
+    const t_zeta& zeta,
+    const t_uext& uext,
+    t_zeta_star& zeta_star,
+    t_gamma& gamma,
+    t_gamma_star& gamma_star,
+    t_forces& forces,
+    const UVLM::Types::VMopts& options,
+    const UVLM::Types::FlightConditions& flightconditions
+)
+{
+    typedef typename t_gamma::value_type::Scalar t_scalar;
+    if (!options.horseshoe && options.n_rollup != 0)
+    {
+        std::cerr << "UVLM::AutoDiff::steady: wake rollup is not "
+                  << "differentiated, the wake is kept straight" << std::endl;
+    }
+
+    UVLM::Types::GenericVecVecMatrixX<t_scalar> zeta_col;
+    UVLM::Types::GenericVecVecMatrixX<t_scalar> uext_col;
+    UVLM::Geometry::generate_colocationMesh(zeta, zeta_col);
+    UVLM::Geometry::generate_colocationMesh(uext, uext_col);
+
+    UVLM::Types::GenericVecVecMatrixX<t_scalar> normals;
+    UVLM::Types::allocate_VecVecMat(normals, zeta_col);
+    UVLM::Geometry::generate_surfaceNormal(zeta, normals);
+
+    // init takes the wake by value (meant for maps)
+    UVLM::Wake::Horseshoe::init<t_zeta, t_zeta_star&>(zeta,
+                                                      zeta_star,
+                                                      flightconditions);
+
+    uint Ktotal = 0;
+    for (uint i_surf=0; i_surf<zeta_col.size(); ++i_surf)
+    {
+        Ktotal += zeta_col[i_surf][0].rows()*zeta_col[i_surf][0].cols();
+    }
+
+    UVLM::Types::GenericVectorX<t_scalar> rhs;
+    UVLM::Matrix::RHS(zeta_col,
+                      zeta_star,
+                      uext_col,
+                      gamma_star,
+                      normals,
+                      options,
+                      rhs,
+                      Ktotal);
+
+    UVLM::Types::GenericMatrixX<t_scalar> aic =
+        UVLM::Types::GenericMatrixX<t_scalar>::Zero(Ktotal, Ktotal);
+    UVLM::Matrix::AIC(Ktotal,
+                      zeta,
+                      zeta_col,
+                      zeta_star,
+                      uext_col,
+                      normals,
+                      options,
+                      true,
+                      aic);
+
+    UVLM::Types::GenericVectorX<t_scalar> gamma_flat;
+    UVLM::LinearSolver::solve_system(aic,
+                                     rhs,
+                                     options,
+                                     gamma_flat);
+    UVLM::Matrix::reconstruct_gamma(gamma_flat,
+                                    gamma,
+                                    zeta_col,
+                                    zeta_star,
+                                    options);
+    UVLM::Wake::Horseshoe::circulation_transfer(gamma,
+                                                gamma_star);
+
+    if (!options.horseshoe)
+    {
+        UVLM::Types::GenericVector3<t_scalar> u_steady;
+        u_steady << uext[0][0](0,0),
+                    uext[0][1](0,0),
+                    uext[0][2](0,0);
+        const t_scalar delta_x = u_steady.norm()*options.dt;
+        UVLM::Wake::Horseshoe::to_discretised(zeta_star,
+                                              gamma_star,
+                                              delta_x);
+    }
+
+    UVLM::PostProc::calculate_static_forces(zeta,
+                                            zeta_star,
+                                            gamma,
+                                            gamma_star,
+                                            uext,
+                                            forces,
+                                            options,
+                                            flightconditions);
+}
+
+
+// Directions first_direction to first_direction + t_n - 1 (the ones that
+// exist) of seeds, 6*K_zeta x n_directions: [dzeta; duext].
+// gamma, gamma_star, zeta_star and forces get the values of the solution.
+template <uint t_n,
+          typename t_zeta,
+          typename t_uext,
+          typename t_zeta_star,
+          typename t_gamma,
+          typename t_gamma_star,
+          typename t_forces>
+void UVLM::AutoDiff::steady_batch
+(
+    const t_zeta& zeta,
+    const t_uext& uext,
+    t_zeta_star& zeta_star,
+    t_gamma& gamma,
+    t_gamma_star& gamma_star,
+    t_forces& forces,
+    const UVLM::Types::MatrixX& seeds,
+    const uint& first_direction,
+    UVLM::Types::MatrixX& dgamma,
+    UVLM::Types::MatrixX& dforces,
+    const UVLM::Types::VMopts& options,
+    const UVLM::Types::FlightConditions& flightconditions
+)
+{
+    typedef UVLM::Types::Dual<t_n> t_dual;
+    const uint n_surf = zeta.size();
+    const uint n_batch = std::min(t_n, uint(seeds.cols()) - first_direction);
+
+    UVLM::Linear::Indices indices;
+    UVLM::Linear::generate_indices(zeta, zeta_star, indices);
+    const uint K_zeta = indices.K_zeta;
+
+    UVLM::Types::GenericVecVecMatrixX<t_dual> zeta_dual;
+    UVLM::Types::GenericVecVecMatrixX<t_dual> uext_dual;
+    UVLM::Types::GenericVecVecMatrixX<t_dual> zeta_star_dual;
+    UVLM::Types::GenericVecVecMatrixX<t_dual> forces_dual;
+    UVLM::Types::GenericVecMatrixX<t_dual> gamma_dual;
+    UVLM::Types::GenericVecMatrixX<t_dual> gamma_star_dual;
+    UVLM::Types::allocate_VecVecMat(zeta_dual, zeta);
+    UVLM::Types::allocate_VecVecMat(uext_dual, uext);
+    UVLM::Types::allocate_VecVecMat(zeta_star_dual, zeta_star);
+    UVLM::Types::allocate_VecVecMat(forces_dual, forces);
+    UVLM::Types::allocate_VecMat(gamma_dual, gamma);
+    UVLM::Types::allocate_VecMat(gamma_star_dual, gamma_star);
+
+    // seeding
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        for (uint i=0; i<indices.dimensions[i_surf].first + 1; ++i)
+        {
+            for (uint j=0; j<indices.dimensions[i_surf].second + 1; ++j)
+            {
+                const uint row = 3*indices.vertex(i_surf, i, j);
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    t_dual& zeta_ij = zeta_dual[i_surf][i_dim](i, j);
+                    t_dual& uext_ij = uext_dual[i_surf][i_dim](i, j);
+                    zeta_ij = zeta[i_surf][i_dim](i, j);
+                    uext_ij = uext[i_surf][i_dim](i, j);
+                    for (uint i_direction=0; i_direction<n_batch; ++i_direction)
+                    {
+                        const uint col = first_direction + i_direction;
+                        zeta_ij.tangent[i_direction] = seeds(row + i_dim, col);
+                        uext_ij.tangent[i_direction] = seeds(3*K_zeta + row + i_dim, col);
+                    }
+                }
+            }
+        }
+    }
+
+    UVLM::AutoDiff::steady(zeta_dual,
+                           uext_dual,
+                           zeta_star_dual,
+                           gamma_dual,
+                           gamma_star_dual,
+                           forces_dual,
+                           options,
+                           flightconditions);
+
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        const uint M = indices.dimensions[i_surf].first;
+        const uint N = indices.dimensions[i_surf].second;
+        for (uint i=0; i<M; ++i)
+        {
+            for (uint j=0; j<N; ++j)
+            {
+                const t_dual& gamma_ij = gamma_dual[i_surf](i, j);
+                gamma[i_surf](i, j) = gamma_ij.value;
+                for (uint i_direction=0; i_direction<n_batch; ++i_direction)
+                {
+                    dgamma(indices.gamma_offset[i_surf] + i*N + j,
+                           first_direction + i_direction) = gamma_ij.tangent[i_direction];
+                }
+            }
+        }
+        UVLM::Types::dual_value(gamma_star_dual[i_surf], gamma_star[i_surf]);
+        for (uint i_dim=0; i_dim<forces[i_surf].size(); ++i_dim)
+        {
+            UVLM::Types::dual_value(forces_dual[i_surf][i_dim],
+                                    forces[i_surf][i_dim]);
+        }
+        for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+        {
+            UVLM::Types::dual_value(zeta_star_dual[i_surf][i_dim],
+                                    zeta_star[i_surf][i_dim]);
+            for (uint i=0; i<M + 1; ++i)
+            {
+                for (uint j=0; j<N + 1; ++j)
+                {
+                    const t_dual& force_ij = forces_dual[i_surf][i_dim](i, j);
+                    const uint row = 3*indices.vertex(i_surf, i, j) + i_dim;
+                    for (uint i_direction=0; i_direction<n_batch; ++i_direction)
+                    {
+                        dforces(row, first_direction + i_direction) =
+                            force_ij.tangent[i_direction];
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+// Any number of directions, in batches of at most
+// UVLM::Types::max_dual_directions.
+// dgamma: K x n_directions
+// dforces: 3*K_zeta x n_directions
+template <typename t_zeta,
+          typename t_uext,
+          typename t_zeta_star,
+          typename t_gamma,
+          typename t_gamma_star,
+          typename t_forces>
+void UVLM::AutoDiff::steady_derivatives
+(
+    const t_zeta& zeta,
+    const t_uext& uext,
+    t_zeta_star& zeta_star,
+    t_gamma& gamma,
+    t_gamma_star& gamma_star,
+    t_forces& forces,
+    const UVLM::Types::MatrixX& seeds,
+    UVLM::Types::MatrixX& dgamma,
+    UVLM::Types::MatrixX& dforces,
+    const UVLM::Types::VMopts& options,
+    const UVLM::Types::FlightConditions& flightconditions
+)
+{
+    UVLM::Linear::Indices indices;
+    UVLM::Linear::generate_indices(zeta, zeta_star, indices);
+    const uint n_directions = seeds.cols();
+    if (seeds.rows() != 6*indices.K_zeta)
+    {
+        std::cerr << "UVLM::AutoDiff::steady_derivatives: seeds need "
+                  << 6*indices.K_zeta << " rows" << std::endl;
+        return;
+    }
+    dgamma.setZero(indices.K, n_directions);
+    dforces.setZero(3*indices.K_zeta, n_directions);
+
+    for (uint first=0; first<n_directions; first+=UVLM::Types::max_dual_directions)
+    {
+        const uint n_batch = std::min(UVLM::Types::max_dual_directions,
+                                      n_directions - first);
+        if (n_batch == 1)
+        {
+            UVLM::AutoDiff::steady_batch<1>(zeta, uext, zeta_star, gamma, gamma_star,
+                                            forces, seeds, first, dgamma, dforces,
+                                            options, flightconditions);
+        } else if (n_batch <= 4)
+        {
+            UVLM::AutoDiff::steady_batch<4>(zeta, uext, zeta_star, gamma, gamma_star,
+                                            forces, seeds, first, dgamma, dforces,
+                                            options, flightconditions);
+        } else
+        {
+            UVLM::AutoDiff::steady_batch<8>(zeta, uext, zeta_star, gamma, gamma_star,
+                                            forces, seeds, first, dgamma, dforces,
+                                            options, flightconditions);
+        }
+    }
+}
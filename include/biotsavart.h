@@ -4,10 +4,15 @@
 #include "types.h"
 #include "mapping.h"
 #include "debugutils.h"
+#include "threads.h"
+#include "fft.h"
 
 #include <limits>
 #include <math.h>
 #include <cmath>
+#include <vector>
+#include <algorithm>
+#include <array>
 
 // #define VORTEX_RADIUS 1e-5
 #define VORTEX_RADIUS 1e-2
@@ -16,6 +21,299 @@ namespace UVLM
 {
     namespace BiotSavart
     {
+        // Tile sizes of the segment kernels (segments_velocity and
+        // segments_influence): number of target points and of source
+        // segments kept in cache together.
+        struct TileSize
+        {
+            uint targets = 64;
+            uint segments = 256;
+        };
+
+        inline TileSize& tile_size()
+        {
+            static TileSize biot_savart_tile_size;
+            return biot_savart_tile_size;
+        }
+
+        // Wake vertices where total_induced_velocity_on_wake evaluates the
+        // Biot-Savart velocity: every stride-th row and column, always with
+        // the last ones (end of the wake and tips), plus all the vertices of
+        // the first edge rows (next to the trailing edge) and of the edge
+        // columns next to every tip, where the bound and tip vortices make
+        // the velocity too steep to interpolate.
+        // The rest are interpolated from them with tensor-product cubics.
+        // 1 evaluates all the vertices.
+        struct WakeStride
+        {
+            uint stride = 1;
+            uint edge = 4;
+        };
+
+        inline WakeStride& wake_stride()
+        {
+            static WakeStride biot_savart_wake_stride;
+            return biot_savart_wake_stride;
+        }
+
+        inline void strided_indices
+        (
+            const uint& n,
+            const uint& stride,
+            std::vector<uint>& indices,
+            const uint& n_first = 1,
+            const uint& n_last = 1
+        );
+
+        inline void cubic_weights
+        (
+            const std::vector<uint>& nodes,
+            const uint& index,
+            uint& first,
+            uint& n_nodes,
+            UVLM::Types::Real weights[4]
+        );
+
+        template <typename t_scalar,
+                  typename t_mat>
+        void interpolate_strided
+        (
+            const std::vector<t_scalar>& coarse,
+            const std::vector<uint>& row_nodes,
+            const std::vector<uint>& col_nodes,
+            t_mat& fine
+        );
+
+        // Particle-mesh (vortex-in-cell) evaluation of the wake velocities
+        // in total_induced_velocity_on_wake (see particle_mesh_velocity).
+        // nodes: mesh nodes along the longest side of the box of the wake
+        // (0: direct evaluation). The particles up to near_cells cells away
+        // from a target are evaluated directly.
+        struct ParticleMesh
+        {
+            uint nodes = 0;
+            uint near_cells = 2;
+        };
+
+        inline ParticleMesh& particle_mesh()
+        {
+            static ParticleMesh biot_savart_particle_mesh;
+            return biot_savart_particle_mesh;
+        }
+
+        // Semi-infinite closure of the discretised wakes (see
+        // wake_closure_velocity): the last row of every wake continues
+        // to infinity as a horseshoe with its circulation instead of
+        // ending in a starting vortex.
+        // Only for the unsteady wakes: the steady solver (options.Steady)
+        // solves with a finite wake, so its rollup and forces leave the
+        // closure out too.
+        struct WakeClosure
+        {
+            bool horseshoe = false;
+        };
+
+        inline WakeClosure& wake_closure()
+        {
+            static WakeClosure biot_savart_wake_closure;
+            return biot_savart_wake_closure;
+        }
+
+        // Points in structure of arrays form
+        template <typename t_scalar>
+        struct Points
+        {
+            std::vector<t_scalar> x;
+            std::vector<t_scalar> y;
+            std::vector<t_scalar> z;
+
+            void resize(const uint& n)
+            {
+                x.assign(n, t_scalar(0.0));
+                y.assign(n, t_scalar(0.0));
+                z.assign(n, t_scalar(0.0));
+            }
+            uint size() const {return x.size();}
+
+            void append(const Points& other)
+            {
+                x.insert(x.end(), other.x.begin(), other.x.end());
+                y.insert(y.end(), other.y.begin(), other.y.end());
+                z.insert(z.end(), other.z.begin(), other.z.end());
+            }
+        };
+
+        // Vortex segments of one or more lattices, in structure of arrays
+        // form. A segment shared by two rings is stored once: it adds to
+        // the output of ring_a with weight_a and subtracts from the output
+        // of ring_b with weight_b (ring -1: no ring on that side).
+        template <typename t_scalar>
+        struct Segments
+        {
+            std::vector<t_scalar> x1;
+            std::vector<t_scalar> y1;
+            std::vector<t_scalar> z1;
+            std::vector<t_scalar> x2;
+            std::vector<t_scalar> y2;
+            std::vector<t_scalar> z2;
+            std::vector<int> ring_a;
+            std::vector<int> ring_b;
+            std::vector<t_scalar> weight_a;
+            std::vector<t_scalar> weight_b;
+
+            uint size() const {return x1.size();}
+        };
+
+        template <typename t_gamma_star>
+        int shed_rows
+        (
+            const t_gamma_star& gamma_star,
+            const int& n_rows = -1
+        );
+
+        template <typename t_zeta_star,
+                  typename t_gamma_star,
+                  typename t_scalar>
+        void wake_closure_velocity
+        (
+            const t_zeta_star& zeta_star,
+            const t_gamma_star& gamma_star,
+            const UVLM::BiotSavart::Points<t_scalar>& targets,
+            UVLM::BiotSavart::Points<t_scalar>& uout,
+            const int& n_rows = -1
+        );
+
+        template <typename t_zeta,
+                  typename t_gamma,
+                  typename t_ring,
+                  typename t_scalar>
+        void lattice_segments
+        (
+            const t_zeta& zeta,
+            const t_gamma& gamma,
+            const t_ring& ring_index,
+            UVLM::BiotSavart::Segments<t_scalar>& segments,
+            const uint& Mstart = 0
+        );
+
+        template <typename t_surface,
+                  typename t_scalar>
+        void surface_points
+        (
+            const t_surface& surface,
+            UVLM::BiotSavart::Points<t_scalar>& points,
+            const uint& row_begin = 0,
+            int row_end = -1
+        );
+
+        template <typename t_scalar>
+        void segments_velocity
+        (
+            const UVLM::BiotSavart::Segments<t_scalar>& segments,
+            const UVLM::BiotSavart::Points<t_scalar>& targets,
+            UVLM::BiotSavart::Points<t_scalar>& uout,
+            const UVLM::Types::Real vortex_radius = VORTEX_RADIUS
+        );
+
+        template <typename t_scalar,
+                  typename t_uout>
+        void segments_influence
+        (
+            const UVLM::BiotSavart::Segments<t_scalar>& segments,
+            const UVLM::BiotSavart::Points<t_scalar>& targets,
+            const UVLM::BiotSavart::Points<t_scalar>& normals,
+            t_uout& uout,
+            const UVLM::Types::Real vortex_radius = VORTEX_RADIUS
+        );
+
+        // Morton (Z-order) permutation of targets and sources, so that
+        // points close in space are close in memory whatever the shape of
+        // the lattice (swept, rolled-up wakes) and a tile of targets or
+        // segments is spatially compact.
+        inline uint64_t morton_code
+        (
+            const uint& ix,
+            const uint& iy,
+            const uint& iz
+        );
+
+        template <typename t_scalar>
+        void morton_order
+        (
+            const std::vector<t_scalar>& x,
+            const std::vector<t_scalar>& y,
+            const std::vector<t_scalar>& z,
+            std::vector<uint>& order
+        );
+
+        template <typename t_scalar>
+        void sort_points
+        (
+            const UVLM::BiotSavart::Points<t_scalar>& points,
+            const std::vector<uint>& order,
+            UVLM::BiotSavart::Points<t_scalar>& sorted,
+            const uint& begin = 0,
+            int end = -1
+        );
+
+        template <typename t_scalar>
+        void unsort_points
+        (
+            const UVLM::BiotSavart::Points<t_scalar>& sorted,
+            const std::vector<uint>& order,
+            UVLM::BiotSavart::Points<t_scalar>& points
+        );
+
+        template <typename t_scalar>
+        void sort_segments
+        (
+            UVLM::BiotSavart::Segments<t_scalar>& segments
+        );
+
+        template <typename t_scalar>
+        void induced_velocity
+        (
+            const UVLM::BiotSavart::Segments<t_scalar>& segments,
+            const UVLM::BiotSavart::Points<t_scalar>& targets,
+            UVLM::BiotSavart::Points<t_scalar>& uout,
+            const UVLM::Types::Real vortex_radius = VORTEX_RADIUS
+        );
+
+        template <typename t_scalar>
+        void particle_mesh_velocity
+        (
+            const UVLM::BiotSavart::Segments<t_scalar>& segments,
+            const UVLM::BiotSavart::Points<t_scalar>& targets,
+            UVLM::BiotSavart::Points<t_scalar>& uout,
+            const UVLM::Types::Real vortex_radius = VORTEX_RADIUS
+        );
+
+        inline void particle_mesh_velocity
+        (
+            const UVLM::BiotSavart::Segments<UVLM::Types::Real>& segments,
+            const UVLM::BiotSavart::Points<UVLM::Types::Real>& targets,
+            UVLM::BiotSavart::Points<UVLM::Types::Real>& uout,
+            const UVLM::Types::Real vortex_radius = VORTEX_RADIUS
+        );
+
+        inline UVLM::Types::Vector3 mesh_kernel
+        (
+            const int& di,
+            const int& dj,
+            const int& dk,
+            const UVLM::Types::Real& h
+        );
+
+        inline void mesh_weights
+        (
+            const UVLM::Types::Vector3& x,
+            const UVLM::Types::Vector3& origin,
+            const UVLM::Types::Real& h,
+            const uint n[3],
+            int base[3],
+            UVLM::Types::Real weights[8]
+        );
+
         // DECLARATIONS
         template <typename t_zeta,
                   typename t_gamma,
@@ -131,40 +429,99 @@ namespace UVLM
             const int&          n_rows = -1 // default val = -1
         );
 
+        // The kernels are templated on the scalar type of uind
+        // (UVLM::Types::Real or UVLM::Types::Dual, see dual.h)
         template <typename t_triad,
-                  typename t_block>
+                  typename t_block,
+                  typename t_uind>
         void vortex_ring
         (
             const t_triad& target_triad,
             const t_block& x,
             const t_block& y,
             const t_block& z,
-            const UVLM::Types::Real& gamma_star,
-            UVLM::Types::Vector3& uind,
+            const typename t_uind::Scalar& gamma_star,
+            t_uind& uind,
             const UVLM::Types::Real vortex_radius = VORTEX_RADIUS
         );
 
         template <typename t_triad,
-                  typename t_block>
+                  typename t_block,
+                  typename t_uind>
         void horseshoe
         (
             const t_triad& target_triad,
             const t_block& x,
             const t_block& y,
             const t_block& z,
-            const UVLM::Types::Real& gamma,
-            UVLM::Types::Vector3& uind,
+            const typename t_uind::Scalar& gamma,
+            t_uind& uind,
             const UVLM::Types::Real vortex_radius = VORTEX_RADIUS
         );
 
-        template <typename t_triad>
+        template <typename t_triad,
+                  typename t_uind>
         void segment
+        (
+            const t_triad& target_triad,
+            const t_uind& v1,
+            const t_uind& v2,
+            const typename t_uind::Scalar& gamma,
+            t_uind& uind,
+            const UVLM::Types::Real vortex_radius = VORTEX_RADIUS
+        );
+
+        template <typename t_triad>
+        void segment_derivatives
         (
             const t_triad& target_triad,
             const UVLM::Types::Vector3& v1,
             const UVLM::Types::Vector3& v2,
             const UVLM::Types::Real& gamma,
-            UVLM::Types::Vector3& uind,
+            UVLM::Types::Matrix3& duind_dtarget,
+            UVLM::Types::Matrix3& duind_dv1,
+            UVLM::Types::Matrix3& duind_dv2,
+            const UVLM::Types::Real vortex_radius = VORTEX_RADIUS
+        );
+
+        template <typename t_triad>
+        void semi_infinite_segment_derivatives
+        (
+            const t_triad& target_triad,
+            const UVLM::Types::Vector3& v_finite,
+            const UVLM::Types::Vector3& v_far,
+            const UVLM::Types::Real& gamma,
+            UVLM::Types::Matrix3& duind_dtarget,
+            UVLM::Types::Matrix3& duind_dv_finite,
+            UVLM::Types::Matrix3& duind_dv_far,
+            const UVLM::Types::Real vortex_radius = VORTEX_RADIUS
+        );
+
+        template <typename t_triad,
+                  typename t_block>
+        void horseshoe_derivatives
+        (
+            const t_triad& target_triad,
+            const t_block& x,
+            const t_block& y,
+            const t_block& z,
+            const UVLM::Types::Real& gamma,
+            UVLM::Types::Matrix3& duind_dtarget,
+            UVLM::Types::Matrix3 duind_dcorner[4],
+            const UVLM::Types::Real vortex_radius = VORTEX_RADIUS
+        );
+
+        template <typename t_triad,
+                  typename t_block>
+        void vortex_ring_derivatives
+        (
+            const t_triad& target_triad,
+            const t_block& x,
+            const t_block& y,
+            const t_block& z,
+            const UVLM::Types::Real& gamma,
+            UVLM::Types::Matrix3& duind_dtarget,
+            UVLM::Types::Matrix3 duind_dcorner[4],
             const UVLM::Types::Real vortex_radius = VORTEX_RADIUS
         );
 
@@ -183,7 +540,10 @@ namespace UVLM
             const t_gamma_star& gamma_star,
             t_uout&             uout,
             const bool&         image_method = false,
-            const UVLM::Types::Real vortex_radius = VORTEX_RADIUS
+            const UVLM::Types::Real vortex_radius = VORTEX_RADIUS,
+            const int&          n_wake_rows = -1,
+            const int&          n_target_rows = -1,
+            const bool&         closure = true
         );
 
 
@@ -225,27 +585,29 @@ namespace UVLM
 
 
 // SOURCE CODE
-template <typename t_triad>
+template <typename t_triad,
+          typename t_uind>
 void UVLM::BiotSavart::segment
         (
             const t_triad& rp,
-            const UVLM::Types::Vector3& v1,
-            const UVLM::Types::Vector3& v2,
-            const UVLM::Types::Real& gamma,
-            UVLM::Types::Vector3& uind,
+            const t_uind& v1,
+            const t_uind& v2,
+            const typename t_uind::Scalar& gamma,
+            t_uind& uind,
             const UVLM::Types::Real vortex_radius
         )
 {
-    UVLM::Types::Vector3 r0 = v2 - v1;
-    UVLM::Types::Vector3 r1 = rp - v1;
-    UVLM::Types::Vector3 r2 = rp - v2;
-    UVLM::Types::Vector3 r1_cross_r2 = r1.cross(r2);
-    UVLM::Types::Real r1_cross_r2_mod_sq = r1_cross_r2.squaredNorm();
+    typedef typename t_uind::Scalar t_scalar;
+    t_uind r0 = v2 - v1;
+    t_uind r1 = rp - v1;
+    t_uind r2 = rp - v2;
+    t_uind r1_cross_r2 = r1.cross(r2);
+    t_scalar r1_cross_r2_mod_sq = r1_cross_r2.squaredNorm();
 
-    UVLM::Types::Real r1_mod = r1.norm();
-    UVLM::Types::Real r2_mod = r2.norm();
+    t_scalar r1_mod = r1.norm();
+    t_scalar r2_mod = r2.norm();
 
-    UVLM::Types::Real relative_vortex_radius = r0.norm()*vortex_radius;
+    t_scalar relative_vortex_radius = r0.norm()*vortex_radius;
 
     if (r1_mod < relative_vortex_radius ||
         r2_mod < relative_vortex_radius ||
@@ -254,10 +616,10 @@ void UVLM::BiotSavart::segment
         return;
     }
 
-    UVLM::Types::Real r0_dot_r1 = r0.dot(r1);
-    UVLM::Types::Real r0_dot_r2 = r0.dot(r2);
+    t_scalar r0_dot_r1 = r0.dot(r1);
+    t_scalar r0_dot_r2 = r0.dot(r2);
 
-    UVLM::Types::Real K;
+    t_scalar K;
     K = (gamma/(UVLM::Constants::PI4*r1_cross_r2_mod_sq))*
         (r0_dot_r1/r1_mod - r0_dot_r2/r2_mod);
     uind += K*r1_cross_r2;
@@ -276,19 +638,89 @@ void UVLM::BiotSavart::segment
 }
 
 
+// Derivatives of the velocity induced by a segment (see segment)
+// with respect to the target point and both vertices.
+// With r1 = rp - v1, r2 = rp - v2 and c = r1 x r2, the kernel is
+//      u = gamma/(4 pi) f/|c|^2 c
+//      f = |r1| + |r2| - (r1.r2)(1/|r1| + 1/|r2|)
+// so d/drp = d/dr1 + d/dr2, d/dv1 = -d/dr1 and d/dv2 = -d/dr2.
+// The derivatives are added to the output matrices.
+template <typename t_triad>
+void UVLM::BiotSavart::segment_derivatives
+        (
+            const t_triad& rp,
+            const UVLM::Types::Vector3& v1,
+            const UVLM::Types::Vector3& v2,
+            const UVLM::Types::Real& gamma,
+            UVLM::Types::Matrix3& duind_drp,
+            UVLM::Types::Matrix3& duind_dv1,
+            UVLM::Types::Matrix3& duind_dv2,
+            const UVLM::Types::Real vortex_radius
+        )
+{
+    UVLM::Types::Vector3 r0 = v2 - v1;
+    UVLM::Types::Vector3 r1 = rp - v1;
+    UVLM::Types::Vector3 r2 = rp - v2;
+    UVLM::Types::Vector3 r1_cross_r2 = r1.cross(r2);
+    UVLM::Types::Real r1_cross_r2_mod_sq = r1_cross_r2.squaredNorm();
+
+    UVLM::Types::Real r1_mod = r1.norm();
+    UVLM::Types::Real r2_mod = r2.norm();
+
+    UVLM::Types::Real relative_vortex_radius = r0.norm()*vortex_radius;
+
+    if (r1_mod < relative_vortex_radius ||
+        r2_mod < relative_vortex_radius ||
+        r1_cross_r2_mod_sq < relative_vortex_radius*relative_vortex_radius)
+    {
+        return;
+    }
+
+    const UVLM::Types::Real r1_dot_r2 = r1.dot(r2);
+    const UVLM::Types::Real inv_sum = 1.0/r1_mod + 1.0/r2_mod;
+    const UVLM::Types::Real f = r1_mod + r2_mod - r1_dot_r2*inv_sum;
+    const UVLM::Types::Real g = f/r1_cross_r2_mod_sq;
+
+    const UVLM::Types::Vector3 df_dr1 = r1/r1_mod - r2*inv_sum +
+                                        r1_dot_r2/(r1_mod*r1_mod*r1_mod)*r1;
+    const UVLM::Types::Vector3 df_dr2 = r2/r2_mod - r1*inv_sum +
+                                        r1_dot_r2/(r2_mod*r2_mod*r2_mod)*r2;
+    // d|c|^2/dr1 = 2 r2 x c; d|c|^2/dr2 = 2 c x r1
+    const UVLM::Types::Vector3 dc2_dr1 = 2.0*r2.cross(r1_cross_r2);
+    const UVLM::Types::Vector3 dc2_dr2 = 2.0*r1_cross_r2.cross(r1);
+    const UVLM::Types::Vector3 dg_dr1 = df_dr1/r1_cross_r2_mod_sq -
+                                        f/(r1_cross_r2_mod_sq*r1_cross_r2_mod_sq)*dc2_dr1;
+    const UVLM::Types::Vector3 dg_dr2 = df_dr2/r1_cross_r2_mod_sq -
+                                        f/(r1_cross_r2_mod_sq*r1_cross_r2_mod_sq)*dc2_dr2;
+
+    // dc/dr1 = -[r2]x; dc/dr2 = [r1]x
+    const UVLM::Types::Real factor = gamma/UVLM::Constants::PI4;
+    const UVLM::Types::Matrix3 du_dr1 = factor*(r1_cross_r2*dg_dr1.transpose() -
+                                                g*UVLM::Triads::skew(r2));
+    const UVLM::Types::Matrix3 du_dr2 = factor*(r1_cross_r2*dg_dr2.transpose() +
+                                                g*UVLM::Triads::skew(r1));
+
+    duind_drp += du_dr1 + du_dr2;
+    duind_dv1 -= du_dr1;
+    duind_dv2 -= du_dr2;
+}
+
+
 template <typename t_triad,
-          typename t_block>
+          typename t_block,
+          typename t_uind>
 void UVLM::BiotSavart::horseshoe
 (
     const t_triad& target_triad,
     const t_block& x,
     const t_block& y,
     const t_block& z,
-    const UVLM::Types::Real& gamma_star,
-    UVLM::Types::Vector3& uind,
+    const typename t_uind::Scalar& gamma_star,
+    t_uind& uind,
     const UVLM::Types::Real vortex_radius
 )
 {
+    typedef typename t_uind::Scalar t_scalar;
     // three segments.
     //
     //     0___________3
@@ -305,8 +737,8 @@ void UVLM::BiotSavart::horseshoe
     // infinite
     // segment 3-0 is considered as a normal one
 
-    UVLM::Types::Vector3 v1;
-    UVLM::Types::Vector3 v2;
+    t_uind v1;
+    t_uind v2;
     // segment 3-0
     v1 << x(UVLM::Mapping::vortex_indices(3, 0),
             UVLM::Mapping::vortex_indices(3, 1)),
@@ -342,14 +774,14 @@ void UVLM::BiotSavart::horseshoe
 
     // here the segment will be considered as 1----->2 and the
     // point 2 is in infinity, so beta2=pi
-    UVLM::Types::Vector3 r0 = v2 - v1;
-    UVLM::Types::Vector3 r1 = target_triad - v1;
-    UVLM::Types::Vector3 r2 = target_triad - v2;
-    UVLM::Types::Vector3 r1_cross_r2 = r1.cross(r2);
-    UVLM::Types::Real dist = (r1_cross_r2).norm()/r0.norm();
-    UVLM::Types::Real beta1;
-    UVLM::Types::Real beta2;
-    UVLM::Types::Vector3 u_radial;
+    t_uind r0 = v2 - v1;
+    t_uind r1 = target_triad - v1;
+    t_uind r2 = target_triad - v2;
+    t_uind r1_cross_r2 = r1.cross(r2);
+    t_scalar dist = (r1_cross_r2).norm()/r0.norm();
+    t_scalar beta1;
+    t_scalar beta2;
+    t_uind u_radial;
     if (!((r1.norm() < vortex_radius) ||
          (r2.norm() < vortex_radius) ||
          (r1_cross_r2.norm() < vortex_radius)))
@@ -400,25 +832,27 @@ void UVLM::BiotSavart::horseshoe
 
 
 template <typename t_triad,
-          typename t_block>
+          typename t_block,
+          typename t_uind>
 void UVLM::BiotSavart::vortex_ring
 (
     const t_triad& target_triad,
     const t_block& x,
     const t_block& y,
     const t_block& z,
-    const UVLM::Types::Real& gamma,
-    UVLM::Types::Vector3& uind,
+    const typename t_uind::Scalar& gamma,
+    t_uind& uind,
     const UVLM::Types::Real vortex_radius
 )
 {
-    if (std::abs(gamma) < UVLM::Constants::EPSILON)
+    using UVLM::Types::is_zero;
+    if (is_zero(gamma, UVLM::Constants::EPSILON))
     {
         return;
     }
 
-    UVLM::Types::Vector3 v1;
-    UVLM::Types::Vector3 v2;
+    t_uind v1;
+    t_uind v2;
     const unsigned int n_segment = 4;
     for (unsigned int i_segment=0; i_segment<n_segment; ++i_segment)
     {
@@ -447,73 +881,249 @@ void UVLM::BiotSavart::vortex_ring
 }
 
 
-template <typename t_zeta,
-          typename t_gamma,
-          typename t_ttriad,
-          typename t_uout>
-void UVLM::BiotSavart::surface
+// Derivatives of the semi-infinite legs of UVLM::BiotSavart::horseshoe.
+// The leg starts at v_finite and goes to infinity in the direction of
+// v_far. With r = rp - v_finite and d = (v_far - v_finite)/|v_far - v_finite|
+// the kernel is
+//      u = gamma/(4 pi) (1 + d.r/|r|)/|d x r|^2 (d x r)
+// A leg that comes from infinity (segment 2-3 of the horseshoe) is the
+// same with -gamma.
+// The derivatives are added to the output matrices.
+template <typename t_triad>
+void UVLM::BiotSavart::semi_infinite_segment_derivatives
 (
-    const t_zeta&       zeta,
-    const t_gamma&      gamma,
-    const t_ttriad&     target_triad,
-    t_uout&             uout,
-    unsigned int        Mstart,
-    unsigned int        Nstart,
-    unsigned int        Mend,
-    unsigned int        Nend,
-    const bool&         image_method,
+    const t_triad& rp,
+    const UVLM::Types::Vector3& v_finite,
+    const UVLM::Types::Vector3& v_far,
+    const UVLM::Types::Real& gamma,
+    UVLM::Types::Matrix3& duind_drp,
+    UVLM::Types::Matrix3& duind_dv_finite,
+    UVLM::Types::Matrix3& duind_dv_far,
     const UVLM::Types::Real vortex_radius
 )
 {
-    // If Mend or Nend are == -1, their values are taken as the surface M and N
-    if (Mend == -1) {Mend = gamma.rows();}
-    if (Nend == -1) {Nend = gamma.cols();}
-
-    UVLM::Types::Vector3 temp_uout;
-    for (unsigned int i=Mstart; i<Mend; ++i)
+    const UVLM::Types::Vector3 r = rp - v_finite;
+    const UVLM::Types::Vector3 r_far = rp - v_far;
+    const UVLM::Types::Vector3 r0 = v_far - v_finite;
+    const UVLM::Types::Real r0_mod = r0.norm();
+    const UVLM::Types::Vector3 d = r0/r0_mod;
+    // same cutoff as the kernel
+    if ((r.norm() < vortex_radius) ||
+        (r_far.norm() < vortex_radius) ||
+        (r.cross(r_far).norm() < vortex_radius))
     {
-        for (unsigned int j=Nstart; j<Nend; ++j)
-        {
-            temp_uout.setZero();
-            UVLM::BiotSavart::vortex_ring(target_triad,
-                                          zeta[0].template block<2, 2>(i,j),
-                                          zeta[1].template block<2, 2>(i,j),
-                                          zeta[2].template block<2, 2>(i,j),
-                                          gamma(i,j),
-                                          temp_uout);
-            uout[0](i, j) += temp_uout(0);
-            uout[1](i, j) += temp_uout(1);
-            uout[2](i, j) += temp_uout(2);
-        }
+        return;
     }
+
+    const UVLM::Types::Real r_mod = r.norm();
+    const UVLM::Types::Vector3 a = d.cross(r);
+    const UVLM::Types::Real a_sq = a.squaredNorm();
+    const UVLM::Types::Real h = 1.0 + d.dot(r)/r_mod;
+    const UVLM::Types::Real factor = gamma/UVLM::Constants::PI4;
+
+    // with respect to r: da/dr = [d]x
+    const UVLM::Types::Matrix3 skew_d = UVLM::Triads::skew(d);
+    const UVLM::Types::Vector3 dh_dr = d/r_mod - d.dot(r)/(r_mod*r_mod*r_mod)*r;
+    const UVLM::Types::Matrix3 du_dr = factor*
+        (a*dh_dr.transpose()/a_sq +
+         h/a_sq*skew_d -
+         2.0*h/(a_sq*a_sq)*a*(a.transpose()*skew_d));
+
+    // with respect to d: da/dd = -[r]x
+    const UVLM::Types::Matrix3 skew_r = UVLM::Triads::skew(r);
+    const UVLM::Types::Vector3 dh_dd = r/r_mod;
+    const UVLM::Types::Matrix3 du_dd = factor*
+        (a*dh_dd.transpose()/a_sq -
+         h/a_sq*skew_r +
+         2.0*h/(a_sq*a_sq)*a*(a.transpose()*skew_r));
+    const UVLM::Types::Matrix3 dd_dr0 =
+        (UVLM::Types::Matrix3::Identity() - d*d.transpose())/r0_mod;
+    const UVLM::Types::Matrix3 du_dr0 = du_dd*dd_dr0;
+
+    duind_drp += du_dr;
+    duind_dv_finite -= du_dr + du_dr0;
+    duind_dv_far += du_dr0;
 }
 
 
-template <typename t_zeta,
-          typename t_zeta_star,
-          typename t_gamma,
-          typename t_gamma_star,
-          typename t_ttriad,
-          typename t_uout>
-void UVLM::BiotSavart::surface_with_steady_wake
+// Derivatives of UVLM::BiotSavart::horseshoe with respect to the target
+// point and the four corners of the block.
+// Results are added to the outputs.
+template <typename t_triad,
+          typename t_block>
+void UVLM::BiotSavart::horseshoe_derivatives
 (
-    const t_zeta&       zeta,
-    const t_zeta_star&  zeta_star,
-    const t_gamma&      gamma,
-    const t_gamma_star& gamma_star,
-    const t_ttriad&     target_triad,
-    const bool&         horseshoe,
-    t_uout&             uout,
-    const bool&         image_method,
+    const t_triad& target_triad,
+    const t_block& x,
+    const t_block& y,
+    const t_block& z,
+    const UVLM::Types::Real& gamma,
+    UVLM::Types::Matrix3& duind_dtarget,
+    UVLM::Types::Matrix3 duind_dcorner[4],
     const UVLM::Types::Real vortex_radius
 )
 {
-    const uint Mstart = 0;
-    const uint Nstart = 0;
-    const uint Mend = gamma.rows();
-    const uint Nend = gamma.cols();
-
-    UVLM::Types::Vector3 temp_uout;
+    UVLM::Types::Vector3 corner[4];
+    for (uint i_corner=0; i_corner<4; ++i_corner)
+    {
+        corner[i_corner] << x(UVLM::Mapping::vortex_indices(i_corner, 0),
+                              UVLM::Mapping::vortex_indices(i_corner, 1)),
+                            y(UVLM::Mapping::vortex_indices(i_corner, 0),
+                              UVLM::Mapping::vortex_indices(i_corner, 1)),
+                            z(UVLM::Mapping::vortex_indices(i_corner, 0),
+                              UVLM::Mapping::vortex_indices(i_corner, 1));
+    }
+
+    // segment 3-0
+    UVLM::BiotSavart::segment_derivatives(target_triad,
+                                          corner[3],
+                                          corner[0],
+                                          gamma,
+                                          duind_dtarget,
+                                          duind_dcorner[3],
+                                          duind_dcorner[0]);
+    // segment 0-1, from 0 to infinity
+    UVLM::BiotSavart::semi_infinite_segment_derivatives(target_triad,
+                                                        corner[0],
+                                                        corner[1],
+                                                        gamma,
+                                                        duind_dtarget,
+                                                        duind_dcorner[0],
+                                                        duind_dcorner[1],
+                                                        vortex_radius);
+    // segment 2-3, from infinity to 3
+    UVLM::BiotSavart::semi_infinite_segment_derivatives(target_triad,
+                                                        corner[3],
+                                                        corner[2],
+                                                        -gamma,
+                                                        duind_dtarget,
+                                                        duind_dcorner[3],
+                                                        duind_dcorner[2],
+                                                        vortex_radius);
+}
+
+
+// Derivatives of the velocity induced by a vortex ring with respect to
+// the target point and the four corners, numbered as in
+// UVLM::Mapping::vortex_indices. Results are added to the outputs.
+template <typename t_triad,
+          typename t_block>
+void UVLM::BiotSavart::vortex_ring_derivatives
+(
+    const t_triad& target_triad,
+    const t_block& x,
+    const t_block& y,
+    const t_block& z,
+    const UVLM::Types::Real& gamma,
+    UVLM::Types::Matrix3& duind_dtarget,
+    UVLM::Types::Matrix3 duind_dcorner[4],
+    const UVLM::Types::Real vortex_radius
+)
+{
+    if (std::abs(gamma) < UVLM::Constants::EPSILON)
+    {
+        return;
+    }
+
+    UVLM::Types::Vector3 v1;
+    UVLM::Types::Vector3 v2;
+    const unsigned int n_segment = 4;
+    for (unsigned int i_segment=0; i_segment<n_segment; ++i_segment)
+    {
+        unsigned int start = i_segment;
+        unsigned int end = (start + 1)%n_segment;
+
+        v1 << x(UVLM::Mapping::vortex_indices(start, 0),
+                UVLM::Mapping::vortex_indices(start, 1)),
+              y(UVLM::Mapping::vortex_indices(start, 0),
+                UVLM::Mapping::vortex_indices(start, 1)),
+              z(UVLM::Mapping::vortex_indices(start, 0),
+                UVLM::Mapping::vortex_indices(start, 1));
+        v2 << x(UVLM::Mapping::vortex_indices(end, 0),
+                UVLM::Mapping::vortex_indices(end, 1)),
+              y(UVLM::Mapping::vortex_indices(end, 0),
+                UVLM::Mapping::vortex_indices(end, 1)),
+              z(UVLM::Mapping::vortex_indices(end, 0),
+                UVLM::Mapping::vortex_indices(end, 1));
+
+        UVLM::BiotSavart::segment_derivatives(target_triad,
+                                              v1,
+                                              v2,
+                                              gamma,
+                                              duind_dtarget,
+                                              duind_dcorner[start],
+                                              duind_dcorner[end]);
+    }
+}
+
+
+template <typename t_zeta,
+          typename t_gamma,
+          typename t_ttriad,
+          typename t_uout>
+void UVLM::BiotSavart::surface
+(
+    const t_zeta&       zeta,
+    const t_gamma&      gamma,
+    const t_ttriad&     target_triad,
+    t_uout&             uout,
+    unsigned int        Mstart,
+    unsigned int        Nstart,
+    unsigned int        Mend,
+    unsigned int        Nend,
+    const bool&         image_method,
+    const UVLM::Types::Real vortex_radius
+)
+{
+    // If Mend or Nend are == -1, their values are taken as the surface M and N
+    if (Mend == -1) {Mend = gamma.rows();}
+    if (Nend == -1) {Nend = gamma.cols();}
+
+    UVLM::Types::GenericVector3<typename t_uout::value_type::Scalar> temp_uout;
+    for (unsigned int i=Mstart; i<Mend; ++i)
+    {
+        for (unsigned int j=Nstart; j<Nend; ++j)
+        {
+            temp_uout.setZero();
+            UVLM::BiotSavart::vortex_ring(target_triad,
+                                          zeta[0].template block<2, 2>(i,j),
+                                          zeta[1].template block<2, 2>(i,j),
+                                          zeta[2].template block<2, 2>(i,j),
+                                          gamma(i,j),
+                                          temp_uout);
+            uout[0](i, j) += temp_uout(0);
+            uout[1](i, j) += temp_uout(1);
+            uout[2](i, j) += temp_uout(2);
+        }
+    }
+}
+
+
+template <typename t_zeta,
+          typename t_zeta_star,
+          typename t_gamma,
+          typename t_gamma_star,
+          typename t_ttriad,
+          typename t_uout>
+void UVLM::BiotSavart::surface_with_steady_wake
+(
+    const t_zeta&       zeta,
+    const t_zeta_star&  zeta_star,
+    const t_gamma&      gamma,
+    const t_gamma_star& gamma_star,
+    const t_ttriad&     target_triad,
+    const bool&         horseshoe,
+    t_uout&             uout,
+    const bool&         image_method,
+    const UVLM::Types::Real vortex_radius
+)
+{
+    const uint Mstart = 0;
+    const uint Nstart = 0;
+    const uint Mend = gamma.rows();
+    const uint Nend = gamma.cols();
+
+    UVLM::Types::GenericVector3<typename t_uout::value_type::Scalar> temp_uout;
     const uint ii = 0;
     for (unsigned int i=Mstart; i<Mend; ++i)
     {
@@ -652,51 +1262,27 @@ void UVLM::BiotSavart::multisurface
     const UVLM::Types::Real vortex_radius
 )
 {
-    const unsigned int rows_collocation = target_surface[0].rows();
-    const unsigned int cols_collocation = target_surface[0].cols();
-
-    UVLM::Types::VecMatrixX temp_uout;
-    UVLM::Types::allocate_VecMat(temp_uout, zeta, -1);
-
-    int collocation_counter = -1;
-    int surface_counter;
-    for (unsigned int i_col=0; i_col<rows_collocation; ++i_col)
-    {
-        for (unsigned int j_col=0; j_col<cols_collocation; ++j_col)
-        {
-            ++collocation_counter;
-            UVLM::Types::initialise_VecMat(temp_uout, 0.0);
-            UVLM::Types::Vector3 target_triad;
-            target_triad << target_surface[0](i_col, j_col),
-                            target_surface[1](i_col, j_col),
-                            target_surface[2](i_col, j_col);
-            UVLM::BiotSavart::surface(zeta,
-                                      gamma,
-                                      target_triad,
-                                      temp_uout);
-            unsigned int surf_rows = gamma.rows();
-            unsigned int surf_cols = gamma.cols();
-
-                surface_counter = -1;
-                for (unsigned int i_surf=0; i_surf<surf_rows; ++i_surf)
-                {
-                    for (unsigned int j_surf=0; j_surf<surf_cols; ++j_surf)
-                    {
-                        ++surface_counter;
-                        uout(collocation_counter, surface_counter) +=
-                            temp_uout[0](i_surf, j_surf)*normal[0](i_col, j_col) +
-                            temp_uout[1](i_surf, j_surf)*normal[1](i_col, j_col) +
-                            temp_uout[2](i_surf, j_surf)*normal[2](i_col, j_col);
-                    }
-                }
-        }
-    }
+    typedef typename t_uout::Scalar t_scalar;
+    const uint surf_cols = gamma.cols();
+    UVLM::BiotSavart::Segments<t_scalar> segments;
+    UVLM::BiotSavart::lattice_segments(zeta,
+                                       gamma,
+                                       [surf_cols](const int& i, const int& j)
+                                       {return static_cast<int>(i*surf_cols + j);},
+                                       segments);
+    UVLM::BiotSavart::Points<t_scalar> targets;
+    UVLM::BiotSavart::Points<t_scalar> target_normals;
+    UVLM::BiotSavart::surface_points(target_surface, targets);
+    UVLM::BiotSavart::surface_points(normal, target_normals);
+    UVLM::BiotSavart::segments_influence(segments,
+                                         targets,
+                                         target_normals,
+                                         uout,
+                                         vortex_radius);
 }
 
 
 
-
-
 template <typename t_zeta,
           typename t_zeta_star,
           typename t_gamma,
@@ -718,6 +1304,7 @@ void UVLM::BiotSavart::multisurface_steady_wake
     const UVLM::Types::Real vortex_radius
 )
 {
+    typedef typename t_uout::Scalar t_scalar;
     const unsigned int rows_collocation = target_surface[0].rows();
     const unsigned int cols_collocation = target_surface[0].cols();
 
@@ -725,6 +1312,31 @@ void UVLM::BiotSavart::multisurface_steady_wake
     int surface_counter;
     const uint surf_rows = gamma.rows();
     const uint surf_cols = gamma.cols();
+    if (!horseshoe)
+    {
+        // every wake ring adds to the trailing edge panel of its column
+        UVLM::BiotSavart::Segments<t_scalar> segments;
+        UVLM::BiotSavart::lattice_segments(zeta,
+                                           gamma,
+                                           [surf_cols](const int& i, const int& j)
+                                           {return static_cast<int>(i*surf_cols + j);},
+                                           segments);
+        UVLM::BiotSavart::lattice_segments(zeta_star,
+                                           gamma_star,
+                                           [surf_rows, surf_cols](const int&, const int& j)
+                                           {return static_cast<int>((surf_rows - 1)*surf_cols + j);},
+                                           segments);
+        UVLM::BiotSavart::Points<t_scalar> targets;
+        UVLM::BiotSavart::Points<t_scalar> target_normals;
+        UVLM::BiotSavart::surface_points(target_surface, targets);
+        UVLM::BiotSavart::surface_points(normal, target_normals);
+        UVLM::BiotSavart::segments_influence(segments,
+                                             targets,
+                                             target_normals,
+                                             uout,
+                                             vortex_radius);
+        return;
+    }
     // #pragma omp parallel for default(none) \
     //                          shared(uout, target_surface, zeta, zeta_star, gamma, gamma_star, horseshoe,\
     //                          normal) \
@@ -737,11 +1349,11 @@ void UVLM::BiotSavart::multisurface_steady_wake
                 // for parallel, calculate directly collocation counter
                 // ++collocation_counter;
                 collocation_counter = i_col*cols_collocation + j_col;
-                UVLM::Types::Vector3 target_triad;
+                UVLM::Types::GenericVector3<t_scalar> target_triad;
                 target_triad << target_surface[0](i_col, j_col),
                                 target_surface[1](i_col, j_col),
                                 target_surface[2](i_col, j_col);
-                UVLM::Types::VecMatrixX temp_uout;
+                UVLM::Types::GenericVecMatrixX<t_scalar> temp_uout;
                 UVLM::Types::allocate_VecMat(temp_uout, zeta, -1);
                 UVLM::Types::initialise_VecMat(temp_uout, 0.0);
 
@@ -869,31 +1481,29 @@ void UVLM::BiotSavart::whole_surface_on_surface
     const bool image_method
 )
 {
+    typedef typename t_u_ind::value_type::Scalar t_scalar;
     const uint col_n_M = zeta_col[0].rows();
     const uint col_n_N = zeta_col[0].cols();
-    const uint n_M = zeta[0].rows();
-    const uint n_N = zeta[0].cols();
-    UVLM::Types::Vector3 target_triad;
-    UVLM::Types::Vector3 uout;
+    // only the velocity is needed, so all the rings share one index
+    UVLM::BiotSavart::Segments<t_scalar> segments;
+    UVLM::BiotSavart::lattice_segments(zeta,
+                                       gamma,
+                                       [](const int& i, const int& j) {return 0;},
+                                       segments);
+    UVLM::BiotSavart::sort_segments(segments);
+    UVLM::BiotSavart::Points<t_scalar> targets;
+    UVLM::BiotSavart::Points<t_scalar> uout;
+    UVLM::BiotSavart::surface_points(zeta_col, targets);
+    UVLM::BiotSavart::induced_velocity(segments, targets, uout);
+    uint counter = 0;
     for (uint col_i_M=0; col_i_M<col_n_M; ++col_i_M)
     {
         for (uint col_j_N=0; col_j_N<col_n_N; ++col_j_N)
         {
-            target_triad << zeta_col[0](col_i_M, col_j_N),
-                            zeta_col[1](col_i_M, col_j_N),
-                            zeta_col[2](col_i_M, col_j_N);
-            uout.setZero();
-            UVLM::BiotSavart::whole_surface
-            (
-                zeta,
-                gamma,
-                target_triad,
-                uout,
-                image_method
-            );
-            u_ind[0](col_i_M, col_j_N) += uout(0);
-            u_ind[1](col_i_M, col_j_N) += uout(1);
-            u_ind[2](col_i_M, col_j_N) += uout(2);
+            u_ind[0](col_i_M, col_j_N) += uout.x[counter];
+            u_ind[1](col_i_M, col_j_N) += uout.y[counter];
+            u_ind[2](col_i_M, col_j_N) += uout.z[counter];
+            ++counter;
         }
     }
 }
@@ -948,33 +1558,1267 @@ void UVLM::BiotSavart::total_induced_velocity_on_wake
     const t_gamma&      gamma,
     const t_gamma_star& gamma_star,
     t_uout&             uout,
-    const bool&         image_method,
-    const UVLM::Types::Real vortex_radius
+    const bool&,
+    const UVLM::Types::Real vortex_radius,
+    const int&          n_wake_rows,
+    const int&          n_target_rows,
+    const bool&         closure
 )
 {
+    typedef typename t_uout::value_type::value_type::Scalar t_scalar;
     const uint n_surf = zeta.size();
+    // only the first n_target_rows rows of every wake (-1: all) are
+    // targets, and only the vertices of the rows shed so far
+    const int wake_rows = UVLM::BiotSavart::shed_rows(gamma_star, n_wake_rows);
+    const int shed_vertices = UVLM::BiotSavart::shed_rows(gamma_star) + 1;
+    std::vector<uint> target_rows(n_surf);
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        target_rows[i_surf] = std::min<uint>(zeta_star[i_surf][0].rows(), shed_vertices);
+        if (n_target_rows != -1)
+        {
+            target_rows[i_surf] = std::min<uint>(target_rows[i_surf], n_target_rows);
+        }
+    }
+
+    // segments of all the wakes (only their first n_wake_rows rows if
+    // n_wake_rows != -1) and surfaces, built once for all the targets
+    // (only the velocity is needed, so all the rings share one index)
+    UVLM::BiotSavart::Segments<t_scalar> segments;
+    auto ring_index = [](const int&, const int&) {return 0;};
+    auto wake_ring_index = [wake_rows](const int& i, const int&)
+    {
+        return i < wake_rows ? 0:-1;
+    };
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        UVLM::BiotSavart::lattice_segments(zeta_star[i_surf],
+                                           gamma_star[i_surf],
+                                           wake_ring_index,
+                                           segments);
+        UVLM::BiotSavart::lattice_segments(zeta[i_surf],
+                                           gamma[i_surf],
+                                           ring_index,
+                                           segments);
+    }
+    UVLM::BiotSavart::sort_segments(segments);
+
+    const uint stride = std::max<uint>(1, UVLM::BiotSavart::wake_stride().stride);
+    const uint edge = UVLM::BiotSavart::wake_stride().edge;
+    if (stride > 1)
+    {
+        // only the nodes (strided rows x strided columns) and the vertices
+        // next to the trailing edge and the tips are targets, the rest are
+        // interpolated from the nodes
+        std::vector<std::vector<uint>> row_nodes(n_surf);
+        std::vector<std::vector<uint>> col_nodes(n_surf);
+        // vertex next to the trailing edge or a tip that is not a node
+        auto edge_vertex = [&row_nodes, &col_nodes, &zeta_star, edge](const uint& i_surf,
+                                                                     const uint& i,
+                                                                     const uint& j)
+        {
+            const uint N = zeta_star[i_surf][0].cols();
+            return (i < edge || j < edge || j + edge >= N) &&
+                   !(std::binary_search(row_nodes[i_surf].begin(), row_nodes[i_surf].end(), i) &&
+                     std::binary_search(col_nodes[i_surf].begin(), col_nodes[i_surf].end(), j));
+        };
+        UVLM::BiotSavart::Points<t_scalar> targets;
+        auto push_target = [&targets, &zeta_star](const uint& i_surf,
+                                                  const uint& i,
+                                                  const uint& j)
+        {
+            targets.x.push_back(zeta_star[i_surf][0](i, j));
+            targets.y.push_back(zeta_star[i_surf][1](i, j));
+            targets.z.push_back(zeta_star[i_surf][2](i, j));
+        };
+        for (uint col_i_surf=0; col_i_surf<n_surf; ++col_i_surf)
+        {
+            const uint N = zeta_star[col_i_surf][0].cols();
+            UVLM::BiotSavart::strided_indices(target_rows[col_i_surf],
+                                              stride,
+                                              row_nodes[col_i_surf],
+                                              edge);
+            UVLM::BiotSavart::strided_indices(N,
+                                              stride,
+                                              col_nodes[col_i_surf],
+                                              edge,
+                                              edge);
+            for (const uint& i: row_nodes[col_i_surf])
+            {
+                for (const uint& j: col_nodes[col_i_surf])
+                {
+                    push_target(col_i_surf, i, j);
+                }
+            }
+            for (uint i=0; i<target_rows[col_i_surf]; ++i)
+            {
+                for (uint j=0; j<N; ++j)
+                {
+                    if (edge_vertex(col_i_surf, i, j))
+                    {
+                        push_target(col_i_surf, i, j);
+                    }
+                }
+            }
+        }
+        UVLM::BiotSavart::Points<t_scalar> temp_uout;
+        UVLM::BiotSavart::particle_mesh_velocity(segments, targets, temp_uout, vortex_radius);
+        if (closure)
+        {
+            UVLM::BiotSavart::wake_closure_velocity(zeta_star,
+                                                    gamma_star,
+                                                    targets,
+                                                    temp_uout,
+                                                    n_wake_rows);
+        }
+
+        // interpolated from the nodes, then the edge vertices overwritten
+        // with their own velocity
+        const std::vector<t_scalar>* components[UVLM::Constants::NDIM] =
+            {&temp_uout.x, &temp_uout.y, &temp_uout.z};
+        Eigen::Matrix<t_scalar, Eigen::Dynamic, Eigen::Dynamic> fine;
+        uint offset = 0;
+        for (uint col_i_surf=0; col_i_surf<n_surf; ++col_i_surf)
+        {
+            const uint N = zeta_star[col_i_surf][0].cols();
+            const uint n_nodes = row_nodes[col_i_surf].size()*col_nodes[col_i_surf].size();
+            uint counter = offset;
+            for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+            {
+                const std::vector<t_scalar> coarse(components[i_dim]->begin() + offset,
+                                                   components[i_dim]->begin() + offset + n_nodes);
+                fine.setZero(target_rows[col_i_surf], N);
+                UVLM::BiotSavart::interpolate_strided(coarse,
+                                                      row_nodes[col_i_surf],
+                                                      col_nodes[col_i_surf],
+                                                      fine);
+                counter = offset + n_nodes;
+                for (uint i=0; i<target_rows[col_i_surf]; ++i)
+                {
+                    for (uint j=0; j<N; ++j)
+                    {
+                        if (edge_vertex(col_i_surf, i, j))
+                        {
+                            fine(i, j) = (*components[i_dim])[counter++];
+                        }
+                    }
+                }
+                uout[col_i_surf][i_dim].topRows(target_rows[col_i_surf]) += fine;
+            }
+            offset = counter;
+        }
+        return;
+    }
+
+    // the wake vertices of all the surfaces as one set of targets
+    UVLM::BiotSavart::Points<t_scalar> targets;
+    for (uint col_i_surf=0; col_i_surf<n_surf; ++col_i_surf)
+    {
+        UVLM::BiotSavart::Points<t_scalar> surface_targets;
+        UVLM::BiotSavart::surface_points(zeta_star[col_i_surf],
+                                         surface_targets,
+                                         0,
+                                         target_rows[col_i_surf]);
+        targets.append(surface_targets);
+    }
+    // (direct evaluation unless particle_mesh().nodes is set)
+    UVLM::BiotSavart::Points<t_scalar> temp_uout;
+    UVLM::BiotSavart::particle_mesh_velocity(segments, targets, temp_uout, vortex_radius);
+    if (closure)
+    {
+        UVLM::BiotSavart::wake_closure_velocity(zeta_star,
+                                                gamma_star,
+                                                targets,
+                                                temp_uout,
+                                                n_wake_rows);
+    }
+
+    uint counter = 0;
     for (uint col_i_surf=0; col_i_surf<n_surf; ++col_i_surf)
     {
-        for (uint i_surf=0; i_surf<n_surf; ++i_surf)
-        {
-            // wake on wake
-            UVLM::BiotSavart::whole_surface_on_surface
-            (
-                zeta_star[i_surf],
-                gamma_star[i_surf],
-                zeta_star[col_i_surf],
-                uout[col_i_surf],
-                image_method
-            );
-            // surface on wake
-            UVLM::BiotSavart::whole_surface_on_surface
-            (
-                zeta[i_surf],
-                gamma[i_surf],
-                zeta_star[col_i_surf],
-                uout[col_i_surf],
-                image_method
-            );
+        for (uint col_i_M=0; col_i_M<target_rows[col_i_surf]; ++col_i_M)
+        {
+            for (uint col_j_N=0; col_j_N<zeta_star[col_i_surf][0].cols(); ++col_j_N)
+            {
+                uout[col_i_surf][0](col_i_M, col_j_N) += temp_uout.x[counter];
+                uout[col_i_surf][1](col_i_M, col_j_N) += temp_uout.y[counter];
+                uout[col_i_surf][2](col_i_M, col_j_N) += temp_uout.z[counter];
+                ++counter;
+            }
+        }
+    }
+}
+
+
+
+// 0, 1... n_first - 1, then every stride-th index, then the last n_last
+// ones (sorted, without repetitions)
+inline void UVLM::BiotSavart::strided_indices
+(
+    const uint& n,
+    const uint& stride,
+    std::vector<uint>& indices,
+    const uint& n_first,
+    const uint& n_last
+)
+{
+    indices.clear();
+    for (uint i=0; i<n; ++i)
+    {
+        if (i < n_first || i%stride == 0 || i + n_last >= n)
+        {
+            indices.push_back(i);
+        }
+    }
+}
+
+
+// Lagrange weights at index of the (up to) 4 nodes around it:
+// nodes[first], ..., nodes[first + n_nodes - 1].
+// Cubic between inner nodes, lower order where there are fewer nodes.
+inline void UVLM::BiotSavart::cubic_weights
+(
+    const std::vector<uint>& nodes,
+    const uint& index,
+    uint& first,
+    uint& n_nodes,
+    UVLM::Types::Real weights[4]
+)
+{
+    const uint n = nodes.size();
+    n_nodes = std::min<uint>(4, n);
+    // interval of index: nodes[a] <= index < nodes[a + 1]
+    const uint a = std::upper_bound(nodes.begin(), nodes.end(), index) - nodes.begin() - 1;
+    const int start = static_cast<int>(a) - 1;
+    first = std::max(0, std::min(start, static_cast<int>(n - n_nodes)));
+    for (uint m=0; m<n_nodes; ++m)
+    {
+        weights[m] = 1.0;
+        for (uint l=0; l<n_nodes; ++l)
+        {
+            if (l == m) {continue;}
+            weights[m] *= (static_cast<UVLM::Types::Real>(index) - nodes[first + l])/
+                          (static_cast<UVLM::Types::Real>(nodes[first + m]) - nodes[first + l]);
+        }
+    }
+}
+
+
+// Adds to fine (all the vertices) the tensor-product cubic interpolation
+// of coarse (row_nodes x col_nodes, row major): first along the columns of
+// the node rows, then along the rows.
+template <typename t_scalar,
+          typename t_mat>
+void UVLM::BiotSavart::interpolate_strided
+(
+    const std::vector<t_scalar>& coarse,
+    const std::vector<uint>& row_nodes,
+    const std::vector<uint>& col_nodes,
+    t_mat& fine
+)
+{
+    const uint M = fine.rows();
+    const uint N = fine.cols();
+    const uint n_col_nodes = col_nodes.size();
+    uint first;
+    uint n_nodes;
+    UVLM::Types::Real weights[4];
+
+    std::vector<t_scalar> node_rows(row_nodes.size()*N, t_scalar(0.0));
+    for (uint j=0; j<N; ++j)
+    {
+        UVLM::BiotSavart::cubic_weights(col_nodes, j, first, n_nodes, weights);
+        for (uint i_node=0; i_node<row_nodes.size(); ++i_node)
+        {
+            for (uint m=0; m<n_nodes; ++m)
+            {
+                node_rows[i_node*N + j] += weights[m]*coarse[i_node*n_col_nodes + first + m];
+            }
+        }
+    }
+    for (uint i=0; i<M; ++i)
+    {
+        UVLM::BiotSavart::cubic_weights(row_nodes, i, first, n_nodes, weights);
+        for (uint j=0; j<N; ++j)
+        {
+            for (uint m=0; m<n_nodes; ++m)
+            {
+                fine(i, j) += weights[m]*node_rows[(first + m)*N + j];
+            }
         }
     }
 }
+
+
+
+// Rows of wake rings to evaluate: the first n_rows (-1: all) of every
+// wake, but not past the last row shed so far (a row with
+// |gamma| >= EPSILON in any wake). The rows after it are still the zero
+// rows of the start of the simulation, so they are found scanning from
+// the end of the wake.
+template <typename t_gamma_star>
+int UVLM::BiotSavart::shed_rows
+(
+    const t_gamma_star& gamma_star,
+    const int& n_rows
+)
+{
+    using std::abs;
+    int shed = 0;
+    for (uint i_surf=0; i_surf<gamma_star.size(); ++i_surf)
+    {
+        for (int i=gamma_star[i_surf].rows(); i>shed; --i)
+        {
+            bool is_shed = false;
+            for (uint j=0; j<gamma_star[i_surf].cols(); ++j)
+            {
+                if (abs(gamma_star[i_surf](i - 1, j)) >= UVLM::Constants::EPSILON)
+                {
+                    is_shed = true;
+                    break;
+                }
+            }
+            if (is_shed)
+            {
+                shed = i;
+                break;
+            }
+        }
+    }
+    return n_rows == -1 ? shed:std::min(shed, n_rows);
+}
+
+
+// Velocity of the wake closure (if wake_closure().horseshoe) on the
+// targets, added to uout. Every column j of a wake gets a horseshoe
+// (UVLM::BiotSavart::horseshoe) with the circulation of its last row,
+// starting at the last row of vertices and with the legs along the
+// chordwise direction of the last row. Its bound segment cancels the
+// trailing segment of the last ring, so the wake goes on to infinity
+// with that circulation instead of ending in a starting vortex.
+// The closure is only added to the wakes whose last row is part of the
+// evaluation (n_rows: rows of the wakes taken, -1: all), which leaves it
+// to the far wake evaluations when the first row is computed apart
+// (wakes of a single row are not closed). A last row with no circulation
+// (not shed yet) does not induce any velocity.
+template <typename t_zeta_star,
+          typename t_gamma_star,
+          typename t_scalar>
+void UVLM::BiotSavart::wake_closure_velocity
+(
+    const t_zeta_star& zeta_star,
+    const t_gamma_star& gamma_star,
+    const UVLM::BiotSavart::Points<t_scalar>& targets,
+    UVLM::BiotSavart::Points<t_scalar>& uout,
+    const int& n_rows
+)
+{
+    using std::abs;
+    if (!UVLM::BiotSavart::wake_closure().horseshoe) {return;}
+    typedef Eigen::Matrix<t_scalar, 2, 2, Eigen::DontAlign> t_block;
+    const uint n_surf = zeta_star.size();
+    const uint n_targets = targets.size();
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        const int M = gamma_star[i_surf].rows();
+        const uint N = gamma_star[i_surf].cols();
+        if (M < 2 || (n_rows != -1 && n_rows < M)) {continue;}
+
+        // corners 0 and 3 on the last row of vertices, 1 and 2 one unit
+        // downstream of them (the legs are semi-infinite)
+        std::vector<t_block> blocks(UVLM::Constants::NDIM*N);
+        std::vector<bool> shed(N, false);
+        for (uint j=0; j<N; ++j)
+        {
+            shed[j] = abs(gamma_star[i_surf](M - 1, j)) >= UVLM::Constants::EPSILON;
+            for (uint c=0; c<2; ++c)
+            {
+                UVLM::Types::GenericVector3<t_scalar> end;
+                UVLM::Types::GenericVector3<t_scalar> direction;
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    end(i_dim) = zeta_star[i_surf][i_dim](M, j + c);
+                    direction(i_dim) = end(i_dim) - zeta_star[i_surf][i_dim](M - 1, j + c);
+                }
+                direction.normalize();
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    t_block& block = blocks[UVLM::Constants::NDIM*j + i_dim];
+                    block(0, c) = end(i_dim);
+                    block(1, c) = end(i_dim) + direction(i_dim);
+                }
+            }
+        }
+
+        UVLM::Threads::parallel_for(n_targets, [&](const int& k)
+        {
+            UVLM::Types::GenericVector3<t_scalar> target;
+            target << targets.x[k], targets.y[k], targets.z[k];
+            UVLM::Types::GenericVector3<t_scalar> velocity;
+            velocity.setZero();
+            for (uint j=0; j<N; ++j)
+            {
+                if (!shed[j]) {continue;}
+                UVLM::BiotSavart::horseshoe(target,
+                                            blocks[UVLM::Constants::NDIM*j],
+                                            blocks[UVLM::Constants::NDIM*j + 1],
+                                            blocks[UVLM::Constants::NDIM*j + 2],
+                                            gamma_star[i_surf](M - 1, j),
+                                            velocity);
+            }
+            uout.x[k] += velocity(0);
+            uout.y[k] += velocity(1);
+            uout.z[k] += velocity(2);
+        });
+    }
+}
+
+
+// Appends the segments of the rings of a lattice.
+// ring_index(i, j) gives the output index of ring (i, j) (-1 to skip it);
+// the ring weights are gamma(i, j). Only the rings from row Mstart on are
+// taken. Rings are 0 -> 1 -> 2 -> 3 as in UVLM::Mapping::vortex_indices,
+// so the spanwise segment (r, j) -> (r, j + 1) is the edge of ring
+// (r - 1, j) and, reversed, of ring (r, j); the chordwise segment
+// (i, c) -> (i + 1, c) is the edge of ring (i, c) and, reversed, of ring
+// (i, c - 1). Segments whose two sides cancel (in value and, for Dual
+// scalars, in every tangent) are not stored.
+template <typename t_zeta,
+          typename t_gamma,
+          typename t_ring,
+          typename t_scalar>
+void UVLM::BiotSavart::lattice_segments
+(
+    const t_zeta& zeta,
+    const t_gamma& gamma,
+    const t_ring& ring_index,
+    UVLM::BiotSavart::Segments<t_scalar>& segments,
+    const uint& Mstart
+)
+{
+    using UVLM::Types::is_zero;
+    const int M = gamma.rows();
+    const int N = gamma.cols();
+    auto ring = [&](const int& i, const int& j) -> int
+    {
+        if (i < static_cast<int>(Mstart) || i >= M || j < 0 || j >= N) {return -1;}
+        return ring_index(i, j);
+    };
+    auto weight = [&](const int& i, const int& j, const int& index) -> t_scalar
+    {
+        if (index < 0) {return t_scalar(0.0);}
+        return t_scalar(gamma(i, j));
+    };
+    auto add = [&](const int& i1, const int& j1, const int& i2, const int& j2,
+                   const int& ia, const int& ja, const int& ib, const int& jb)
+    {
+        const int index_a = ring(ia, ja);
+        const int index_b = ring(ib, jb);
+        if (index_a < 0 && index_b < 0) {return;}
+        const t_scalar w_a = weight(ia, ja, index_a);
+        const t_scalar w_b = weight(ib, jb, index_b);
+        if (index_a == index_b && is_zero(w_a - w_b)) {return;}
+        segments.x1.push_back(zeta[0](i1, j1));
+        segments.y1.push_back(zeta[1](i1, j1));
+        segments.z1.push_back(zeta[2](i1, j1));
+        segments.x2.push_back(zeta[0](i2, j2));
+        segments.y2.push_back(zeta[1](i2, j2));
+        segments.z2.push_back(zeta[2](i2, j2));
+        segments.ring_a.push_back(index_a);
+        segments.ring_b.push_back(index_b);
+        segments.weight_a.push_back(w_a);
+        segments.weight_b.push_back(w_b);
+    };
+
+    // spanwise
+    for (int r=Mstart; r<=M; ++r)
+    {
+        for (int j=0; j<N; ++j)
+        {
+            add(r, j, r, j + 1, r - 1, j, r, j);
+        }
+    }
+    // chordwise
+    for (int i=Mstart; i<M; ++i)
+    {
+        for (int c=0; c<=N; ++c)
+        {
+            add(i, c, i + 1, c, i, c, i, c - 1);
+        }
+    }
+}
+
+
+// Points of rows [row_begin, row_end) of a VecMat (row_end = -1: all)
+template <typename t_surface,
+          typename t_scalar>
+void UVLM::BiotSavart::surface_points
+(
+    const t_surface& surface,
+    UVLM::BiotSavart::Points<t_scalar>& points,
+    const uint& row_begin,
+    int row_end
+)
+{
+    if (row_end == -1) {row_end = surface[0].rows();}
+    const uint N = surface[0].cols();
+    points.resize((row_end - row_begin)*N);
+    uint counter = 0;
+    for (int i=row_begin; i<row_end; ++i)
+    {
+        for (uint j=0; j<N; ++j)
+        {
+            points.x[counter] = surface[0](i, j);
+            points.y[counter] = surface[1](i, j);
+            points.z[counter] = surface[2](i, j);
+            ++counter;
+        }
+    }
+}
+
+
+// Velocity induced on the targets by the segments, with circulation
+// weight_a - weight_b, added to uout.
+// The loops are blocked in tiles of tile_size().targets targets and
+// tile_size().segments segments, so a tile of sources is loaded once and
+// reused by all the targets of a tile while both fit in cache. The inner
+// loop over targets has no branches (the cut-off of
+// UVLM::BiotSavart::segment is a select), so it vectorises.
+template <typename t_scalar>
+void UVLM::BiotSavart::segments_velocity
+(
+    const UVLM::BiotSavart::Segments<t_scalar>& segments,
+    const UVLM::BiotSavart::Points<t_scalar>& targets,
+    UVLM::BiotSavart::Points<t_scalar>& uout,
+    const UVLM::Types::Real vortex_radius
+)
+{
+    using std::sqrt;
+    using UVLM::Types::is_zero;
+    const uint n_targets = targets.size();
+    const uint n_segments = segments.size();
+    const uint tile_targets = std::max<uint>(1, UVLM::BiotSavart::tile_size().targets);
+    const uint tile_segments = std::max<uint>(1, UVLM::BiotSavart::tile_size().segments);
+    const t_scalar zero(0.0);
+    const t_scalar one(1.0);
+
+    for (uint t_begin=0; t_begin<n_targets; t_begin+=tile_targets)
+    {
+        const uint t_end = std::min(n_targets, t_begin + tile_targets);
+        for (uint s_begin=0; s_begin<n_segments; s_begin+=tile_segments)
+        {
+            const uint s_end = std::min(n_segments, s_begin + tile_segments);
+            for (uint i_seg=s_begin; i_seg<s_end; ++i_seg)
+            {
+                const t_scalar gamma = segments.weight_a[i_seg] - segments.weight_b[i_seg];
+                if (is_zero(gamma, UVLM::Constants::EPSILON)) {continue;}
+                const t_scalar x1 = segments.x1[i_seg];
+                const t_scalar y1 = segments.y1[i_seg];
+                const t_scalar z1 = segments.z1[i_seg];
+                const t_scalar r0_x = segments.x2[i_seg] - x1;
+                const t_scalar r0_y = segments.y2[i_seg] - y1;
+                const t_scalar r0_z = segments.z2[i_seg] - z1;
+                const t_scalar radius = sqrt(r0_x*r0_x + r0_y*r0_y + r0_z*r0_z)*vortex_radius;
+                const t_scalar radius_sq = radius*radius;
+                const t_scalar factor = gamma/UVLM::Constants::PI4;
+                for (uint i_t=t_begin; i_t<t_end; ++i_t)
+                {
+                    const t_scalar r1_x = targets.x[i_t] - x1;
+                    const t_scalar r1_y = targets.y[i_t] - y1;
+                    const t_scalar r1_z = targets.z[i_t] - z1;
+                    const t_scalar r2_x = r1_x - r0_x;
+                    const t_scalar r2_y = r1_y - r0_y;
+                    const t_scalar r2_z = r1_z - r0_z;
+                    const t_scalar c_x = r1_y*r2_z - r1_z*r2_y;
+                    const t_scalar c_y = r1_z*r2_x - r1_x*r2_z;
+                    const t_scalar c_z = r1_x*r2_y - r1_y*r2_x;
+                    const t_scalar c_sq = c_x*c_x + c_y*c_y + c_z*c_z;
+                    const t_scalar r1_mod = sqrt(r1_x*r1_x + r1_y*r1_y + r1_z*r1_z);
+                    const t_scalar r2_mod = sqrt(r2_x*r2_x + r2_y*r2_y + r2_z*r2_z);
+                    // cut-off of UVLM::BiotSavart::segment, with the
+                    // denominators kept finite so the select is safe
+                    const bool cut = r1_mod < radius || r2_mod < radius || c_sq < radius_sq;
+                    const t_scalar c_sq_safe = cut ? one:c_sq;
+                    const t_scalar r1_safe = cut ? one:r1_mod;
+                    const t_scalar r2_safe = cut ? one:r2_mod;
+                    const t_scalar k = cut ? zero:
+                        factor/c_sq_safe*((r0_x*r1_x + r0_y*r1_y + r0_z*r1_z)/r1_safe -
+                                          (r0_x*r2_x + r0_y*r2_y + r0_z*r2_z)/r2_safe);
+                    uout.x[i_t] += k*c_x;
+                    uout.y[i_t] += k*c_y;
+                    uout.z[i_t] += k*c_z;
+                }
+            }
+        }
+    }
+}
+
+
+// Normal velocity induced on the targets by every segment with unit
+// circulation, added to uout(target, ring_a) with weight_a and subtracted
+// from uout(target, ring_b) with weight_b: the influence coefficients of
+// the rings, with every shared segment evaluated once.
+// Same tiling as segments_velocity.
+template <typename t_scalar,
+          typename t_uout>
+void UVLM::BiotSavart::segments_influence
+(
+    const UVLM::BiotSavart::Segments<t_scalar>& segments,
+    const UVLM::BiotSavart::Points<t_scalar>& targets,
+    const UVLM::BiotSavart::Points<t_scalar>& normals,
+    t_uout& uout,
+    const UVLM::Types::Real vortex_radius
+)
+{
+    using std::sqrt;
+    const uint n_targets = targets.size();
+    const uint n_segments = segments.size();
+    const uint tile_targets = std::max<uint>(1, UVLM::BiotSavart::tile_size().targets);
+    const uint tile_segments = std::max<uint>(1, UVLM::BiotSavart::tile_size().segments);
+    const t_scalar zero(0.0);
+    const t_scalar one(1.0);
+    std::vector<t_scalar> coefficient(tile_targets);
+
+    for (uint t_begin=0; t_begin<n_targets; t_begin+=tile_targets)
+    {
+        const uint t_end = std::min(n_targets, t_begin + tile_targets);
+        for (uint s_begin=0; s_begin<n_segments; s_begin+=tile_segments)
+        {
+            const uint s_end = std::min(n_segments, s_begin + tile_segments);
+            for (uint i_seg=s_begin; i_seg<s_end; ++i_seg)
+            {
+                const t_scalar x1 = segments.x1[i_seg];
+                const t_scalar y1 = segments.y1[i_seg];
+                const t_scalar z1 = segments.z1[i_seg];
+                const t_scalar r0_x = segments.x2[i_seg] - x1;
+                const t_scalar r0_y = segments.y2[i_seg] - y1;
+                const t_scalar r0_z = segments.z2[i_seg] - z1;
+                const t_scalar radius = sqrt(r0_x*r0_x + r0_y*r0_y + r0_z*r0_z)*vortex_radius;
+                const t_scalar radius_sq = radius*radius;
+                const t_scalar factor = 1.0/UVLM::Constants::PI4;
+                for (uint i_t=t_begin; i_t<t_end; ++i_t)
+                {
+                    const t_scalar r1_x = targets.x[i_t] - x1;
+                    const t_scalar r1_y = targets.y[i_t] - y1;
+                    const t_scalar r1_z = targets.z[i_t] - z1;
+                    const t_scalar r2_x = r1_x - r0_x;
+                    const t_scalar r2_y = r1_y - r0_y;
+                    const t_scalar r2_z = r1_z - r0_z;
+                    const t_scalar c_x = r1_y*r2_z - r1_z*r2_y;
+                    const t_scalar c_y = r1_z*r2_x - r1_x*r2_z;
+                    const t_scalar c_z = r1_x*r2_y - r1_y*r2_x;
+                    const t_scalar c_sq = c_x*c_x + c_y*c_y + c_z*c_z;
+                    const t_scalar r1_mod = sqrt(r1_x*r1_x + r1_y*r1_y + r1_z*r1_z);
+                    const t_scalar r2_mod = sqrt(r2_x*r2_x + r2_y*r2_y + r2_z*r2_z);
+                    // cut-off of UVLM::BiotSavart::segment, with the
+                    // denominators kept finite so the select is safe
+                    const bool cut = r1_mod < radius || r2_mod < radius || c_sq < radius_sq;
+                    const t_scalar c_sq_safe = cut ? one:c_sq;
+                    const t_scalar r1_safe = cut ? one:r1_mod;
+                    const t_scalar r2_safe = cut ? one:r2_mod;
+                    const t_scalar k = cut ? zero:
+                        factor/c_sq_safe*((r0_x*r1_x + r0_y*r1_y + r0_z*r1_z)/r1_safe -
+                                          (r0_x*r2_x + r0_y*r2_y + r0_z*r2_z)/r2_safe);
+                    coefficient[i_t - t_begin] =
+                        k*(c_x*normals.x[i_t] + c_y*normals.y[i_t] + c_z*normals.z[i_t]);
+                }
+                const int ring_a = segments.ring_a[i_seg];
+                const int ring_b = segments.ring_b[i_seg];
+                if (ring_a >= 0)
+                {
+                    const t_scalar weight = segments.weight_a[i_seg];
+                    for (uint i_t=t_begin; i_t<t_end; ++i_t)
+                    {
+                        uout(i_t, ring_a) += weight*coefficient[i_t - t_begin];
+                    }
+                }
+                if (ring_b >= 0)
+                {
+                    const t_scalar weight = segments.weight_b[i_seg];
+                    for (uint i_t=t_begin; i_t<t_end; ++i_t)
+                    {
+                        uout(i_t, ring_b) -= weight*coefficient[i_t - t_begin];
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+
+// Interleaves the lower 21 bits of the three quantised coordinates
+inline uint64_t UVLM::BiotSavart::morton_code
+(
+    const uint& ix,
+    const uint& iy,
+    const uint& iz
+)
+{
+    auto spread = [](uint64_t a) -> uint64_t
+    {
+        a &= 0x1fffffULL;
+        a = (a | a << 32) & 0x1f00000000ffffULL;
+        a = (a | a << 16) & 0x1f0000ff0000ffULL;
+        a = (a | a << 8) & 0x100f00f00f00f00fULL;
+        a = (a | a << 4) & 0x10c30c30c30c30c3ULL;
+        a = (a | a << 2) & 0x1249249249249249ULL;
+        return a;
+    };
+    return spread(ix) | (spread(iy) << 1) | (spread(iz) << 2);
+}
+
+
+// order[k] is the index of the k-th point along the Morton curve of the
+// bounding box of the points
+template <typename t_scalar>
+void UVLM::BiotSavart::morton_order
+(
+    const std::vector<t_scalar>& x,
+    const std::vector<t_scalar>& y,
+    const std::vector<t_scalar>& z,
+    std::vector<uint>& order
+)
+{
+    using UVLM::Types::primal;
+    const uint n_points = x.size();
+    order.resize(n_points);
+    for (uint i=0; i<n_points; ++i) {order[i] = i;}
+    if (n_points < 2) {return;}
+
+    UVLM::Types::Vector3 min_corner;
+    UVLM::Types::Vector3 max_corner;
+    min_corner.setConstant(std::numeric_limits<UVLM::Types::Real>::max());
+    max_corner.setConstant(std::numeric_limits<UVLM::Types::Real>::lowest());
+    for (uint i=0; i<n_points; ++i)
+    {
+        const UVLM::Types::Vector3 point(primal(x[i]), primal(y[i]), primal(z[i]));
+        min_corner = min_corner.cwiseMin(point);
+        max_corner = max_corner.cwiseMax(point);
+    }
+    const UVLM::Types::Real extent =
+        std::max((max_corner - min_corner).maxCoeff(),
+                 std::numeric_limits<UVLM::Types::Real>::min());
+    const UVLM::Types::Real scale = ((1 << 21) - 1)/extent;
+
+    std::vector<uint64_t> codes(n_points);
+    for (uint i=0; i<n_points; ++i)
+    {
+        codes[i] = UVLM::BiotSavart::morton_code
+        (
+            static_cast<uint>((primal(x[i]) - min_corner(0))*scale),
+            static_cast<uint>((primal(y[i]) - min_corner(1))*scale),
+            static_cast<uint>((primal(z[i]) - min_corner(2))*scale)
+        );
+    }
+    std::stable_sort(order.begin(),
+                     order.end(),
+                     [&codes](const uint& a, const uint& b)
+                     {return codes[a] < codes[b];});
+}
+
+
+// sorted = points[order[begin:end]] (end = -1: all)
+template <typename t_scalar>
+void UVLM::BiotSavart::sort_points
+(
+    const UVLM::BiotSavart::Points<t_scalar>& points,
+    const std::vector<uint>& order,
+    UVLM::BiotSavart::Points<t_scalar>& sorted,
+    const uint& begin,
+    int end
+)
+{
+    if (end == -1) {end = order.size();}
+    sorted.resize(end - begin);
+    for (int k=begin; k<end; ++k)
+    {
+        sorted.x[k - begin] = points.x[order[k]];
+        sorted.y[k - begin] = points.y[order[k]];
+        sorted.z[k - begin] = points.z[order[k]];
+    }
+}
+
+
+// points[order] = sorted
+template <typename t_scalar>
+void UVLM::BiotSavart::unsort_points
+(
+    const UVLM::BiotSavart::Points<t_scalar>& sorted,
+    const std::vector<uint>& order,
+    UVLM::BiotSavart::Points<t_scalar>& points
+)
+{
+    const uint n_points = order.size();
+    points.resize(n_points);
+    for (uint k=0; k<n_points; ++k)
+    {
+        points.x[order[k]] = sorted.x[k];
+        points.y[order[k]] = sorted.y[k];
+        points.z[order[k]] = sorted.z[k];
+    }
+}
+
+
+// Segments in the Morton order of their midpoints
+template <typename t_scalar>
+void UVLM::BiotSavart::sort_segments
+(
+    UVLM::BiotSavart::Segments<t_scalar>& segments
+)
+{
+    const uint n_segments = segments.size();
+    std::vector<t_scalar> x(n_segments);
+    std::vector<t_scalar> y(n_segments);
+    std::vector<t_scalar> z(n_segments);
+    for (uint i=0; i<n_segments; ++i)
+    {
+        x[i] = 0.5*(segments.x1[i] + segments.x2[i]);
+        y[i] = 0.5*(segments.y1[i] + segments.y2[i]);
+        z[i] = 0.5*(segments.z1[i] + segments.z2[i]);
+    }
+    std::vector<uint> order;
+    UVLM::BiotSavart::morton_order(x, y, z, order);
+
+    auto gather = [&order](auto& values)
+    {
+        auto unsorted = values;
+        for (uint k=0; k<order.size(); ++k) {values[k] = unsorted[order[k]];}
+    };
+    gather(segments.x1);
+    gather(segments.y1);
+    gather(segments.z1);
+    gather(segments.x2);
+    gather(segments.y2);
+    gather(segments.z2);
+    gather(segments.ring_a);
+    gather(segments.ring_b);
+    gather(segments.weight_a);
+    gather(segments.weight_b);
+}
+
+
+// Velocity induced by the segments on the targets (uout is overwritten).
+// The targets are taken in Morton order and split in tiles of about the
+// same cost (UVLM::Threads::make_tiles), so every tile is a compact
+// cluster of points; the results are scattered back to the original
+// order. The segments are expected to be sorted already (sort_segments).
+template <typename t_scalar>
+void UVLM::BiotSavart::induced_velocity
+(
+    const UVLM::BiotSavart::Segments<t_scalar>& segments,
+    const UVLM::BiotSavart::Points<t_scalar>& targets,
+    UVLM::BiotSavart::Points<t_scalar>& uout,
+    const UVLM::Types::Real vortex_radius
+)
+{
+    const uint n_targets = targets.size();
+    std::vector<uint> order;
+    UVLM::BiotSavart::morton_order(targets.x, targets.y, targets.z, order);
+    UVLM::BiotSavart::Points<t_scalar> sorted_uout;
+    sorted_uout.resize(n_targets);
+
+    UVLM::Types::VecDimensions dimensions(1, UVLM::Types::IntPair(n_targets, 1));
+    std::vector<double> source_rings(1, segments.size());
+    std::vector<UVLM::Threads::Tile> tiles;
+    UVLM::Threads::make_tiles(dimensions, source_rings, false, tiles);
+    UVLM::Threads::run_tiles(tiles, [&](const UVLM::Threads::Tile& tile)
+    {
+        UVLM::BiotSavart::Points<t_scalar> tile_targets;
+        UVLM::BiotSavart::Points<t_scalar> tile_uout;
+        UVLM::BiotSavart::sort_points(targets,
+                                      order,
+                                      tile_targets,
+                                      tile.row_begin,
+                                      tile.row_end);
+        tile_uout.resize(tile_targets.size());
+        UVLM::BiotSavart::segments_velocity(segments,
+                                            tile_targets,
+                                            tile_uout,
+                                            vortex_radius);
+        for (uint k=0; k<tile_uout.size(); ++k)
+        {
+            sorted_uout.x[tile.row_begin + k] = tile_uout.x[k];
+            sorted_uout.y[tile.row_begin + k] = tile_uout.y[k];
+            sorted_uout.z[tile.row_begin + k] = tile_uout.z[k];
+        }
+    });
+    UVLM::BiotSavart::unsort_points(sorted_uout, order, uout);
+}
+
+
+// Only the Real version is a particle-mesh one; other scalars (Dual...)
+// are evaluated directly.
+template <typename t_scalar>
+void UVLM::BiotSavart::particle_mesh_velocity
+(
+    const UVLM::BiotSavart::Segments<t_scalar>& segments,
+    const UVLM::BiotSavart::Points<t_scalar>& targets,
+    UVLM::BiotSavart::Points<t_scalar>& uout,
+    const UVLM::Types::Real vortex_radius
+)
+{
+    UVLM::BiotSavart::induced_velocity(segments, targets, uout, vortex_radius);
+}
+
+
+// Velocity of the mesh vorticity at offset (di, dj, dk) nodes:
+//      u = alpha x r/(4 pi |r|^3)
+// (the Biot-Savart kernel of a vortex element alpha = gamma*dl)
+inline UVLM::Types::Vector3 UVLM::BiotSavart::mesh_kernel
+(
+    const int& di,
+    const int& dj,
+    const int& dk,
+    const UVLM::Types::Real& h
+)
+{
+    if (di == 0 && dj == 0 && dk == 0)
+    {
+        return UVLM::Types::Vector3::Zero();
+    }
+    const UVLM::Types::Vector3 r(h*di, h*dj, h*dk);
+    const UVLM::Types::Real r_mod = r.norm();
+    return r/(UVLM::Constants::PI4*r_mod*r_mod*r_mod);
+}
+
+
+// Cloud in cell weights of the 8 nodes base + (c >> 2, (c >> 1) & 1, c & 1)
+// around x
+inline void UVLM::BiotSavart::mesh_weights
+(
+    const UVLM::Types::Vector3& x,
+    const UVLM::Types::Vector3& origin,
+    const UVLM::Types::Real& h,
+    const uint n[3],
+    int base[3],
+    UVLM::Types::Real weights[8]
+)
+{
+    UVLM::Types::Real fraction[3];
+    for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+    {
+        const UVLM::Types::Real position = (x(i_dim) - origin(i_dim))/h;
+        base[i_dim] = std::max(0, std::min(static_cast<int>(std::floor(position)),
+                                           static_cast<int>(n[i_dim]) - 2));
+        fraction[i_dim] = position - base[i_dim];
+    }
+    for (uint c=0; c<8; ++c)
+    {
+        weights[c] = ((c >> 2) ? fraction[0]:1.0 - fraction[0])*
+                     (((c >> 1) & 1) ? fraction[1]:1.0 - fraction[1])*
+                     ((c & 1) ? fraction[2]:1.0 - fraction[2]);
+    }
+}
+
+
+// Particle-particle particle-mesh (P3M) version of induced_velocity:
+//  - the segments are split in particles (vortex elements gamma*dl) no
+//    longer than the mesh spacing h, deposited on a uniform mesh with
+//    cloud in cell weights;
+//  - the mesh velocity is the free space convolution with the Biot-Savart
+//    kernel (Hockney: zero padding to twice the mesh), with FFTs;
+//  - it is interpolated to the targets with the same weights, and the
+//    particles up to near_cells cells away are evaluated directly
+//    (segment) instead of through the mesh.
+// The cost is O(n log n) in the mesh nodes plus the near field, instead
+// of targets times segments.
+inline void UVLM::BiotSavart::particle_mesh_velocity
+(
+    const UVLM::BiotSavart::Segments<UVLM::Types::Real>& segments,
+    const UVLM::BiotSavart::Points<UVLM::Types::Real>& targets,
+    UVLM::BiotSavart::Points<UVLM::Types::Real>& uout,
+    const UVLM::Types::Real vortex_radius
+)
+{
+    const UVLM::BiotSavart::ParticleMesh& settings = UVLM::BiotSavart::particle_mesh();
+    const uint n_segments = segments.size();
+    const uint n_targets = targets.size();
+
+    // box of the segments and the targets
+    UVLM::Types::Vector3 lower = UVLM::Types::Vector3::Constant(std::numeric_limits<UVLM::Types::Real>::max());
+    UVLM::Types::Vector3 upper = -lower;
+    auto extend = [&](const UVLM::Types::Vector3& x)
+    {
+        lower = lower.cwiseMin(x);
+        upper = upper.cwiseMax(x);
+    };
+    for (uint i_seg=0; i_seg<n_segments; ++i_seg)
+    {
+        extend(UVLM::Types::Vector3(segments.x1[i_seg], segments.y1[i_seg], segments.z1[i_seg]));
+        extend(UVLM::Types::Vector3(segments.x2[i_seg], segments.y2[i_seg], segments.z2[i_seg]));
+    }
+    for (uint i_target=0; i_target<n_targets; ++i_target)
+    {
+        extend(UVLM::Types::Vector3(targets.x[i_target], targets.y[i_target], targets.z[i_target]));
+    }
+    const UVLM::Types::Real extent = (upper - lower).maxCoeff();
+    if (settings.nodes < 2 || n_segments == 0 || n_targets == 0 || !(extent > 0.0))
+    {
+        UVLM::BiotSavart::induced_velocity(segments, targets, uout, vortex_radius);
+        return;
+    }
+    const UVLM::Types::Real h = extent/(settings.nodes - 1);
+    uint n[3];
+    uint padded[3];
+    for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+    {
+        n[i_dim] = std::max<uint>(2, std::floor((upper(i_dim) - lower(i_dim))/h) + 1);
+        padded[i_dim] = UVLM::FFT::next_power_of_2(2*n[i_dim] - 1);
+    }
+    const uint n_nodes = n[0]*n[1]*n[2];
+    const uint n_padded = padded[0]*padded[1]*padded[2];
+    auto node = [&](const int& i, const int& j, const int& k)
+    {
+        return (i*n[1] + j)*n[2] + k;
+    };
+    auto padded_node = [&](const int& i, const int& j, const int& k)
+    {
+        return (i*padded[1] + j)*padded[2] + k;
+    };
+
+    // particles, with the vortex radius of the whole segment
+    std::vector<UVLM::Types::Vector3> particle_a;
+    std::vector<UVLM::Types::Vector3> particle_b;
+    std::vector<UVLM::Types::Real> particle_gamma;
+    std::vector<UVLM::Types::Real> particle_radius;
+    for (uint i_seg=0; i_seg<n_segments; ++i_seg)
+    {
+        const UVLM::Types::Real gamma = segments.weight_a[i_seg] - segments.weight_b[i_seg];
+        if (std::abs(gamma) < UVLM::Constants::EPSILON) {continue;}
+        const UVLM::Types::Vector3 a(segments.x1[i_seg], segments.y1[i_seg], segments.z1[i_seg]);
+        const UVLM::Types::Vector3 b(segments.x2[i_seg], segments.y2[i_seg], segments.z2[i_seg]);
+        const uint n_pieces = std::max<uint>(1, std::ceil((b - a).norm()/h));
+        for (uint i_piece=0; i_piece<n_pieces; ++i_piece)
+        {
+            particle_a.push_back(a + (b - a)*(static_cast<UVLM::Types::Real>(i_piece)/n_pieces));
+            particle_b.push_back(a + (b - a)*(static_cast<UVLM::Types::Real>(i_piece + 1)/n_pieces));
+            particle_gamma.push_back(gamma);
+            particle_radius.push_back(vortex_radius*n_pieces);
+        }
+    }
+    const uint n_particles = particle_gamma.size();
+
+    // deposition
+    std::vector<std::array<int, 3>> particle_base(n_particles);
+    std::vector<std::array<UVLM::Types::Real, 8>> particle_weights(n_particles);
+    std::vector<UVLM::Types::Vector3> particle_alpha(n_particles);
+    std::vector<UVLM::Types::Complex> mesh[UVLM::Constants::NDIM];
+    std::vector<UVLM::Types::Complex> kernel[UVLM::Constants::NDIM];
+    for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+    {
+        mesh[i_dim].assign(n_padded, UVLM::Types::Complex(0.0, 0.0));
+        kernel[i_dim].assign(n_padded, UVLM::Types::Complex(0.0, 0.0));
+    }
+    for (uint i_particle=0; i_particle<n_particles; ++i_particle)
+    {
+        int* base = particle_base[i_particle].data();
+        UVLM::Types::Real* weights = particle_weights[i_particle].data();
+        UVLM::BiotSavart::mesh_weights(0.5*(particle_a[i_particle] + particle_b[i_particle]),
+                                       lower, h, n, base, weights);
+        particle_alpha[i_particle] = particle_gamma[i_particle]*
+                                     (particle_b[i_particle] - particle_a[i_particle]);
+        for (uint c=0; c<8; ++c)
+        {
+            const uint index = padded_node(base[0] + (c >> 2),
+                                           base[1] + ((c >> 1) & 1),
+                                           base[2] + (c & 1));
+            for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+            {
+                mesh[i_dim][index] += weights[c]*particle_alpha[i_particle](i_dim);
+            }
+        }
+    }
+
+    // kernel, with the indices above padded/2 as negative offsets
+    UVLM::Threads::parallel_for(padded[0], [&](const int& i)
+    {
+        const int di = i <= static_cast<int>(padded[0]/2) ? i:i - static_cast<int>(padded[0]);
+        for (int j=0; j<static_cast<int>(padded[1]); ++j)
+        {
+            const int dj = j <= static_cast<int>(padded[1]/2) ? j:j - static_cast<int>(padded[1]);
+            for (int k=0; k<static_cast<int>(padded[2]); ++k)
+            {
+                const int dk = k <= static_cast<int>(padded[2]/2) ? k:k - static_cast<int>(padded[2]);
+                const UVLM::Types::Vector3 g = UVLM::BiotSavart::mesh_kernel(di, dj, dk, h);
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    kernel[i_dim][padded_node(i, j, k)] = g(i_dim);
+                }
+            }
+        }
+    });
+
+    // convolution: u_hat = alpha_hat x kernel_hat
+    for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+    {
+        UVLM::FFT::transform_3d(mesh[i_dim], padded[0], padded[1], padded[2], false);
+        UVLM::FFT::transform_3d(kernel[i_dim], padded[0], padded[1], padded[2], false);
+    }
+    UVLM::Threads::parallel_for(n_padded, [&](const int& index)
+    {
+        const UVLM::Types::Complex a0 = mesh[0][index];
+        const UVLM::Types::Complex a1 = mesh[1][index];
+        const UVLM::Types::Complex a2 = mesh[2][index];
+        mesh[0][index] = a1*kernel[2][index] - a2*kernel[1][index];
+        mesh[1][index] = a2*kernel[0][index] - a0*kernel[2][index];
+        mesh[2][index] = a0*kernel[1][index] - a1*kernel[0][index];
+    });
+    std::vector<UVLM::Types::Vector3> mesh_velocity(n_nodes);
+    for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+    {
+        UVLM::FFT::transform_3d(mesh[i_dim], padded[0], padded[1], padded[2], true);
+        for (uint i=0; i<n[0]; ++i)
+        {
+            for (uint j=0; j<n[1]; ++j)
+            {
+                for (uint k=0; k<n[2]; ++k)
+                {
+                    mesh_velocity[node(i, j, k)](i_dim) =
+                        mesh[i_dim][padded_node(i, j, k)].real()/n_padded;
+                }
+            }
+        }
+    }
+    for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+    {
+        std::vector<UVLM::Types::Complex>().swap(mesh[i_dim]);
+        std::vector<UVLM::Types::Complex>().swap(kernel[i_dim]);
+    }
+
+    // particles by cell (the base node of their weights)
+    std::vector<uint> cell_start(n_nodes + 1, 0);
+    for (uint i_particle=0; i_particle<n_particles; ++i_particle)
+    {
+        const int* base = particle_base[i_particle].data();
+        ++cell_start[node(base[0], base[1], base[2]) + 1];
+    }
+    for (uint cell=0; cell<n_nodes; ++cell)
+    {
+        cell_start[cell + 1] += cell_start[cell];
+    }
+    std::vector<uint> cell_particles(n_particles);
+    std::vector<uint> cell_fill(cell_start.begin(), cell_start.end() - 1);
+    for (uint i_particle=0; i_particle<n_particles; ++i_particle)
+    {
+        const int* base = particle_base[i_particle].data();
+        cell_particles[cell_fill[node(base[0], base[1], base[2])]++] = i_particle;
+    }
+
+    // targets by cell: the near particles, and what the mesh gave for them
+    // on the 8 nodes of the cell, are the same for all of them
+    std::vector<std::array<int, 3>> target_base(n_targets);
+    std::vector<std::array<UVLM::Types::Real, 8>> target_weights(n_targets);
+    std::vector<uint> target_start(n_nodes + 1, 0);
+    for (uint i_target=0; i_target<n_targets; ++i_target)
+    {
+        int* base = target_base[i_target].data();
+        UVLM::BiotSavart::mesh_weights(UVLM::Types::Vector3(targets.x[i_target],
+                                                            targets.y[i_target],
+                                                            targets.z[i_target]),
+                                       lower, h, n, base, target_weights[i_target].data());
+        ++target_start[node(base[0], base[1], base[2]) + 1];
+    }
+    std::vector<uint> target_cells;
+    for (uint cell=0; cell<n_nodes; ++cell)
+    {
+        if (target_start[cell + 1] > 0) {target_cells.push_back(cell);}
+        target_start[cell + 1] += target_start[cell];
+    }
+    std::vector<uint> cell_targets(n_targets);
+    std::vector<uint> target_fill(target_start.begin(), target_start.end() - 1);
+    for (uint i_target=0; i_target<n_targets; ++i_target)
+    {
+        const int* base = target_base[i_target].data();
+        cell_targets[target_fill[node(base[0], base[1], base[2])]++] = i_target;
+    }
+
+    // kernel between the nodes of a cell and of the near particles
+    const int near = settings.near_cells;
+    const int table_size = 2*near + 3;
+    std::vector<UVLM::Types::Vector3> near_kernel(table_size*table_size*table_size);
+    for (int di=-near - 1; di<=near + 1; ++di)
+    {
+        for (int dj=-near - 1; dj<=near + 1; ++dj)
+        {
+            for (int dk=-near - 1; dk<=near + 1; ++dk)
+            {
+                near_kernel[((di + near + 1)*table_size + dj + near + 1)*table_size + dk + near + 1] =
+                    UVLM::BiotSavart::mesh_kernel(di, dj, dk, h);
+            }
+        }
+    }
+
+    // interpolation and near field
+    uout.resize(n_targets);
+    UVLM::Threads::parallel_for(target_cells.size(), [&](const int& i_cell)
+    {
+        const uint cell = target_cells[i_cell];
+        const int* base = target_base[cell_targets[target_start[cell]]].data();
+        std::vector<uint> near_particles;
+        for (int ci=std::max(0, base[0] - near); ci<=std::min<int>(n[0] - 1, base[0] + near); ++ci)
+        {
+            for (int cj=std::max(0, base[1] - near); cj<=std::min<int>(n[1] - 1, base[1] + near); ++cj)
+            {
+                for (int ck=std::max(0, base[2] - near); ck<=std::min<int>(n[2] - 1, base[2] + near); ++ck)
+                {
+                    const uint near_cell = node(ci, cj, ck);
+                    near_particles.insert(near_particles.end(),
+                                          cell_particles.begin() + cell_start[near_cell],
+                                          cell_particles.begin() + cell_start[near_cell + 1]);
+                }
+            }
+        }
+
+        // mesh velocity on the nodes of the cell without the near particles
+        UVLM::Types::Vector3 cell_velocity[8];
+        for (uint c=0; c<8; ++c)
+        {
+            cell_velocity[c] = mesh_velocity[node(base[0] + (c >> 2),
+                                                  base[1] + ((c >> 1) & 1),
+                                                  base[2] + (c & 1))];
+        }
+        for (const uint& i_particle: near_particles)
+        {
+            const int* particle_node = particle_base[i_particle].data();
+            const UVLM::Types::Real* weights = particle_weights[i_particle].data();
+            for (uint c_particle=0; c_particle<8; ++c_particle)
+            {
+                const UVLM::Types::Vector3 alpha = weights[c_particle]*particle_alpha[i_particle];
+                const int di = base[0] - particle_node[0] - (c_particle >> 2) + near + 1;
+                const int dj = base[1] - particle_node[1] - ((c_particle >> 1) & 1) + near + 1;
+                const int dk = base[2] - particle_node[2] - (c_particle & 1) + near + 1;
+                for (uint c=0; c<8; ++c)
+                {
+                    cell_velocity[c] -= alpha.cross(near_kernel[((di + (c >> 2))*table_size +
+                                                                 dj + ((c >> 1) & 1))*table_size +
+                                                                dk + (c & 1)]);
+                }
+            }
+        }
+
+        // plus the near particles evaluated directly
+        for (uint k=target_start[cell]; k<target_start[cell + 1]; ++k)
+        {
+            const uint i_target = cell_targets[k];
+            const UVLM::Types::Vector3 x(targets.x[i_target], targets.y[i_target], targets.z[i_target]);
+            UVLM::Types::Vector3 u = UVLM::Types::Vector3::Zero();
+            for (uint c=0; c<8; ++c)
+            {
+                u += target_weights[i_target][c]*cell_velocity[c];
+            }
+            for (const uint& i_particle: near_particles)
+            {
+                UVLM::BiotSavart::segment(x,
+                                          particle_a[i_particle],
+                                          particle_b[i_particle],
+                                          particle_gamma[i_particle],
+                                          u,
+                                          particle_radius[i_particle]);
+            }
+            uout.x[i_target] = u(0);
+            uout.y[i_target] = u(1);
+            uout.z[i_target] = u(2);
+        }
+    }, true);
+}
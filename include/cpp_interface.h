@@ -2,9 +2,18 @@
 #include "EigenInclude.h"
 #include "types.h"
 #include "constants.h"
+#include "threads.h"
 #include "geometry.h"
+#include "simulation.h"
 #include "steady.h"
 #include "unsteady.h"
+#include "ensemble.h"
+#include "linear.h"
+#include "rom.h"
+#include "frequency.h"
+#include "adjoint.h"
+#include "autodiff.h"
+#include "trim.h"
 
 // #include "omp.h"
 
@@ -61,5 +70,21 @@ namespace UVLM
                 dimensions[i_surf].second= dimensions_in[i_surf][1];
             }
         }
+
+        // Simulation state bound by the calling thread (nullptr: none)
+        inline UVLM::Simulation::State*& bound_simulation()
+        {
+            static thread_local UVLM::Simulation::State* bound = nullptr;
+            return bound;
+        }
+
+        // Simulation state of the solvers called from this thread: the
+        // bound one, or else one of the thread itself
+        inline UVLM::Simulation::State& simulation()
+        {
+            static thread_local UVLM::Simulation::State thread_simulation;
+            UVLM::Simulation::State* bound = bound_simulation();
+            return bound == nullptr ? thread_simulation:*bound;
+        }
     }
 }
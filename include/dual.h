@@ -0,0 +1,259 @@
+#pragma once
+
+#include "EigenInclude.h"
+#include "types.h"
+
+#include <cmath>
+#include <iostream>
+
+// Forward-mode automatic differentiation.
+// A Dual carries a value and its derivatives along t_n tangent
+// directions, so one evaluation of a templated kernel with Dual scalars
+// returns the result and t_n directional derivatives at once:
+//      f(x + dx) = f(x) + f'(x) dx, dx = tangent[0..t_n)
+// The tangents are a plain array to keep the type trivially copyable
+// and free of alignment requirements inside Eigen matrices.
+namespace UVLM
+{
+    namespace Types
+    {
+        const uint max_dual_directions = 8;
+
+        template <uint t_n>
+        struct Dual
+        {
+            Real value;
+            Real tangent[t_n];
+
+            Dual(): value(0.0)
+            {
+                for (uint i=0; i<t_n; ++i) {tangent[i] = 0.0;}
+            }
+
+            Dual(const Real& in_value): value(in_value)
+            {
+                for (uint i=0; i<t_n; ++i) {tangent[i] = 0.0;}
+            }
+
+            // seeds the i_direction tangent with 1
+            Dual(const Real& in_value, const uint& i_direction): value(in_value)
+            {
+                for (uint i=0; i<t_n; ++i) {tangent[i] = 0.0;}
+                tangent[i_direction] = 1.0;
+            }
+
+            Dual& operator+=(const Dual& other)
+            {
+                value += other.value;
+                for (uint i=0; i<t_n; ++i) {tangent[i] += other.tangent[i];}
+                return *this;
+            }
+
+            Dual& operator-=(const Dual& other)
+            {
+                value -= other.value;
+                for (uint i=0; i<t_n; ++i) {tangent[i] -= other.tangent[i];}
+                return *this;
+            }
+
+            Dual& operator*=(const Dual& other)
+            {
+                for (uint i=0; i<t_n; ++i)
+                {
+                    tangent[i] = tangent[i]*other.value + value*other.tangent[i];
+                }
+                value *= other.value;
+                return *this;
+            }
+
+            Dual& operator/=(const Dual& other)
+            {
+                const Real inv = 1.0/other.value;
+                value *= inv;
+                for (uint i=0; i<t_n; ++i)
+                {
+                    tangent[i] = (tangent[i] - value*other.tangent[i])*inv;
+                }
+                return *this;
+            }
+        };
+
+        // operators. Real operands promote to a Dual with zero tangents
+        template <uint t_n>
+        inline Dual<t_n> operator-(const Dual<t_n>& a)
+        {
+            Dual<t_n> result(a);
+            result.value = -a.value;
+            for (uint i=0; i<t_n; ++i) {result.tangent[i] = -a.tangent[i];}
+            return result;
+        }
+
+        template <uint t_n>
+        inline Dual<t_n> operator+(const Dual<t_n>& a) {return a;}
+
+        template <uint t_n>
+        inline Dual<t_n> operator+(Dual<t_n> a, const Dual<t_n>& b) {return a += b;}
+        template <uint t_n>
+        inline Dual<t_n> operator+(Dual<t_n> a, const Real& b) {a.value += b; return a;}
+        template <uint t_n>
+        inline Dual<t_n> operator+(const Real& a, Dual<t_n> b) {b.value += a; return b;}
+
+        template <uint t_n>
+        inline Dual<t_n> operator-(Dual<t_n> a, const Dual<t_n>& b) {return a -= b;}
+        template <uint t_n>
+        inline Dual<t_n> operator-(Dual<t_n> a, const Real& b) {a.value -= b; return a;}
+        template <uint t_n>
+        inline Dual<t_n> operator-(const Real& a, const Dual<t_n>& b) {return Dual<t_n>(a) -= b;}
+
+        template <uint t_n>
+        inline Dual<t_n> operator*(Dual<t_n> a, const Dual<t_n>& b) {return a *= b;}
+        template <uint t_n>
+        inline Dual<t_n> operator*(Dual<t_n> a, const Real& b)
+        {
+            a.value *= b;
+            for (uint i=0; i<t_n; ++i) {a.tangent[i] *= b;}
+            return a;
+        }
+        template <uint t_n>
+        inline Dual<t_n> operator*(const Real& a, const Dual<t_n>& b) {return b*a;}
+
+        template <uint t_n>
+        inline Dual<t_n> operator/(Dual<t_n> a, const Dual<t_n>& b) {return a /= b;}
+        template <uint t_n>
+        inline Dual<t_n> operator/(const Dual<t_n>& a, const Real& b) {return a*(1.0/b);}
+        template <uint t_n>
+        inline Dual<t_n> operator/(const Real& a, const Dual<t_n>& b) {return Dual<t_n>(a) /= b;}
+
+        // comparisons only look at the value, so branches (cut-off radii)
+        // follow the primal evaluation
+        #define UVLM_DUAL_COMPARISON(op) \
+        template <uint t_n> \
+        inline bool operator op(const Dual<t_n>& a, const Dual<t_n>& b) {return a.value op b.value;} \
+        template <uint t_n> \
+        inline bool operator op(const Dual<t_n>& a, const Real& b) {return a.value op b;} \
+        template <uint t_n> \
+        inline bool operator op(const Real& a, const Dual<t_n>& b) {return a op b.value;}
+        UVLM_DUAL_COMPARISON(<)
+        UVLM_DUAL_COMPARISON(<=)
+        UVLM_DUAL_COMPARISON(>)
+        UVLM_DUAL_COMPARISON(>=)
+        UVLM_DUAL_COMPARISON(==)
+        UVLM_DUAL_COMPARISON(!=)
+        #undef UVLM_DUAL_COMPARISON
+
+        // functions, found by argument dependent lookup
+        // (using std::sqrt; sqrt(x))
+        template <uint t_n>
+        inline Dual<t_n> sqrt(const Dual<t_n>& a)
+        {
+            Dual<t_n> result(a);
+            result.value = std::sqrt(a.value);
+            const Real factor = 0.5/result.value;
+            for (uint i=0; i<t_n; ++i) {result.tangent[i] = factor*a.tangent[i];}
+            return result;
+        }
+
+        template <uint t_n>
+        inline Dual<t_n> abs(const Dual<t_n>& a)
+        {
+            return (a.value < 0.0) ? -a:a;
+        }
+
+        template <uint t_n>
+        inline bool isfinite(const Dual<t_n>& a)
+        {
+            return std::isfinite(a.value);
+        }
+
+        template <uint t_n>
+        inline Real primal(const Dual<t_n>& a)
+        {
+            return a.value;
+        }
+
+        // |value| <= tolerance and every tangent exactly zero. Unlike the
+        // comparisons, it keeps a quantity that vanishes at the primal
+        // point but not in its derivatives (a segment of zero net
+        // circulation whose circulation still changes, for instance).
+        template <uint t_n>
+        inline bool is_zero(const Dual<t_n>& a, const Real& tolerance = 0.0)
+        {
+            if (std::abs(a.value) > tolerance) {return false;}
+            for (uint i=0; i<t_n; ++i)
+            {
+                if (a.tangent[i] != 0.0) {return false;}
+            }
+            return true;
+        }
+
+        template <uint t_n>
+        inline std::ostream& operator<<(std::ostream& out, const Dual<t_n>& a)
+        {
+            return out << a.value;
+        }
+
+        // value and tangents of a matrix of Duals
+        template <typename t_in,
+                  typename t_out>
+        void dual_value(const t_in& in, t_out& out)
+        {
+            out.resize(in.rows(), in.cols());
+            for (uint i=0; i<in.rows(); ++i)
+            {
+                for (uint j=0; j<in.cols(); ++j)
+                {
+                    out(i, j) = in(i, j).value;
+                }
+            }
+        }
+
+        template <typename t_in,
+                  typename t_out>
+        void dual_tangent(const t_in& in, const uint& i_direction, t_out& out)
+        {
+            out.resize(in.rows(), in.cols());
+            for (uint i=0; i<in.rows(); ++i)
+            {
+                for (uint j=0; j<in.cols(); ++j)
+                {
+                    out(i, j) = in(i, j).tangent[i_direction];
+                }
+            }
+        }
+    }
+}
+
+
+namespace Eigen
+{
+    template <uint t_n>
+    struct NumTraits<UVLM::Types::Dual<t_n>>: NumTraits<UVLM::Types::Real>
+    {
+        typedef UVLM::Types::Dual<t_n> Real;
+        typedef UVLM::Types::Dual<t_n> NonInteger;
+        typedef UVLM::Types::Dual<t_n> Nested;
+        typedef UVLM::Types::Dual<t_n> Literal;
+        enum
+        {
+            IsComplex = 0,
+            IsInteger = 0,
+            IsSigned = 1,
+            RequireInitialization = 1,
+            ReadCost = 1 + t_n,
+            AddCost = 1 + t_n,
+            MulCost = 1 + 2*t_n
+        };
+    };
+
+    template <uint t_n, typename BinaryOp>
+    struct ScalarBinaryOpTraits<UVLM::Types::Dual<t_n>, UVLM::Types::Real, BinaryOp>
+    {
+        typedef UVLM::Types::Dual<t_n> ReturnType;
+    };
+
+    template <uint t_n, typename BinaryOp>
+    struct ScalarBinaryOpTraits<UVLM::Types::Real, UVLM::Types::Dual<t_n>, BinaryOp>
+    {
+        typedef UVLM::Types::Dual<t_n> ReturnType;
+    };
+}
@@ -0,0 +1,721 @@
+#pragma once
+
+#include "EigenInclude.h"
+#include "types.h"
+#include "constants.h"
+#include "mapping.h"
+#include "geometry.h"
+#include "biotsavart.h"
+#include "matrix.h"
+#include "wake.h"
+#include "unsteady_utils.h"
+#include "threads.h"
+
+#include <iostream>
+#include <algorithm>
+
+// Ensemble of unsteady simulations advanced in lockstep.
+// All the members share zeta, zeta_dot, zeta_star, normals and
+// rbm_velocity, and only differ in the external velocities
+// (uext and uext_star), hence in gamma, gamma_star and the forces.
+// The containers indexed by member are std::vectors of the usual
+// VecVecMatrix/VecMatrix types.
+namespace UVLM
+{
+    namespace Ensemble
+    {
+        // Data kept between calls, by the simulation
+        // (UVLM::Simulation::State).
+        // The keys are hashes of the geometry used to build every matrix,
+        // so a rigid wing with a prescribed wake assembles and factorises
+        // them only once for the whole run.
+        struct Cache
+        {
+            uint64_t aic_key = 0;
+            bool aic_valid = false;
+            Eigen::PartialPivLU<UVLM::Types::MatrixX> aic_lu;
+
+            uint64_t wake_key = 0;
+            bool wake_valid = false;
+            UVLM::Types::MatrixX wake_influence;
+        };
+
+        // DECLARATIONS
+        template <typename t_zeta,
+                  typename t_zeta_dot,
+                  typename t_uext,
+                  typename t_uext_star,
+                  typename t_zeta_star,
+                  typename t_gamma,
+                  typename t_gamma_star,
+                  typename t_normals,
+                  typename t_rbm_velocity,
+                  typename t_forces>
+        void solver
+        (
+            const uint& i_iter,
+            t_zeta& zeta,
+            t_zeta_dot& zeta_dot,
+            t_uext& uext,
+            t_uext_star& uext_star,
+            t_zeta_star& zeta_star,
+            t_gamma& gamma,
+            t_gamma_star& gamma_star,
+            t_normals& normals,
+            t_rbm_velocity& rbm_velocity,
+            t_forces& forces,
+            t_forces& dynamic_forces,
+            const UVLM::Types::UVMopts& options,
+            const UVLM::Types::FlightConditions& flightconditions,
+            UVLM::Ensemble::Cache& ensemble_cache
+        );
+
+        template <typename t_zeta_col,
+                  typename t_zeta_star,
+                  typename t_normals>
+        void wake_influence
+        (
+            const t_zeta_col& zeta_col,
+            const t_zeta_star& zeta_star,
+            const t_normals& normals,
+            UVLM::Types::MatrixX& influence
+        );
+
+        template <typename t_zeta,
+                  typename t_zeta_dot,
+                  typename t_zeta_star,
+                  typename t_gamma,
+                  typename t_gamma_star,
+                  typename t_uext,
+                  typename t_rbm_velocity,
+                  typename t_forces>
+        void calculate_static_forces
+        (
+            const t_zeta& zeta,
+            const t_zeta_dot& zeta_dot,
+            const t_zeta_star& zeta_star,
+            const t_gamma& gamma,
+            const t_gamma_star& gamma_star,
+            const t_uext& uext,
+            const t_rbm_velocity& rbm_velocity,
+            t_forces& forces,
+            const UVLM::Types::FlightConditions& flightconditions,
+            const std::vector<int>& active_rows
+        );
+    }
+}
+
+// Same time step as UVLM::Unsteady::solver, for every member at once.
+// The wake geometry is shared, so only convection_scheme 0 and 2 are
+// supported. With scheme 2, the wake is convected with the
+// ensemble-averaged uext_star.
+// The AIC is factorised once and all the RHS are solved together;
+// the wake influence on the collocation points is a matrix applied to
+// the gamma_star of all the members.
+// The adaptive wake truncation (UVLM::Unsteady::Utils::WakeTruncation)
+// depends on the circulation, so every member keeps its own active rows,
+// as if run on its own. The truncated rows are left out of the wake
+// influence and of the forces.
+// The closure horseshoes (UVLM::BiotSavart::wake_closure) depend on the
+// last row of every member, so they are added member by member.
+template <typename t_zeta,
+          typename t_zeta_dot,
+          typename t_uext,
+          typename t_uext_star,
+          typename t_zeta_star,
+          typename t_gamma,
+          typename t_gamma_star,
+          typename t_normals,
+          typename t_rbm_velocity,
+          typename t_forces>
+void UVLM::Ensemble::solver
+(
+    const uint&,
+    t_zeta& zeta,
+    t_zeta_dot& zeta_dot,
+    t_uext& uext,
+    t_uext_star& uext_star,
+    t_zeta_star& zeta_star,
+    t_gamma& gamma,
+    t_gamma_star& gamma_star,
+    t_normals& normals,
+    t_rbm_velocity& rbm_velocity,
+    t_forces& forces,
+    t_forces& dynamic_forces,
+    const UVLM::Types::UVMopts& options,
+    const UVLM::Types::FlightConditions& flightconditions,
+    UVLM::Ensemble::Cache& ensemble_cache
+)
+{
+    const uint n_members = uext.size();
+    const uint n_surf = options.NumSurfaces;
+    UVLM::Types::VMopts steady_options = UVLM::Types::UVMopts2VMopts(options);
+
+    UVLM::Types::VecVecMatrixX zeta_col;
+    UVLM::Geometry::generate_colocationMesh(zeta, zeta_col);
+    UVLM::Geometry::generate_surfaceNormal(zeta, normals);
+
+    if (options.convect_wake)
+    {
+        if (options.convection_scheme == 2)
+        {
+            // ensemble-averaged background flow
+            UVLM::Types::VecVecMatrixX uext_star_mean;
+            UVLM::Types::allocate_VecVecMat(uext_star_mean, uext_star[0]);
+            for (uint i_member=0; i_member<n_members; ++i_member)
+            {
+                for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+                {
+                    for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                    {
+                        uext_star_mean[i_surf][i_dim] +=
+                            uext_star[i_member][i_surf][i_dim]/n_members;
+                    }
+                }
+            }
+            UVLM::Types::VecVecMatrixX uext_star_total;
+            UVLM::Types::allocate_VecVecMat(uext_star_total, uext_star_mean);
+            UVLM::Types::VecVecMatrixX zeros;
+            UVLM::Types::allocate_VecVecMat(zeros, uext_star_mean);
+            UVLM::Types::Vector6 rbm_no_omega = UVLM::Types::Vector6::Zero();
+            rbm_no_omega.template head<3>() = rbm_velocity.template head<3>();
+
+            UVLM::Unsteady::Utils::compute_resultant_grid_velocity
+            (
+                zeta_star,
+                zeros,
+                uext_star_mean,
+                rbm_no_omega,
+                uext_star_total
+            );
+            UVLM::Wake::Discretised::convect(zeta_star,
+                                             uext_star_total,
+                                             options.dt);
+            UVLM::Wake::General::displace_VecVecMat(zeta_star);
+            UVLM::Wake::Discretised::generate_new_row
+            (
+                zeta_star,
+                zeta
+            );
+        } else if (options.convection_scheme != 0)
+        {
+            std::cerr << "convection_scheme == "
+                      << options.convection_scheme
+                      << " is not supported by the ensemble solver. \n"
+                      << "Supported options are 0 and 2"
+                      << std::endl;
+        }
+        if (options.convection_scheme == 0 || options.convection_scheme == 2)
+        {
+            for (uint i_member=0; i_member<n_members; ++i_member)
+            {
+                UVLM::Wake::General::displace_VecMat(gamma_star[i_member]);
+            }
+        }
+    }
+
+    uint Ktotal = 0;
+    uint Kstar_total = 0;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        Ktotal += gamma[0][i_surf].size();
+        Kstar_total += gamma_star[0][i_surf].size();
+    }
+
+    // AIC depends on the lattice and the first row of wake panels
+    const uint64_t aic_key = UVLM::Types::hash_VecVecMat
+    (
+        zeta_star,
+        2,
+        UVLM::Types::hash_VecVecMat(zeta)
+    );
+    if (!ensemble_cache.aic_valid || ensemble_cache.aic_key != aic_key)
+    {
+        UVLM::Types::MatrixX aic;
+        UVLM::Threads::first_touch(aic, Ktotal, Ktotal);
+        UVLM::Matrix::AIC(Ktotal,
+                          zeta,
+                          zeta_col,
+                          zeta_star,
+                          zeta_col,
+                          normals,
+                          steady_options,
+                          false,
+                          aic);
+        ensemble_cache.aic_lu.compute(aic);
+        ensemble_cache.aic_key = aic_key;
+        ensemble_cache.aic_valid = true;
+    }
+
+    const uint64_t wake_key = UVLM::Types::hash_VecVecMat
+    (
+        zeta_star,
+        -1,
+        UVLM::Types::hash_VecVecMat(zeta)
+    );
+    if (!ensemble_cache.wake_valid || ensemble_cache.wake_key != wake_key)
+    {
+        UVLM::Ensemble::wake_influence(zeta_col,
+                                       zeta_star,
+                                       normals,
+                                       ensemble_cache.wake_influence);
+        ensemble_cache.wake_key = wake_key;
+        ensemble_cache.wake_valid = true;
+    }
+
+    // wake rows kept as sources by every member (-1: all)
+    std::vector<int> active_rows(n_members);
+    for (uint i_member=0; i_member<n_members; ++i_member)
+    {
+        active_rows[i_member] = UVLM::Unsteady::Utils::truncated_rows(
+            zeta_col,
+            zeta_star,
+            gamma_star[i_member],
+            flightconditions);
+    }
+
+    // one RHS column per member
+    UVLM::Types::MatrixX rhs(Ktotal, n_members);
+    UVLM::Types::MatrixX gamma_star_flat(Kstar_total, n_members);
+    UVLM::Threads::parallel_for(n_members, [&](const int& i_member)
+    {
+        UVLM::Types::VecVecMatrixX uext_total;
+        UVLM::Types::allocate_VecVecMat(uext_total, uext[i_member]);
+        UVLM::Unsteady::Utils::compute_resultant_grid_velocity
+        (
+            zeta,
+            zeta_dot,
+            uext[i_member],
+            rbm_velocity,
+            uext_total
+        );
+        UVLM::Types::VecVecMatrixX uext_total_col;
+        UVLM::Geometry::generate_colocationMesh(uext_total, uext_total_col);
+
+        uint ii = 0;
+        uint ii_star = 0;
+        for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+        {
+            const uint M = gamma[i_member][i_surf].rows();
+            const uint N = gamma[i_member][i_surf].cols();
+            for (uint i=0; i<M; ++i)
+            {
+                for (uint j=0; j<N; ++j)
+                {
+                    rhs(ii++, i_member) =
+                    -(
+                        uext_total_col[i_surf][0](i,j)*normals[i_surf][0](i,j) +
+                        uext_total_col[i_surf][1](i,j)*normals[i_surf][1](i,j) +
+                        uext_total_col[i_surf][2](i,j)*normals[i_surf][2](i,j)
+                    );
+                }
+            }
+            const uint M_star = gamma_star[i_member][i_surf].rows();
+            for (uint i=0; i<M_star; ++i)
+            {
+                const bool active = active_rows[i_member] == -1 ||
+                                    static_cast<int>(i) < active_rows[i_member];
+                for (uint j=0; j<N; ++j)
+                {
+                    gamma_star_flat(ii_star++, i_member) =
+                        active ? gamma_star[i_member][i_surf](i, j):0.0;
+                }
+            }
+        }
+    });
+    rhs.noalias() -= ensemble_cache.wake_influence*gamma_star_flat;
+
+    if (UVLM::BiotSavart::wake_closure().horseshoe)
+    {
+        UVLM::BiotSavart::Points<UVLM::Types::Real> collocation;
+        for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+        {
+            UVLM::BiotSavart::Points<UVLM::Types::Real> surface_collocation;
+            UVLM::BiotSavart::surface_points(zeta_col[i_surf], surface_collocation);
+            collocation.append(surface_collocation);
+        }
+        UVLM::BiotSavart::Points<UVLM::Types::Real> closure_velocity;
+        for (uint i_member=0; i_member<n_members; ++i_member)
+        {
+            closure_velocity.resize(Ktotal);
+            UVLM::BiotSavart::wake_closure_velocity(zeta_star,
+                                                    gamma_star[i_member],
+                                                    collocation,
+                                                    closure_velocity,
+                                                    active_rows[i_member]);
+            uint ii = 0;
+            for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+            {
+                for (uint i=0; i<normals[i_surf][0].rows(); ++i)
+                {
+                    for (uint j=0; j<normals[i_surf][0].cols(); ++j)
+                    {
+                        rhs(ii, i_member) -=
+                            closure_velocity.x[ii]*normals[i_surf][0](i,j) +
+                            closure_velocity.y[ii]*normals[i_surf][1](i,j) +
+                            closure_velocity.z[ii]*normals[i_surf][2](i,j);
+                        ++ii;
+                    }
+                }
+            }
+        }
+    }
+
+    UVLM::Types::MatrixX gamma_flat = ensemble_cache.aic_lu.solve(rhs);
+
+    for (uint i_member=0; i_member<n_members; ++i_member)
+    {
+        UVLM::Types::VectorX gamma_member = gamma_flat.col(i_member);
+        UVLM::Matrix::reconstruct_gamma(gamma_member,
+                                        gamma[i_member],
+                                        zeta_col,
+                                        zeta_star,
+                                        steady_options);
+        UVLM::Wake::Horseshoe::circulation_transfer(gamma[i_member],
+                                                    gamma_star[i_member],
+                                                    1);
+    }
+
+    UVLM::Ensemble::calculate_static_forces
+    (
+        zeta,
+        zeta_dot,
+        zeta_star,
+        gamma,
+        gamma_star,
+        uext,
+        rbm_velocity,
+        forces,
+        flightconditions,
+        active_rows
+    );
+    for (uint i_member=0; i_member<n_members; ++i_member)
+    {
+        UVLM::Types::initialise_VecVecMat(dynamic_forces[i_member]);
+    }
+}
+
+
+// Normal velocity induced at every collocation point by every wake ring
+// with unit circulation (Ktotal x Kstar_total).
+// Columns are ordered as the flattened gamma_star.
+template <typename t_zeta_col,
+          typename t_zeta_star,
+          typename t_normals>
+void UVLM::Ensemble::wake_influence
+(
+    const t_zeta_col& zeta_col,
+    const t_zeta_star& zeta_star,
+    const t_normals& normals,
+    UVLM::Types::MatrixX& influence
+)
+{
+    const uint n_surf = zeta_col.size();
+    std::vector<uint> offset;
+    std::vector<uint> offset_star;
+    uint Ktotal = 0;
+    uint Kstar_total = 0;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        offset.push_back(Ktotal);
+        offset_star.push_back(Kstar_total);
+        Ktotal += zeta_col[i_surf][0].size();
+        Kstar_total += (zeta_star[i_surf][0].rows() - 1)*
+                       (zeta_star[i_surf][0].cols() - 1);
+    }
+
+    UVLM::Threads::first_touch(influence, Ktotal, Kstar_total);
+    UVLM::Threads::parallel_for(n_surf*n_surf, [&](const int& i_pair)
+    {
+        const uint icol_surf = i_pair/n_surf;
+        const uint ii_surf = i_pair%n_surf;
+        const uint M_star = zeta_star[ii_surf][0].rows() - 1;
+        const uint N_star = zeta_star[ii_surf][0].cols() - 1;
+        UVLM::Types::MatrixX unit_gamma_star;
+        unit_gamma_star.setOnes(M_star, N_star);
+        UVLM::Types::Block block = influence.block
+        (
+            offset[icol_surf],
+            offset_star[ii_surf],
+            zeta_col[icol_surf][0].size(),
+            M_star*N_star
+        );
+        UVLM::BiotSavart::multisurface
+        (
+            zeta_star[ii_surf],
+            unit_gamma_star,
+            zeta_col[icol_surf],
+            block,
+            false,
+            normals[icol_surf]
+        );
+    }, true);
+}
+
+
+// Same as UVLM::PostProc::calculate_static_forces_unsteady
+// for every member, with the wake rows from active_rows[i_member] on
+// (if not -1) left out and the wake closure velocity added.
+// The induced velocities at the midpoints of the vortex segments are
+// linear in the circulation, so the ring influences are evaluated once
+// per chunk of segments and applied to all the members as a
+// matrix product.
+template <typename t_zeta,
+          typename t_zeta_dot,
+          typename t_zeta_star,
+          typename t_gamma,
+          typename t_gamma_star,
+          typename t_uext,
+          typename t_rbm_velocity,
+          typename t_forces>
+void UVLM::Ensemble::calculate_static_forces
+(
+    const t_zeta& zeta,
+    const t_zeta_dot& zeta_dot,
+    const t_zeta_star& zeta_star,
+    const t_gamma& gamma,
+    const t_gamma_star& gamma_star,
+    const t_uext& uext,
+    const t_rbm_velocity& rbm_velocity,
+    t_forces& forces,
+    const UVLM::Types::FlightConditions& flightconditions,
+    const std::vector<int>& active_rows
+)
+{
+    const uint n_members = gamma.size();
+    const uint n_surf = zeta.size();
+
+    // rings: bound first, then wake, with the flattened gamma ordering
+    struct Ring
+    {
+        uint i_surf;
+        uint i;
+        uint j;
+        bool wake;
+    };
+    std::vector<Ring> rings;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        for (uint i=0; i<gamma[0][i_surf].rows(); ++i)
+        {
+            for (uint j=0; j<gamma[0][i_surf].cols(); ++j)
+            {
+                rings.push_back({i_surf, i, j, false});
+            }
+        }
+    }
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        for (uint i=0; i<gamma_star[0][i_surf].rows(); ++i)
+        {
+            for (uint j=0; j<gamma_star[0][i_surf].cols(); ++j)
+            {
+                rings.push_back({i_surf, i, j, true});
+            }
+        }
+    }
+    const uint n_rings = rings.size();
+
+    UVLM::Types::MatrixX circulation(n_rings, n_members);
+    for (uint i_member=0; i_member<n_members; ++i_member)
+    {
+        for (uint i_ring=0; i_ring<n_rings; ++i_ring)
+        {
+            const Ring& ring = rings[i_ring];
+            if (!ring.wake)
+            {
+                circulation(i_ring, i_member) =
+                    gamma[i_member][ring.i_surf](ring.i, ring.j);
+            } else if (active_rows[i_member] == -1 ||
+                       static_cast<int>(ring.i) < active_rows[i_member])
+            {
+                circulation(i_ring, i_member) =
+                    gamma_star[i_member][ring.i_surf](ring.i, ring.j);
+            } else
+            {
+                circulation(i_ring, i_member) = 0.0;
+            }
+        }
+    }
+
+    // u_ext taking into account unsteady contributions
+    std::vector<UVLM::Types::VecVecMatrixX> velocities(n_members);
+    for (uint i_member=0; i_member<n_members; ++i_member)
+    {
+        UVLM::Types::allocate_VecVecMat(velocities[i_member], zeta);
+        UVLM::Unsteady::Utils::compute_resultant_grid_velocity
+        (
+            zeta,
+            zeta_dot,
+            uext[i_member],
+            rbm_velocity,
+            velocities[i_member]
+        );
+        UVLM::Types::initialise_VecVecMat(forces[i_member]);
+    }
+
+    // segments, in the order of calculate_static_forces_unsteady
+    struct Segment
+    {
+        uint i_surf;
+        uint i_M;
+        uint i_N;
+        uint i_start;
+        uint j_start;
+        uint i_end;
+        uint j_end;
+    };
+    std::vector<Segment> segments;
+    const unsigned int n_segment = 4;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        const uint M = gamma[0][i_surf].rows();
+        const uint N = gamma[0][i_surf].cols();
+        for (uint i_M=0; i_M<M; ++i_M)
+        {
+            for (uint i_N=0; i_N<N; ++i_N)
+            {
+                for (unsigned int i_segment=0; i_segment<n_segment; ++i_segment)
+                {
+                    if ((i_segment == 1) && (i_M == M - 1))
+                    {
+                        // trailing edge
+                        continue;
+                    }
+                    unsigned int start = i_segment;
+                    unsigned int end = (start + 1)%n_segment;
+                    segments.push_back({i_surf,
+                                        i_M,
+                                        i_N,
+                                        i_M + UVLM::Mapping::vortex_indices(start, 0),
+                                        i_N + UVLM::Mapping::vortex_indices(start, 1),
+                                        i_M + UVLM::Mapping::vortex_indices(end, 0),
+                                        i_N + UVLM::Mapping::vortex_indices(end, 1)});
+                }
+            }
+        }
+    }
+    const uint n_segments = segments.size();
+
+    // closure horseshoes at the segment midpoints, member by member
+    std::vector<UVLM::BiotSavart::Points<UVLM::Types::Real>> closure_velocity(n_members);
+    if (UVLM::BiotSavart::wake_closure().horseshoe)
+    {
+        UVLM::BiotSavart::Points<UVLM::Types::Real> midpoints;
+        midpoints.resize(n_segments);
+        for (uint i_seg=0; i_seg<n_segments; ++i_seg)
+        {
+            const Segment& seg = segments[i_seg];
+            midpoints.x[i_seg] = 0.5*(zeta[seg.i_surf][0](seg.i_start, seg.j_start) +
+                                      zeta[seg.i_surf][0](seg.i_end, seg.j_end));
+            midpoints.y[i_seg] = 0.5*(zeta[seg.i_surf][1](seg.i_start, seg.j_start) +
+                                      zeta[seg.i_surf][1](seg.i_end, seg.j_end));
+            midpoints.z[i_seg] = 0.5*(zeta[seg.i_surf][2](seg.i_start, seg.j_start) +
+                                      zeta[seg.i_surf][2](seg.i_end, seg.j_end));
+        }
+        for (uint i_member=0; i_member<n_members; ++i_member)
+        {
+            closure_velocity[i_member].resize(n_segments);
+            UVLM::BiotSavart::wake_closure_velocity(zeta_star,
+                                                    gamma_star[i_member],
+                                                    midpoints,
+                                                    closure_velocity[i_member],
+                                                    active_rows[i_member]);
+        }
+    }
+
+    // the chunk keeps the influence matrices small
+    const uint chunk_size = 32;
+    UVLM::Types::MatrixX influence_x(chunk_size, n_rings);
+    UVLM::Types::MatrixX influence_y(chunk_size, n_rings);
+    UVLM::Types::MatrixX influence_z(chunk_size, n_rings);
+    for (uint i_chunk=0; i_chunk<n_segments; i_chunk+=chunk_size)
+    {
+        const uint n_chunk = std::min(chunk_size, n_segments - i_chunk);
+        UVLM::Threads::parallel_for(n_chunk, [&](const int& i_seg)
+        {
+            const Segment& seg = segments[i_chunk + i_seg];
+            UVLM::Types::Vector3 rp;
+            for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+            {
+                rp(i_dim) = 0.5*(zeta[seg.i_surf][i_dim](seg.i_start, seg.j_start) +
+                                 zeta[seg.i_surf][i_dim](seg.i_end, seg.j_end));
+            }
+            UVLM::Types::Vector3 uind;
+            for (uint i_ring=0; i_ring<n_rings; ++i_ring)
+            {
+                const Ring& ring = rings[i_ring];
+                uind.setZero();
+                if (ring.wake)
+                {
+                    UVLM::BiotSavart::vortex_ring(rp,
+                                                  zeta_star[ring.i_surf][0].template block<2,2>(ring.i, ring.j),
+                                                  zeta_star[ring.i_surf][1].template block<2,2>(ring.i, ring.j),
+                                                  zeta_star[ring.i_surf][2].template block<2,2>(ring.i, ring.j),
+                                                  1.0,
+                                                  uind);
+                } else
+                {
+                    UVLM::BiotSavart::vortex_ring(rp,
+                                                  zeta[ring.i_surf][0].template block<2,2>(ring.i, ring.j),
+                                                  zeta[ring.i_surf][1].template block<2,2>(ring.i, ring.j),
+                                                  zeta[ring.i_surf][2].template block<2,2>(ring.i, ring.j),
+                                                  1.0,
+                                                  uind);
+                }
+                influence_x(i_seg, i_ring) = uind(0);
+                influence_y(i_seg, i_ring) = uind(1);
+                influence_z(i_seg, i_ring) = uind(2);
+            }
+        });
+
+        UVLM::Types::MatrixX v_ind_x = influence_x.topRows(n_chunk)*circulation;
+        UVLM::Types::MatrixX v_ind_y = influence_y.topRows(n_chunk)*circulation;
+        UVLM::Types::MatrixX v_ind_z = influence_z.topRows(n_chunk)*circulation;
+
+        UVLM::Threads::parallel_for(n_members, [&](const int& i_member)
+        {
+            for (uint i_seg=0; i_seg<n_chunk; ++i_seg)
+            {
+                const Segment& seg = segments[i_chunk + i_seg];
+                UVLM::Types::Vector3 r1;
+                UVLM::Types::Vector3 r2;
+                UVLM::Types::Vector3 v;
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    r1(i_dim) = zeta[seg.i_surf][i_dim](seg.i_start, seg.j_start);
+                    r2(i_dim) = zeta[seg.i_surf][i_dim](seg.i_end, seg.j_end);
+                    v(i_dim) = 0.5*(velocities[i_member][seg.i_surf][i_dim](seg.i_start, seg.j_start) +
+                                    velocities[i_member][seg.i_surf][i_dim](seg.i_end, seg.j_end));
+                }
+                const UVLM::Types::Vector3 rp = 0.5*(r1 + r2);
+                v(0) += v_ind_x(i_seg, i_member);
+                v(1) += v_ind_y(i_seg, i_member);
+                v(2) += v_ind_z(i_seg, i_member);
+                if (closure_velocity[i_member].size() > 0)
+                {
+                    v(0) += closure_velocity[i_member].x[i_chunk + i_seg];
+                    v(1) += closure_velocity[i_member].y[i_chunk + i_seg];
+                    v(2) += closure_velocity[i_member].z[i_chunk + i_seg];
+                }
+
+                const UVLM::Types::Vector3 dl = r2 - r1;
+                const UVLM::Types::Vector3 f = flightconditions.rho*
+                    gamma[i_member][seg.i_surf](seg.i_M, seg.i_N)*v.cross(dl);
+                const UVLM::Types::Vector3 r_cross_f1 = (r1 - rp).cross(f);
+                const UVLM::Types::Vector3 r_cross_f2 = (r2 - rp).cross(f);
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    forces[i_member][seg.i_surf][i_dim](seg.i_start, seg.j_start) +=
+                        0.5*f(i_dim);
+                    forces[i_member][seg.i_surf][i_dim](seg.i_end, seg.j_end) +=
+                        0.5*f(i_dim);
+                    forces[i_member][seg.i_surf][i_dim + 3](seg.i_start, seg.j_start) +=
+                        0.5*r_cross_f1(i_dim);
+                    forces[i_member][seg.i_surf][i_dim + 3](seg.i_end, seg.j_end) +=
+                        0.5*r_cross_f2(i_dim);
+                }
+            }
+        });
+    }
+}
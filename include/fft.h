@@ -0,0 +1,131 @@
+#pragma once
+
+#include "types.h"
+#include "threads.h"
+
+#include <vector>
+#include <cmath>
+
+// Complex to complex FFTs of power of 2 sizes, used by the particle-mesh
+// evaluation of the wake velocities (UVLM::BiotSavart::particle_mesh_velocity).
+// Iterative radix-2 transforms; the 3D transform applies them along every
+// line of each dimension in parallel.
+// Transforms are not normalised: inverse(forward(x)) = n*x.
+namespace UVLM
+{
+    namespace FFT
+    {
+        // DECLARATIONS
+        inline uint next_power_of_2
+        (
+            const uint& n
+        );
+
+        inline void transform
+        (
+            UVLM::Types::Complex* data,
+            const uint& n,
+            const uint& stride,
+            const bool& inverse
+        );
+
+        inline void transform_3d
+        (
+            std::vector<UVLM::Types::Complex>& data,
+            const uint& n0,
+            const uint& n1,
+            const uint& n2,
+            const bool& inverse
+        );
+    }
+}
+
+
+inline uint UVLM::FFT::next_power_of_2
+(
+    const uint& n
+)
+{
+    uint p = 1;
+    while (p < n)
+    {
+        p *= 2;
+    }
+    return p;
+}
+
+
+// In place transform of the n (power of 2) elements
+// data[0], data[stride], ..., data[(n - 1)*stride]
+inline void UVLM::FFT::transform
+(
+    UVLM::Types::Complex* data,
+    const uint& n,
+    const uint& stride,
+    const bool& inverse
+)
+{
+    // bit reversal permutation
+    for (uint i=1, j=0; i<n; ++i)
+    {
+        uint bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            std::swap(data[i*stride], data[j*stride]);
+        }
+    }
+    // butterflies
+    const UVLM::Types::Real sign = inverse ? 1.0:-1.0;
+    for (uint length=2; length<=n; length*=2)
+    {
+        const UVLM::Types::Real angle = sign*2.0*M_PI/length;
+        const UVLM::Types::Complex w_length(std::cos(angle), std::sin(angle));
+        for (uint i=0; i<n; i+=length)
+        {
+            UVLM::Types::Complex w(1.0, 0.0);
+            for (uint k=0; k<length/2; ++k)
+            {
+                const UVLM::Types::Complex u = data[(i + k)*stride];
+                const UVLM::Types::Complex v = w*data[(i + k + length/2)*stride];
+                data[(i + k)*stride] = u + v;
+                data[(i + k + length/2)*stride] = u - v;
+                w *= w_length;
+            }
+        }
+    }
+}
+
+
+// data: n0 x n1 x n2, index (i*n1 + j)*n2 + k
+inline void UVLM::FFT::transform_3d
+(
+    std::vector<UVLM::Types::Complex>& data,
+    const uint& n0,
+    const uint& n1,
+    const uint& n2,
+    const bool& inverse
+)
+{
+    const int lines_k = n0*n1;
+    UVLM::Threads::parallel_for(lines_k, [&](const int& line)
+    {
+        UVLM::FFT::transform(&data[line*n2], n2, 1, inverse);
+    });
+    const int lines_j = n0*n2;
+    UVLM::Threads::parallel_for(lines_j, [&](const int& line)
+    {
+        const uint i = line/n2;
+        const uint k = line%n2;
+        UVLM::FFT::transform(&data[i*n1*n2 + k], n1, n2, inverse);
+    });
+    const int lines_i = n1*n2;
+    UVLM::Threads::parallel_for(lines_i, [&](const int& line)
+    {
+        UVLM::FFT::transform(&data[line], n0, n1*n2, inverse);
+    });
+}
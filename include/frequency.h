@@ -0,0 +1,191 @@
+#pragma once
+
+#include "EigenInclude.h"
+#include "types.h"
+#include "linear.h"
+
+#include <iostream>
+#include <vector>
+
+// Frequency-domain UVLM for small amplitude harmonic motion.
+// All the perturbations are u = Re(u_hat*exp(i*omega*t)) about the
+// reference state of a UVLM::Linear::Linearisation. The wake vortex ring
+// in row i_row was shed i_row time steps ago, so its circulation lags the
+// trailing edge one by exp(-i*omega*dt*i_row). This gives the complex AIC
+//      AIC(omega) = aic_body + aic_wake*Q(omega)
+// which is solved once per frequency instead of time marching until the
+// response is periodic.
+namespace UVLM
+{
+    namespace Frequency
+    {
+        // DECLARATIONS
+        void complex_aic
+        (
+            const UVLM::Linear::Linearisation& lin,
+            const UVLM::Types::Complex& z,
+            const UVLM::Types::MatrixX& aic_body,
+            const UVLM::Types::MatrixX& aic_wake,
+            UVLM::Types::MatrixXc& aic
+        );
+
+        void solve
+        (
+            const UVLM::Linear::Linearisation& lin,
+            const UVLM::Types::Real& omega,
+            const UVLM::Types::Real& dt,
+            const UVLM::Types::MatrixXc& inputs,
+            UVLM::Types::MatrixXc& gamma,
+            UVLM::Types::MatrixXc& forces,
+            const bool& unsteady_forces = true
+        );
+
+        void generalised_forces
+        (
+            const UVLM::Linear::Linearisation& lin,
+            const UVLM::Types::MatrixX& modes,
+            const std::vector<UVLM::Types::Real>& omega,
+            const UVLM::Types::Real& dt,
+            std::vector<UVLM::Types::MatrixXc>& gaf,
+            const bool& unsteady_forces = true
+        );
+
+        UVLM::Types::Real reduced_to_circular
+        (
+            const UVLM::Types::Real& reduced_frequency,
+            const UVLM::Types::FlightConditions& flightconditions
+        );
+    }
+}
+
+
+// Adds the wake columns to the trailing edge ones:
+//      aic = aic_body + aic_wake*Q, Q(i_row) = z^{-i_row}
+// Used both for the AIC and for the force derivatives.
+inline void UVLM::Frequency::complex_aic
+(
+    const UVLM::Linear::Linearisation& lin,
+    const UVLM::Types::Complex& z,
+    const UVLM::Types::MatrixX& aic_body,
+    const UVLM::Types::MatrixX& aic_wake,
+    UVLM::Types::MatrixXc& aic
+)
+{
+    const UVLM::Linear::Indices& indices = lin.indices;
+    const uint n_surf = indices.dimensions.size();
+    aic = aic_body.cast<UVLM::Types::Complex>();
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        const uint M = indices.dimensions[i_surf].first;
+        const uint N = indices.dimensions[i_surf].second;
+        const uint M_star = indices.dimensions_star[i_surf].first;
+        UVLM::Types::Complex lag = 1.0;
+        for (uint i=0; i<M_star; ++i)
+        {
+            for (uint j=0; j<N; ++j)
+            {
+                const uint col = indices.gamma_offset[i_surf] + (M - 1)*N + j;
+                const uint col_star = indices.gamma_star_offset[i_surf] + i*N + j;
+                aic.col(col) += lag*aic_wake.col(col_star).cast<UVLM::Types::Complex>();
+            }
+            lag /= z;
+        }
+    }
+}
+
+
+// inputs: 9*K_zeta x n_cases, [zeta_hat; zeta_dot_hat; uext_hat] per case
+// gamma: K x n_cases
+// forces: 3*K_zeta x n_cases
+// unsteady_forces adds the -rho*A*n*gamma_dot term
+// (UVLM::PostProc::calculate_dynamic_forces) with gamma_dot = i*omega*gamma.
+inline void UVLM::Frequency::solve
+(
+    const UVLM::Linear::Linearisation& lin,
+    const UVLM::Types::Real& omega,
+    const UVLM::Types::Real& dt,
+    const UVLM::Types::MatrixXc& inputs,
+    UVLM::Types::MatrixXc& gamma,
+    UVLM::Types::MatrixXc& forces,
+    const bool& unsteady_forces
+)
+{
+    const uint K_zeta = lin.indices.K_zeta;
+    const UVLM::Types::Complex i_omega(0.0, omega);
+    const UVLM::Types::Complex z = std::exp(i_omega*dt);
+
+    UVLM::Types::MatrixXc aic;
+    UVLM::Frequency::complex_aic(lin, z, lin.aic_body, lin.aic_wake, aic);
+
+    const UVLM::Types::MatrixXc rhs =
+        -lin.dres_dzeta.cast<UVLM::Types::Complex>()*inputs.topRows(3*K_zeta)
+        -lin.dres_dzeta_dot.cast<UVLM::Types::Complex>()*inputs.middleRows(3*K_zeta, 3*K_zeta)
+        -lin.dres_duext.cast<UVLM::Types::Complex>()*inputs.bottomRows(3*K_zeta);
+    gamma = aic.partialPivLu().solve(rhs);
+
+    UVLM::Types::MatrixXc dforces_dgamma;
+    UVLM::Frequency::complex_aic(lin,
+                                 z,
+                                 lin.dforces_dgamma,
+                                 lin.dforces_dgamma_star,
+                                 dforces_dgamma);
+    if (unsteady_forces)
+    {
+        dforces_dgamma += i_omega*lin.dforces_dgamma_dot.cast<UVLM::Types::Complex>();
+    }
+    forces = dforces_dgamma*gamma
+           + lin.dforces_dzeta.cast<UVLM::Types::Complex>()*inputs.topRows(3*K_zeta)
+           + lin.dforces_dzeta_dot.cast<UVLM::Types::Complex>()*inputs.middleRows(3*K_zeta, 3*K_zeta)
+           + lin.dforces_duext.cast<UVLM::Types::Complex>()*inputs.bottomRows(3*K_zeta);
+}
+
+
+// Generalised aerodynamic forces of the modes (3*K_zeta x n_modes, vertex
+// displacements) at every frequency:
+//      gaf[i_freq](i, j) = modes.col(i)^T forces_hat(mode j)
+// with zeta_hat = mode j, zeta_dot_hat = i*omega*mode j.
+inline void UVLM::Frequency::generalised_forces
+(
+    const UVLM::Linear::Linearisation& lin,
+    const UVLM::Types::MatrixX& modes,
+    const std::vector<UVLM::Types::Real>& omega,
+    const UVLM::Types::Real& dt,
+    std::vector<UVLM::Types::MatrixXc>& gaf,
+    const bool& unsteady_forces
+)
+{
+    const uint K_zeta = lin.indices.K_zeta;
+    const uint n_modes = modes.cols();
+    const uint n_freq = omega.size();
+    gaf.resize(n_freq);
+
+    UVLM::Types::MatrixXc inputs;
+    UVLM::Types::MatrixXc gamma;
+    UVLM::Types::MatrixXc forces;
+    for (uint i_freq=0; i_freq<n_freq; ++i_freq)
+    {
+        const UVLM::Types::Complex i_omega(0.0, omega[i_freq]);
+        inputs.setZero(9*K_zeta, n_modes);
+        inputs.topRows(3*K_zeta) = modes.cast<UVLM::Types::Complex>();
+        inputs.middleRows(3*K_zeta, 3*K_zeta) = i_omega*modes.cast<UVLM::Types::Complex>();
+        UVLM::Frequency::solve(lin,
+                               omega[i_freq],
+                               dt,
+                               inputs,
+                               gamma,
+                               forces,
+                               unsteady_forces);
+        gaf[i_freq] = modes.transpose().cast<UVLM::Types::Complex>()*forces;
+    }
+}
+
+
+// k = omega*c_ref/(2*uinf)
+inline UVLM::Types::Real UVLM::Frequency::reduced_to_circular
+(
+    const UVLM::Types::Real& reduced_frequency,
+    const UVLM::Types::FlightConditions& flightconditions
+)
+{
+    return 2.0*flightconditions.uinf*reduced_frequency/flightconditions.c_ref;
+}
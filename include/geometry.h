@@ -16,15 +16,17 @@ namespace UVLM
         // It uses Heron's fomula:
         // s = 0.5*(a + b + c)
         // A = sqrt(s*(s-a)*(s-b)*(s-c))
-        UVLM::Types::Real triangle_area
+        template <typename t_scalar>
+        t_scalar triangle_area
         (
-            const UVLM::Types::Real& a,
-            const UVLM::Types::Real& b,
-            const UVLM::Types::Real& c
+            const t_scalar& a,
+            const t_scalar& b,
+            const t_scalar& c
         )
         {
-            UVLM::Types::Real s = 0.5*(a + b + c);
-            return std::sqrt(s*(s - a)*(s - b)*(s - c));
+            using std::sqrt;
+            t_scalar s = 0.5*(a + b + c);
+            return sqrt(s*(s - a)*(s - b)*(s - c));
         }
 
 
@@ -37,16 +39,18 @@ namespace UVLM
         // 4) calculate area of resulting triangles
         // 5) average the two areas
         template <typename t_block>
-        UVLM::Types::Real panel_area
+        typename t_block::Scalar panel_area
         (
             const t_block& x,
             const t_block& y,
             const t_block& z
         )
         {
-            UVLM::Types::Real area = 0;
+            typedef typename t_block::Scalar t_scalar;
+            using std::sqrt;
+            t_scalar area = 0;
             // calculate side length
-            UVLM::Types::VectorX sides;
+            UVLM::Types::GenericVectorX<t_scalar> sides;
             sides.resize(4);
             uint i_side = 0;
             for (uint i_side=0; i_side<4; ++i_side)
@@ -55,15 +59,15 @@ namespace UVLM
                 uint j_first = UVLM::Mapping::vortex_indices(i_side, 1);
                 uint i_second = UVLM::Mapping::vortex_indices((i_side + 1) % 4, 0);
                 uint j_second = UVLM::Mapping::vortex_indices((i_side + 1) % 4, 1);
-                sides(i_side) = std::sqrt(
+                sides(i_side) = sqrt(
                     (x(i_second,j_second) - x(i_first,j_first))*(x(i_second,j_second) - x(i_first,j_first)) +
                     (y(i_second,j_second) - y(i_first,j_first))*(y(i_second,j_second) - y(i_first,j_first)) +
                     (z(i_second,j_second) - z(i_first,j_first))*(z(i_second,j_second) - z(i_first,j_first)));
             }
 
             // diagonal from 0 to 2
-            UVLM::Types::Real diagonal = 0;
-            diagonal = std::sqrt(
+            t_scalar diagonal = 0;
+            diagonal = sqrt(
                     (x(1,1) - x(0,0))*(x(1,1) - x(0,0)) +
                     (y(1,1) - y(0,0))*(y(1,1) - y(0,0)) +
                     (z(1,1) - z(0,0))*(z(1,1) - z(0,0)));
@@ -72,7 +76,7 @@ namespace UVLM
             area += triangle_area(sides(2), sides(3), diagonal);
 
             // diagonal from 1 to 3
-            diagonal = std::sqrt(
+            diagonal = sqrt(
                     (x(1,0) - x(0,1))*(x(1,0) - x(0,1)) +
                     (y(1,0) - y(0,1))*(y(1,0) - y(0,1)) +
                     (z(1,0) - z(0,1))*(z(1,0) - z(0,1)));
@@ -86,29 +90,31 @@ namespace UVLM
 
 
 
-        template <typename type>
+        template <typename type,
+                  typename t_normal>
         void panel_normal(type& x,
                           type& y,
                           type& z,
-                          UVLM::Types::Vector3& normal
+                          t_normal& normal
                           )
         {
+            typedef UVLM::Types::GenericVector3<typename t_normal::Scalar> t_vector;
             // correction for left-oriented panels
-            UVLM::Types::Vector3 v_01(x(0,1) - x(0,0),
-                                      y(0,1) - y(0,0),
-                                      z(0,1) - z(0,0));
-            UVLM::Types::Vector3 v_03(x(1,0) - x(0,0),
-                                      y(1,0) - y(0,0),
-                                      z(1,0) - z(0,0));
-            UVLM::Types::Vector3 diff = v_01.cross(v_03);
-
-            UVLM::Types::Vector3 A(x(1,1) - x(0,0),
-                                   y(1,1) - y(0,0),
-                                   z(1,1) - z(0,0));
-
-            UVLM::Types::Vector3 B(x(1,0) - x(0,1),
-                                   y(1,0) - y(0,1),
-                                   z(1,0) - z(0,1));
+            t_vector v_01(x(0,1) - x(0,0),
+                          y(0,1) - y(0,0),
+                          z(0,1) - z(0,0));
+            t_vector v_03(x(1,0) - x(0,0),
+                          y(1,0) - y(0,0),
+                          z(1,0) - z(0,0));
+            t_vector diff = v_01.cross(v_03);
+
+            t_vector A(x(1,1) - x(0,0),
+                       y(1,1) - y(0,0),
+                       z(1,1) - z(0,0));
+
+            t_vector B(x(1,0) - x(0,1),
+                       y(1,0) - y(0,1),
+                       z(1,0) - z(0,1));
 
             // if (diff(2) < 0.0)
             // {
@@ -136,6 +142,41 @@ namespace UVLM
             znormal = A(2);
         }
 
+        // Derivatives of the unit normal given by panel_normal with
+        // respect to the corners of the panel, numbered as in
+        // UVLM::Mapping::vortex_indices.
+        // n = c/|c|, c = B x A, with the diagonals A = x(1,1) - x(0,0)
+        // and B = x(1,0) - x(0,1).
+        template <typename type>
+        void panel_normal_derivatives(type& x,
+                                      type& y,
+                                      type& z,
+                                      UVLM::Types::Matrix3 dnormal_dcorner[4]
+                                      )
+        {
+            UVLM::Types::Vector3 A(x(1,1) - x(0,0),
+                                   y(1,1) - y(0,0),
+                                   z(1,1) - z(0,0));
+
+            UVLM::Types::Vector3 B(x(1,0) - x(0,1),
+                                   y(1,0) - y(0,1),
+                                   z(1,0) - z(0,1));
+
+            UVLM::Types::Vector3 c = B.cross(A);
+            const UVLM::Types::Real c_mod = c.norm();
+            UVLM::Types::Vector3 normal = c/c_mod;
+            UVLM::Types::Matrix3 dnormal_dc =
+                (UVLM::Types::Matrix3::Identity() - normal*normal.transpose())/c_mod;
+
+            // dc/dA = [B]x, dc/dB = -[A]x
+            const UVLM::Types::Matrix3 dnormal_dA = dnormal_dc*UVLM::Triads::skew(B);
+            const UVLM::Types::Matrix3 dnormal_dB = -dnormal_dc*UVLM::Triads::skew(A);
+            dnormal_dcorner[0] = -dnormal_dA;
+            dnormal_dcorner[1] = dnormal_dB;
+            dnormal_dcorner[2] = dnormal_dA;
+            dnormal_dcorner[3] = -dnormal_dB;
+        }
+
         template <typename type_in,
                   typename type_out>
         void generate_surfaceNormal(const type_in& zeta,
@@ -152,7 +193,7 @@ namespace UVLM
                     {
                         for (unsigned int jN=0; jN<N; ++jN)
                         {
-                            UVLM::Types::Vector3 temp_normal;
+                            UVLM::Types::GenericVector3<typename type_out::value_type::value_type::Scalar> temp_normal;
                             panel_normal(zeta[i_surf][0].template block<2,2>(iM,jN),
                                          zeta[i_surf][1].template block<2,2>(iM,jN),
                                          zeta[i_surf][2].template block<2,2>(iM,jN),
@@ -189,8 +230,7 @@ namespace UVLM
             if (collocation_mesh.empty())
             {
                 UVLM::Types::allocate_VecVecMat(collocation_mesh,
-                                                UVLM::Constants::NDIM,
-                                                dimensions,
+                                                vortex_mesh,
                                                 -1);
             }
             for (unsigned int i_surf=0; i_surf<dimensions.size(); ++i_surf)
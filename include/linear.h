@@ -0,0 +1,795 @@
+#pragma once
+
+#include "EigenInclude.h"
+#include "types.h"
+#include "constants.h"
+#include "triads.h"
+#include "mapping.h"
+#include "geometry.h"
+#include "biotsavart.h"
+#include "unsteady_utils.h"
+
+#include <iostream>
+#include <algorithm>
+
+// Linearised UVLM.
+// The time step of UVLM::Unsteady::solver is linearised about a
+// reference state (zeta, zeta_dot, uext, gamma, gamma_star), with the
+// wake geometry frozen except for the row attached to the trailing edge.
+//
+// Flat orderings used by the linear model:
+//  - gamma and gamma_star: surface by surface, row major (as in
+//    UVLM::Matrix::reconstruct_gamma).
+//  - vertex quantities (zeta, zeta_dot, uext, forces): 3*i_vertex + i_dim,
+//    with the vertices surface by surface, row major.
+//
+// State space, discrete time:
+//      x^{n+1} = A x^n + B u^{n+1}
+//      y^{n+1} = C x^{n+1} + D u^{n+1}
+// with x = [gamma; gamma_star], u = [zeta; zeta_dot; uext] and
+// y = forces at the vertices (no moments). All of them are perturbations
+// with respect to the reference state.
+namespace UVLM
+{
+    namespace Linear
+    {
+        struct Indices
+        {
+            UVLM::Types::VecDimensions dimensions;
+            UVLM::Types::VecDimensions dimensions_star;
+            std::vector<uint> gamma_offset;
+            std::vector<uint> gamma_star_offset;
+            std::vector<uint> zeta_offset;
+            uint K;
+            uint K_star;
+            uint K_zeta;
+
+            uint vertex(const uint& i_surf, const uint& i, const uint& j) const
+            {
+                return zeta_offset[i_surf] + i*(dimensions[i_surf].second + 1) + j;
+            }
+        };
+
+        // Vortex ring used as a source.
+        // corner_vertex is the vertex of zeta every corner moves with,
+        // or -1 if the corner is frozen (wake).
+        // horseshoe rings use UVLM::BiotSavart::horseshoe, and inactive
+        // ones do not induce any velocity (wake rows behind a horseshoe).
+        struct Ring
+        {
+            uint i_surf;
+            uint i;
+            uint j;
+            bool wake;
+            bool horseshoe;
+            bool active;
+            int corner_vertex[4];
+        };
+
+        // Jacobians of the UVLM time step.
+        // The residual is the normal velocity at the collocation points:
+        //      R = aic_body*gamma + aic_wake*gamma_star + n.u_col = 0
+        struct Linearisation
+        {
+            UVLM::Linear::Indices indices;
+
+            UVLM::Types::MatrixX aic_body;
+            UVLM::Types::MatrixX aic_wake;
+            UVLM::Types::MatrixX dres_dzeta;
+            UVLM::Types::MatrixX dres_dzeta_dot;
+            UVLM::Types::MatrixX dres_duext;
+
+            UVLM::Types::MatrixX dforces_dgamma;
+            UVLM::Types::MatrixX dforces_dgamma_star;
+            UVLM::Types::MatrixX dforces_dzeta;
+            UVLM::Types::MatrixX dforces_dzeta_dot;
+            UVLM::Types::MatrixX dforces_duext;
+            // unsteady term of UVLM::PostProc::calculate_dynamic_forces,
+            // not included in the state space (as in Unsteady::solver)
+            UVLM::Types::MatrixX dforces_dgamma_dot;
+
+            // gamma_star^{n+1} = wake_shift*gamma_star^n +
+            //                    wake_shedding*gamma^{n+1}
+            UVLM::Types::SparseMatrixX wake_shift;
+            UVLM::Types::SparseMatrixX wake_shedding;
+        };
+
+        struct StateSpace
+        {
+            UVLM::Types::MatrixX A;
+            UVLM::Types::MatrixX B;
+            UVLM::Types::MatrixX C;
+            UVLM::Types::MatrixX D;
+        };
+
+        // DECLARATIONS
+        template <typename t_zeta,
+                  typename t_zeta_star>
+        void generate_indices
+        (
+            const t_zeta& zeta,
+            const t_zeta_star& zeta_star,
+            UVLM::Linear::Indices& indices
+        );
+
+        template <typename t_zeta>
+        void generate_rings
+        (
+            const t_zeta& zeta,
+            const UVLM::Linear::Indices& indices,
+            const int& attached_wake_rows,
+            std::vector<UVLM::Linear::Ring>& rings,
+            const bool& horseshoe = false
+        );
+
+        template <typename t_zeta,
+                  typename t_zeta_star>
+        void induced_velocity_derivatives
+        (
+            const UVLM::Types::Vector3& target,
+            const t_zeta& zeta,
+            const t_zeta_star& zeta_star,
+            const std::vector<UVLM::Linear::Ring>& rings,
+            const UVLM::Types::VectorX& circulation,
+            const uint& K_zeta,
+            UVLM::Types::MatrixX& influence,
+            UVLM::Types::Vector3& uind,
+            UVLM::Types::Matrix3& duind_dtarget,
+            UVLM::Types::MatrixX& duind_dzeta
+        );
+
+        template <typename t_zeta,
+                  typename t_zeta_dot,
+                  typename t_uext,
+                  typename t_zeta_star,
+                  typename t_gamma,
+                  typename t_gamma_star,
+                  typename t_rbm_velocity>
+        void linearise
+        (
+            const t_zeta& zeta,
+            const t_zeta_dot& zeta_dot,
+            const t_uext& uext,
+            const t_zeta_star& zeta_star,
+            const t_gamma& gamma,
+            const t_gamma_star& gamma_star,
+            const t_rbm_velocity& rbm_velocity,
+            const UVLM::Types::FlightConditions& flightconditions,
+            UVLM::Linear::Linearisation& lin,
+            const int& attached_wake_rows = 1,
+            const bool& horseshoe = false
+        );
+
+        void assemble_state_space
+        (
+            const UVLM::Linear::Linearisation& lin,
+            UVLM::Linear::StateSpace& ss
+        );
+
+        UVLM::Types::SparseMatrixX sparse
+        (
+            const UVLM::Types::MatrixX& mat,
+            const UVLM::Types::Real& tolerance = 0.0
+        );
+    }
+}
+
+
+template <typename t_zeta,
+          typename t_zeta_star>
+void UVLM::Linear::generate_indices
+(
+    const t_zeta& zeta,
+    const t_zeta_star& zeta_star,
+    UVLM::Linear::Indices& indices
+)
+{
+    const uint n_surf = zeta.size();
+    UVLM::Types::generate_dimensions(zeta, indices.dimensions, -1);
+    UVLM::Types::generate_dimensions(zeta_star, indices.dimensions_star, -1);
+    indices.gamma_offset.resize(n_surf);
+    indices.gamma_star_offset.resize(n_surf);
+    indices.zeta_offset.resize(n_surf);
+    indices.K = 0;
+    indices.K_star = 0;
+    indices.K_zeta = 0;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        const uint M = indices.dimensions[i_surf].first;
+        const uint N = indices.dimensions[i_surf].second;
+        indices.gamma_offset[i_surf] = indices.K;
+        indices.gamma_star_offset[i_surf] = indices.K_star;
+        indices.zeta_offset[i_surf] = indices.K_zeta;
+        indices.K += M*N;
+        indices.K_star += indices.dimensions_star[i_surf].first*
+                          indices.dimensions_star[i_surf].second;
+        indices.K_zeta += (M + 1)*(N + 1);
+    }
+}
+
+
+// Bound rings first, then wake rings, so that the circulation of the
+// rings is [gamma; gamma_star].
+// The vertices of the first attached_wake_rows rows of zeta_star
+// (all of them if -1) follow the trailing edge vertex of their column.
+// With horseshoe, the first wake row is a horseshoe and the rest are
+// inactive, as in UVLM::BiotSavart::surface_with_steady_wake.
+template <typename t_zeta>
+void UVLM::Linear::generate_rings
+(
+    const t_zeta& zeta,
+    const UVLM::Linear::Indices& indices,
+    const int& attached_wake_rows,
+    std::vector<UVLM::Linear::Ring>& rings,
+    const bool& horseshoe
+)
+{
+    const uint n_surf = zeta.size();
+    rings.clear();
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        for (uint i=0; i<indices.dimensions[i_surf].first; ++i)
+        {
+            for (uint j=0; j<indices.dimensions[i_surf].second; ++j)
+            {
+                UVLM::Linear::Ring ring;
+                ring.i_surf = i_surf;
+                ring.i = i;
+                ring.j = j;
+                ring.wake = false;
+                ring.horseshoe = false;
+                ring.active = true;
+                for (uint i_corner=0; i_corner<4; ++i_corner)
+                {
+                    ring.corner_vertex[i_corner] = indices.vertex
+                    (
+                        i_surf,
+                        i + UVLM::Mapping::vortex_indices(i_corner, 0),
+                        j + UVLM::Mapping::vortex_indices(i_corner, 1)
+                    );
+                }
+                rings.push_back(ring);
+            }
+        }
+    }
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        const uint M = indices.dimensions[i_surf].first;
+        for (uint i=0; i<indices.dimensions_star[i_surf].first; ++i)
+        {
+            for (uint j=0; j<indices.dimensions_star[i_surf].second; ++j)
+            {
+                UVLM::Linear::Ring ring;
+                ring.i_surf = i_surf;
+                ring.i = i;
+                ring.j = j;
+                ring.wake = true;
+                ring.horseshoe = horseshoe && (i == 0);
+                ring.active = !horseshoe || (i == 0);
+                for (uint i_corner=0; i_corner<4; ++i_corner)
+                {
+                    const int i_row = i + UVLM::Mapping::vortex_indices(i_corner, 0);
+                    const uint j_col = j + UVLM::Mapping::vortex_indices(i_corner, 1);
+                    if (attached_wake_rows == -1 || i_row < attached_wake_rows)
+                    {
+                        ring.corner_vertex[i_corner] = indices.vertex(i_surf, M, j_col);
+                    } else
+                    {
+                        ring.corner_vertex[i_corner] = -1;
+                    }
+                }
+                rings.push_back(ring);
+            }
+        }
+    }
+}
+
+
+// Velocity induced at target by all the rings, and its derivatives:
+//  influence: 3 x n_rings, velocity per unit circulation of every ring
+//  uind: influence*circulation
+//  duind_dtarget: 3 x 3
+//  duind_dzeta: 3 x 3*K_zeta, through the corners of the rings
+template <typename t_zeta,
+          typename t_zeta_star>
+void UVLM::Linear::induced_velocity_derivatives
+(
+    const UVLM::Types::Vector3& target,
+    const t_zeta& zeta,
+    const t_zeta_star& zeta_star,
+    const std::vector<UVLM::Linear::Ring>& rings,
+    const UVLM::Types::VectorX& circulation,
+    const uint& K_zeta,
+    UVLM::Types::MatrixX& influence,
+    UVLM::Types::Vector3& uind,
+    UVLM::Types::Matrix3& duind_dtarget,
+    UVLM::Types::MatrixX& duind_dzeta
+)
+{
+    const uint n_rings = rings.size();
+    influence.setZero(3, n_rings);
+    duind_dzeta.setZero(3, 3*K_zeta);
+    duind_dtarget.setZero();
+
+    UVLM::Types::Vector3 u_ring;
+    UVLM::Types::Matrix3 du_dcorner[4];
+    auto ring_terms = [&](const auto& source,
+                          const UVLM::Linear::Ring& ring,
+                          const UVLM::Types::Real& gamma)
+    {
+        u_ring.setZero();
+        for (uint i_corner=0; i_corner<4; ++i_corner)
+        {
+            du_dcorner[i_corner].setZero();
+        }
+        if (ring.horseshoe)
+        {
+            UVLM::BiotSavart::horseshoe(target,
+                                        source[0].template block<2,2>(ring.i, ring.j),
+                                        source[1].template block<2,2>(ring.i, ring.j),
+                                        source[2].template block<2,2>(ring.i, ring.j),
+                                        1.0,
+                                        u_ring);
+            UVLM::BiotSavart::horseshoe_derivatives(target,
+                                                    source[0].template block<2,2>(ring.i, ring.j),
+                                                    source[1].template block<2,2>(ring.i, ring.j),
+                                                    source[2].template block<2,2>(ring.i, ring.j),
+                                                    gamma,
+                                                    duind_dtarget,
+                                                    du_dcorner);
+            return;
+        }
+        UVLM::BiotSavart::vortex_ring(target,
+                                      source[0].template block<2,2>(ring.i, ring.j),
+                                      source[1].template block<2,2>(ring.i, ring.j),
+                                      source[2].template block<2,2>(ring.i, ring.j),
+                                      1.0,
+                                      u_ring);
+        UVLM::BiotSavart::vortex_ring_derivatives(target,
+                                                  source[0].template block<2,2>(ring.i, ring.j),
+                                                  source[1].template block<2,2>(ring.i, ring.j),
+                                                  source[2].template block<2,2>(ring.i, ring.j),
+                                                  gamma,
+                                                  duind_dtarget,
+                                                  du_dcorner);
+    };
+    for (uint i_ring=0; i_ring<n_rings; ++i_ring)
+    {
+        const UVLM::Linear::Ring& ring = rings[i_ring];
+        if (!ring.active)
+        {
+            continue;
+        }
+        if (ring.wake)
+        {
+            ring_terms(zeta_star[ring.i_surf], ring, circulation(i_ring));
+        } else
+        {
+            ring_terms(zeta[ring.i_surf], ring, circulation(i_ring));
+        }
+        influence.col(i_ring) = u_ring;
+        for (uint i_corner=0; i_corner<4; ++i_corner)
+        {
+            if (ring.corner_vertex[i_corner] >= 0)
+            {
+                duind_dzeta.template block<3,3>(0, 3*ring.corner_vertex[i_corner]) +=
+                    du_dcorner[i_corner];
+            }
+        }
+    }
+    uind = influence*circulation;
+}
+
+
+// attached_wake_rows = 1 gives the unsteady time step, where only the
+// first row of wake vertices follows the trailing edge.
+// attached_wake_rows = -1 and horseshoe are used for the steady solver
+// (see adjoint.h).
+template <typename t_zeta,
+          typename t_zeta_dot,
+          typename t_uext,
+          typename t_zeta_star,
+          typename t_gamma,
+          typename t_gamma_star,
+          typename t_rbm_velocity>
+void UVLM::Linear::linearise
+(
+    const t_zeta& zeta,
+    const t_zeta_dot& zeta_dot,
+    const t_uext& uext,
+    const t_zeta_star& zeta_star,
+    const t_gamma& gamma,
+    const t_gamma_star& gamma_star,
+    const t_rbm_velocity& rbm_velocity,
+    const UVLM::Types::FlightConditions& flightconditions,
+    UVLM::Linear::Linearisation& lin,
+    const int& attached_wake_rows,
+    const bool& horseshoe
+)
+{
+    const uint n_surf = zeta.size();
+    UVLM::Linear::Indices& indices = lin.indices;
+    UVLM::Linear::generate_indices(zeta, zeta_star, indices);
+    const uint K = indices.K;
+    const uint K_star = indices.K_star;
+    const uint K_zeta = indices.K_zeta;
+
+    std::vector<UVLM::Linear::Ring> rings;
+    UVLM::Linear::generate_rings(zeta,
+                                 indices,
+                                 attached_wake_rows,
+                                 rings,
+                                 horseshoe);
+    const uint n_rings = rings.size();
+
+    UVLM::Types::VectorX circulation(n_rings);
+    for (uint i_ring=0; i_ring<n_rings; ++i_ring)
+    {
+        const UVLM::Linear::Ring& ring = rings[i_ring];
+        circulation(i_ring) = ring.wake ?
+            gamma_star[ring.i_surf](ring.i, ring.j):
+            gamma[ring.i_surf](ring.i, ring.j);
+    }
+
+    // vertex velocities including the grid motion
+    UVLM::Types::VecVecMatrixX velocities;
+    UVLM::Types::allocate_VecVecMat(velocities, zeta);
+    UVLM::Unsteady::Utils::compute_resultant_grid_velocity
+    (
+        zeta,
+        zeta_dot,
+        uext,
+        rbm_velocity,
+        velocities
+    );
+    // d(velocity)/d(zeta) = -[omega]x
+    UVLM::Types::Vector3 omega;
+    omega << rbm_velocity(3), rbm_velocity(4), rbm_velocity(5);
+    const UVLM::Types::Matrix3 dvel_dzeta = -UVLM::Triads::skew(omega);
+
+    // RESIDUAL------------------------------------------------------------
+    lin.aic_body.setZero(K, K);
+    lin.aic_wake.setZero(K, K_star);
+    lin.dres_dzeta.setZero(K, 3*K_zeta);
+    lin.dres_dzeta_dot.setZero(K, 3*K_zeta);
+    lin.dres_duext.setZero(K, 3*K_zeta);
+
+    std::vector<UVLM::Types::IntPair> panels;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        for (uint i=0; i<indices.dimensions[i_surf].first; ++i)
+        {
+            for (uint j=0; j<indices.dimensions[i_surf].second; ++j)
+            {
+                panels.push_back(UVLM::Types::IntPair(i_surf, i*indices.dimensions[i_surf].second + j));
+            }
+        }
+    }
+
+    UVLM::Threads::parallel_for(K, [&](const int& k)
+    {
+        const uint i_surf = panels[k].first;
+        const uint N = indices.dimensions[i_surf].second;
+        const uint i = panels[k].second/N;
+        const uint j = panels[k].second%N;
+
+        UVLM::Types::Vector3 normal;
+        UVLM::Geometry::panel_normal(zeta[i_surf][0].template block<2,2>(i, j),
+                                     zeta[i_surf][1].template block<2,2>(i, j),
+                                     zeta[i_surf][2].template block<2,2>(i, j),
+                                     normal);
+        UVLM::Types::Matrix3 dnormal_dcorner[4];
+        UVLM::Geometry::panel_normal_derivatives(zeta[i_surf][0].template block<2,2>(i, j),
+                                                 zeta[i_surf][1].template block<2,2>(i, j),
+                                                 zeta[i_surf][2].template block<2,2>(i, j),
+                                                 dnormal_dcorner);
+
+        UVLM::Types::Vector3 collocation = UVLM::Types::Vector3::Zero();
+        UVLM::Types::Vector3 u_col = UVLM::Types::Vector3::Zero();
+        uint corner_vertex[4];
+        for (uint i_corner=0; i_corner<4; ++i_corner)
+        {
+            const uint ii = i + UVLM::Mapping::vortex_indices(i_corner, 0);
+            const uint jj = j + UVLM::Mapping::vortex_indices(i_corner, 1);
+            corner_vertex[i_corner] = indices.vertex(i_surf, ii, jj);
+            for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+            {
+                collocation(i_dim) += 0.25*zeta[i_surf][i_dim](ii, jj);
+                u_col(i_dim) += 0.25*velocities[i_surf][i_dim](ii, jj);
+            }
+        }
+
+        UVLM::Types::MatrixX influence;
+        UVLM::Types::Vector3 uind;
+        UVLM::Types::Matrix3 duind_dtarget;
+        UVLM::Types::MatrixX duind_dzeta;
+        UVLM::Linear::induced_velocity_derivatives(collocation,
+                                                   zeta,
+                                                   zeta_star,
+                                                   rings,
+                                                   circulation,
+                                                   K_zeta,
+                                                   influence,
+                                                   uind,
+                                                   duind_dtarget,
+                                                   duind_dzeta);
+
+        const uint row = indices.gamma_offset[i_surf] + i*N + j;
+        lin.aic_body.row(row) = normal.transpose()*influence.leftCols(K);
+        lin.aic_wake.row(row) = normal.transpose()*influence.rightCols(K_star);
+        lin.dres_dzeta.row(row) = normal.transpose()*duind_dzeta;
+
+        const UVLM::Types::Vector3 u_total = u_col + uind;
+        for (uint i_corner=0; i_corner<4; ++i_corner)
+        {
+            const uint col = 3*corner_vertex[i_corner];
+            lin.dres_dzeta.template block<1,3>(row, col) +=
+                u_total.transpose()*dnormal_dcorner[i_corner] +
+                0.25*normal.transpose()*(duind_dtarget + dvel_dzeta);
+            lin.dres_duext.template block<1,3>(row, col) += 0.25*normal.transpose();
+            lin.dres_dzeta_dot.template block<1,3>(row, col) -= 0.25*normal.transpose();
+        }
+    }, true);
+
+    // FORCES--------------------------------------------------------------
+    // as in UVLM::PostProc::calculate_static_forces_unsteady:
+    //      f = rho*gamma*(v x dl), v = u_vertices + u_ind(midpoint)
+    // shared by both vertices of the segment
+    lin.dforces_dgamma.setZero(3*K_zeta, K);
+    lin.dforces_dgamma_star.setZero(3*K_zeta, K_star);
+    lin.dforces_dzeta.setZero(3*K_zeta, 3*K_zeta);
+    lin.dforces_dzeta_dot.setZero(3*K_zeta, 3*K_zeta);
+    lin.dforces_duext.setZero(3*K_zeta, 3*K_zeta);
+
+    struct Segment
+    {
+        uint i_surf;
+        uint i_gamma;
+        uint start;
+        uint end;
+        uint i_start;
+        uint j_start;
+        uint i_end;
+        uint j_end;
+    };
+    std::vector<Segment> segments;
+    const unsigned int n_segment = 4;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        const uint M = indices.dimensions[i_surf].first;
+        const uint N = indices.dimensions[i_surf].second;
+        for (uint i_M=0; i_M<M; ++i_M)
+        {
+            for (uint i_N=0; i_N<N; ++i_N)
+            {
+                for (unsigned int i_segment=0; i_segment<n_segment; ++i_segment)
+                {
+                    if ((i_segment == 1) && (i_M == M - 1))
+                    {
+                        // trailing edge
+                        continue;
+                    }
+                    const unsigned int start = i_segment;
+                    const unsigned int end = (start + 1)%n_segment;
+                    Segment seg;
+                    seg.i_surf = i_surf;
+                    seg.i_gamma = indices.gamma_offset[i_surf] + i_M*N + i_N;
+                    seg.i_start = i_M + UVLM::Mapping::vortex_indices(start, 0);
+                    seg.j_start = i_N + UVLM::Mapping::vortex_indices(start, 1);
+                    seg.i_end = i_M + UVLM::Mapping::vortex_indices(end, 0);
+                    seg.j_end = i_N + UVLM::Mapping::vortex_indices(end, 1);
+                    seg.start = indices.vertex(i_surf, seg.i_start, seg.j_start);
+                    seg.end = indices.vertex(i_surf, seg.i_end, seg.j_end);
+                    segments.push_back(seg);
+                }
+            }
+        }
+    }
+    const uint n_segments = segments.size();
+
+    // segments are processed in chunks: the derivatives are computed in
+    // parallel and accumulated on the shared vertices afterwards.
+    const uint chunk_size = 32;
+    std::vector<UVLM::Types::MatrixX> influence(chunk_size);
+    std::vector<UVLM::Types::Vector3> uind(chunk_size);
+    std::vector<UVLM::Types::Matrix3> duind_drp(chunk_size);
+    std::vector<UVLM::Types::MatrixX> duind_dzeta(chunk_size);
+    for (uint i_chunk=0; i_chunk<n_segments; i_chunk+=chunk_size)
+    {
+        const uint n_chunk = std::min(chunk_size, n_segments - i_chunk);
+        UVLM::Threads::parallel_for(n_chunk, [&](const int& i_seg)
+        {
+            const Segment& seg = segments[i_chunk + i_seg];
+            UVLM::Types::Vector3 rp;
+            for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+            {
+                rp(i_dim) = 0.5*(zeta[seg.i_surf][i_dim](seg.i_start, seg.j_start) +
+                                 zeta[seg.i_surf][i_dim](seg.i_end, seg.j_end));
+            }
+            UVLM::Linear::induced_velocity_derivatives(rp,
+                                                       zeta,
+                                                       zeta_star,
+                                                       rings,
+                                                       circulation,
+                                                       K_zeta,
+                                                       influence[i_seg],
+                                                       uind[i_seg],
+                                                       duind_drp[i_seg],
+                                                       duind_dzeta[i_seg]);
+        });
+
+        for (uint i_seg=0; i_seg<n_chunk; ++i_seg)
+        {
+            const Segment& seg = segments[i_chunk + i_seg];
+            UVLM::Types::Vector3 r1;
+            UVLM::Types::Vector3 r2;
+            UVLM::Types::Vector3 v;
+            for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+            {
+                r1(i_dim) = zeta[seg.i_surf][i_dim](seg.i_start, seg.j_start);
+                r2(i_dim) = zeta[seg.i_surf][i_dim](seg.i_end, seg.j_end);
+                v(i_dim) = 0.5*(velocities[seg.i_surf][i_dim](seg.i_start, seg.j_start) +
+                                velocities[seg.i_surf][i_dim](seg.i_end, seg.j_end));
+            }
+            v += uind[i_seg];
+            const UVLM::Types::Vector3 dl = r2 - r1;
+            const UVLM::Types::Real rho_gamma = flightconditions.rho*circulation(seg.i_gamma);
+            // d(f)/d(v) = -rho*gamma*[dl]x
+            const UVLM::Types::Matrix3 df_dv = -rho_gamma*UVLM::Triads::skew(dl);
+            const UVLM::Types::Vector3 df_dgamma = flightconditions.rho*v.cross(dl);
+
+            // vertex-local terms: dl, midpoint, vertex velocities
+            const UVLM::Types::Matrix3 df_dvertex_common =
+                0.5*df_dv*(duind_drp[i_seg] + dvel_dzeta);
+            const UVLM::Types::Matrix3 df_ddl = rho_gamma*UVLM::Triads::skew(v);
+            const UVLM::Types::MatrixX df_dsources = df_dv*duind_dzeta[i_seg];
+            const UVLM::Types::MatrixX df_dcirculation = df_dv*influence[i_seg];
+
+            const uint vertices[2] = {seg.start, seg.end};
+            for (uint i_vertex=0; i_vertex<2; ++i_vertex)
+            {
+                const uint row = 3*vertices[i_vertex];
+                lin.dforces_dgamma.block(row, 0, 3, K) +=
+                    0.5*df_dcirculation.leftCols(K);
+                lin.dforces_dgamma.template block<3,1>(row, seg.i_gamma) +=
+                    0.5*df_dgamma;
+                lin.dforces_dgamma_star.block(row, 0, 3, K_star) +=
+                    0.5*df_dcirculation.rightCols(K_star);
+                lin.dforces_dzeta.block(row, 0, 3, 3*K_zeta) += 0.5*df_dsources;
+
+                lin.dforces_dzeta.template block<3,3>(row, 3*seg.start) +=
+                    0.5*(df_dvertex_common - df_ddl);
+                lin.dforces_dzeta.template block<3,3>(row, 3*seg.end) +=
+                    0.5*(df_dvertex_common + df_ddl);
+                lin.dforces_duext.template block<3,3>(row, 3*seg.start) += 0.25*df_dv;
+                lin.dforces_duext.template block<3,3>(row, 3*seg.end) += 0.25*df_dv;
+                lin.dforces_dzeta_dot.template block<3,3>(row, 3*seg.start) -= 0.25*df_dv;
+                lin.dforces_dzeta_dot.template block<3,3>(row, 3*seg.end) -= 0.25*df_dv;
+            }
+        }
+    }
+
+    // f_uns = -rho*A*n*gamma_dot, shared by the four corners
+    lin.dforces_dgamma_dot.setZero(3*K_zeta, K);
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        const uint N = indices.dimensions[i_surf].second;
+        for (uint i=0; i<indices.dimensions[i_surf].first; ++i)
+        {
+            for (uint j=0; j<N; ++j)
+            {
+                const UVLM::Types::Real area = UVLM::Geometry::panel_area
+                (
+                    zeta[i_surf][0].template block<2,2>(i, j),
+                    zeta[i_surf][1].template block<2,2>(i, j),
+                    zeta[i_surf][2].template block<2,2>(i, j)
+                );
+                UVLM::Types::Vector3 normal;
+                UVLM::Geometry::panel_normal(zeta[i_surf][0].template block<2,2>(i, j),
+                                             zeta[i_surf][1].template block<2,2>(i, j),
+                                             zeta[i_surf][2].template block<2,2>(i, j),
+                                             normal);
+                const uint col = indices.gamma_offset[i_surf] + i*N + j;
+                for (uint i_corner=0; i_corner<4; ++i_corner)
+                {
+                    const uint row = 3*indices.vertex
+                    (
+                        i_surf,
+                        i + UVLM::Mapping::vortex_indices(i_corner, 0),
+                        j + UVLM::Mapping::vortex_indices(i_corner, 1)
+                    );
+                    lin.dforces_dgamma_dot.template block<3,1>(row, col) =
+                        -0.25*flightconditions.rho*area*normal;
+                }
+            }
+        }
+    }
+
+    // WAKE PROPAGATION----------------------------------------------------
+    std::vector<Eigen::Triplet<UVLM::Types::Real>> shift_triplets;
+    std::vector<Eigen::Triplet<UVLM::Types::Real>> shedding_triplets;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        const uint M = indices.dimensions[i_surf].first;
+        const uint N = indices.dimensions[i_surf].second;
+        const uint M_star = indices.dimensions_star[i_surf].first;
+        const uint offset_star = indices.gamma_star_offset[i_surf];
+        for (uint j=0; j<N; ++j)
+        {
+            shedding_triplets.push_back(Eigen::Triplet<UVLM::Types::Real>
+            (
+                offset_star + j,
+                indices.gamma_offset[i_surf] + (M - 1)*N + j,
+                1.0
+            ));
+            for (uint i=1; i<M_star; ++i)
+            {
+                shift_triplets.push_back(Eigen::Triplet<UVLM::Types::Real>
+                (
+                    offset_star + i*N + j,
+                    offset_star + (i - 1)*N + j,
+                    1.0
+                ));
+            }
+        }
+    }
+    lin.wake_shift.resize(K_star, K_star);
+    lin.wake_shift.setFromTriplets(shift_triplets.begin(), shift_triplets.end());
+    lin.wake_shedding.resize(K_star, K);
+    lin.wake_shedding.setFromTriplets(shedding_triplets.begin(), shedding_triplets.end());
+}
+
+
+// Eliminates gamma^{n+1} from the linearised residual:
+//      (aic_body + aic_wake*Q) gamma^{n+1} =
+//          -aic_wake*P gamma_star^n - dR/du u^{n+1}
+//      gamma_star^{n+1} = P gamma_star^n + Q gamma^{n+1}
+inline void UVLM::Linear::assemble_state_space
+(
+    const UVLM::Linear::Linearisation& lin,
+    UVLM::Linear::StateSpace& ss
+)
+{
+    const uint K = lin.indices.K;
+    const uint K_star = lin.indices.K_star;
+    const uint K_zeta = lin.indices.K_zeta;
+    const uint n_states = K + K_star;
+    const uint n_inputs = 9*K_zeta;
+    const uint n_outputs = 3*K_zeta;
+
+    UVLM::Types::MatrixX aic = lin.aic_body + lin.aic_wake*lin.wake_shedding;
+    Eigen::PartialPivLU<UVLM::Types::MatrixX> aic_lu(aic);
+
+    UVLM::Types::MatrixX dres_du(K, n_inputs);
+    dres_du << lin.dres_dzeta, lin.dres_dzeta_dot, lin.dres_duext;
+
+    const UVLM::Types::MatrixX A_gamma_star = -aic_lu.solve(
+        UVLM::Types::MatrixX(lin.aic_wake*lin.wake_shift));
+    const UVLM::Types::MatrixX B_gamma = -aic_lu.solve(dres_du);
+
+    ss.A.setZero(n_states, n_states);
+    ss.A.block(0, K, K, K_star) = A_gamma_star;
+    ss.A.block(K, K, K_star, K_star) = lin.wake_shedding*A_gamma_star;
+    ss.A.block(K, K, K_star, K_star) += lin.wake_shift;
+
+    ss.B.resize(n_states, n_inputs);
+    ss.B.topRows(K) = B_gamma;
+    ss.B.bottomRows(K_star) = lin.wake_shedding*B_gamma;
+
+    ss.C.resize(n_outputs, n_states);
+    ss.C << lin.dforces_dgamma, lin.dforces_dgamma_star;
+
+    ss.D.resize(n_outputs, n_inputs);
+    ss.D << lin.dforces_dzeta, lin.dforces_dzeta_dot, lin.dforces_duext;
+}
+
+
+// Sparse copy of mat, without the entries with |a_ij| <= tolerance
+inline UVLM::Types::SparseMatrixX UVLM::Linear::sparse
+(
+    const UVLM::Types::MatrixX& mat,
+    const UVLM::Types::Real& tolerance
+)
+{
+    return mat.sparseView(1.0, tolerance);
+}
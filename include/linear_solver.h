@@ -2,6 +2,7 @@
 
 #include "EigenInclude.h"
 #include "types.h"
+#include "dual.h"
 #include "Eigen/IterativeLinearSolvers"
 
 namespace UVLM
@@ -44,5 +45,44 @@ namespace UVLM
                 x = a.partialPivLu().solve(b);
             }
         }
+
+        // Dual systems share the LU of the values between all the tangents:
+        //      x' = a^{-1} (b' - a' x)
+        template <uint t_n,
+                  typename t_options>
+        void solve_system
+        (
+            UVLM::Types::GenericMatrixX<UVLM::Types::Dual<t_n>>& a,
+            UVLM::Types::GenericVectorX<UVLM::Types::Dual<t_n>>& b,
+            t_options&,
+            UVLM::Types::GenericVectorX<UVLM::Types::Dual<t_n>>& x
+        )
+        {
+            UVLM::Types::MatrixX a_value;
+            UVLM::Types::VectorX b_value;
+            UVLM::Types::dual_value(a, a_value);
+            UVLM::Types::dual_value(b, b_value);
+            Eigen::PartialPivLU<UVLM::Types::MatrixX> a_lu(a_value);
+            const UVLM::Types::VectorX x_value = a_lu.solve(b_value);
+
+            x.resize(b.rows());
+            for (uint i=0; i<x.rows(); ++i)
+            {
+                x(i) = x_value(i);
+            }
+            UVLM::Types::MatrixX a_tangent;
+            UVLM::Types::VectorX b_tangent;
+            for (uint i_direction=0; i_direction<t_n; ++i_direction)
+            {
+                UVLM::Types::dual_tangent(a, i_direction, a_tangent);
+                UVLM::Types::dual_tangent(b, i_direction, b_tangent);
+                const UVLM::Types::VectorX x_tangent =
+                    a_lu.solve(UVLM::Types::VectorX(b_tangent - a_tangent*x_value));
+                for (uint i=0; i<x.rows(); ++i)
+                {
+                    x(i).tangent[i_direction] = x_tangent(i);
+                }
+            }
+        }
     }
 }
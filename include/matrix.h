@@ -3,8 +3,12 @@
 #include "EigenInclude.h"
 #include "types.h"
 #include "biotsavart.h"
+#include "threads.h"
 
 #include <fstream>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
 
 namespace UVLM
 {
@@ -33,12 +37,172 @@ namespace UVLM
         );
 
 
+        template <typename t_zeta,
+                  typename t_zeta_col,
+                  typename t_zeta_star,
+                  typename t_normals,
+                  typename t_block>
+        void AIC_block
+        (
+            const uint& icol_surf,
+            const uint& ii_surf,
+            const uint& row_begin,
+            const uint& row_end,
+            const t_zeta& zeta,
+            const t_zeta_col& zeta_col,
+            const t_zeta_star& zeta_star,
+            const t_normals& normals,
+            const UVLM::Types::VMopts& options,
+            const bool horseshoe,
+            t_block& block
+        );
+
+        template <typename t_zeta,
+                  typename t_zeta_col,
+                  typename t_zeta_star,
+                  typename t_normals,
+                  typename t_aic>
+        void AIC_tiles
+        (
+            const t_zeta& zeta,
+            const t_zeta_col& zeta_col,
+            const t_zeta_star& zeta_star,
+            const t_normals& normals,
+            const UVLM::Types::VMopts& options,
+            const bool horseshoe,
+            const std::vector<bool>& recompute,
+            t_aic& aic
+        );
+
+        // AIC blocks and factorisations kept between the calls of one
+        // simulation (see AIC_cached and solve_blockwise, and
+        // UVLM::Simulation::State).
+        // surface_keys are hashes of the lattice of every surface and of
+        // the wake rows its influence depends on.
+        struct BlockCache
+        {
+            bool aic_valid = false;
+            bool steady = false;
+            bool horseshoe = false;
+            bool image_method = false;
+            UVLM::Types::VecDimensions dimensions;
+            UVLM::Types::VecDimensions dimensions_star;
+            std::vector<uint64_t> surface_keys;
+            UVLM::Types::MatrixX aic;
+
+            // factorisation of the whole AIC
+            bool lu_valid = false;
+            Eigen::PartialPivLU<UVLM::Types::MatrixX> lu;
+
+            // factorisation of the block of the unchanged surfaces
+            bool unchanged_valid = false;
+            uint64_t unchanged_key = 0;
+            Eigen::PartialPivLU<UVLM::Types::MatrixX> unchanged_lu;
+
+            // rigid body motion (see update_rigid).
+            // reference_vertices: 3 x n_vertices of the lattice the rigid
+            // motion is measured from
+            bool reference_valid = false;
+            UVLM::Types::MatrixX reference_vertices;
+            // AIC without the wake (body, until solve_rigid factorises it)
+            // and its factorisation
+            bool body_valid = false;
+            UVLM::Types::MatrixX body;
+            Eigen::PartialPivLU<UVLM::Types::MatrixX> body_lu;
+            // Woodbury terms of the current step
+            std::vector<int> trailing_edge;
+            UVLM::Types::MatrixX wake_influence;
+            UVLM::Types::MatrixX body_wake;
+            Eigen::PartialPivLU<UVLM::Types::MatrixX> capacitance_lu;
+        };
+
+        // rms distance to the rigidly moved reference lattice, relative
+        // to its rms radius, below which the motion is taken as rigid
+        const UVLM::Types::Real rigid_motion_tolerance = 1e-10;
+
+        template <typename t_zeta,
+                  typename t_zeta_col,
+                  typename t_zeta_star,
+                  typename t_normals>
+        void AIC_cached
+        (
+            const uint& Ktotal,
+            const t_zeta& zeta,
+            const t_zeta_col& zeta_col,
+            const t_zeta_star& zeta_star,
+            const t_normals& normals,
+            const UVLM::Types::VMopts& options,
+            const bool horseshoe,
+            UVLM::Matrix::BlockCache& cache,
+            std::vector<bool>& changed
+        );
+
+        void solve_blockwise
+        (
+            UVLM::Matrix::BlockCache& cache,
+            const std::vector<bool>& changed,
+            const UVLM::Types::VectorX& rhs,
+            UVLM::Types::VectorX& gamma_flat
+        );
+
+        template <typename t_zeta,
+                  typename t_zeta_star>
+        uint64_t surface_key
+        (
+            const t_zeta& zeta,
+            const t_zeta_star& zeta_star,
+            const UVLM::Types::VMopts& options
+        );
+
+        template <typename t_zeta,
+                  typename t_zeta_col,
+                  typename t_zeta_star,
+                  typename t_normals>
+        bool update_rigid
+        (
+            const t_zeta& zeta,
+            const t_zeta_col& zeta_col,
+            const t_zeta_star& zeta_star,
+            const t_normals& normals,
+            const UVLM::Types::VMopts& options,
+            UVLM::Matrix::BlockCache& cache
+        );
+
+        void solve_rigid
+        (
+            UVLM::Matrix::BlockCache& cache,
+            const UVLM::Types::VectorX& rhs,
+            UVLM::Types::VectorX& gamma_flat
+        );
+
+        template <typename t_zeta>
+        UVLM::Types::Real rigid_fit
+        (
+            const t_zeta& zeta,
+            const UVLM::Types::MatrixX& reference_vertices,
+            UVLM::Types::MatrixX& vertices
+        );
+
+        template <typename t_zeta_col,
+                  typename t_zeta_star,
+                  typename t_normals>
+        void wake_row_influence
+        (
+            const t_zeta_col& zeta_col,
+            const t_zeta_star& zeta_star,
+            const t_normals& normals,
+            UVLM::Types::MatrixX& influence,
+            std::vector<int>& trailing_edge
+        );
+
+
         template <typename t_zeta_col,
                   typename t_zeta_star,
                   typename t_uext_col,
                 //   typename t_zeta_dot_col,
                   typename t_gamma_star,
-                  typename t_normal>
+                  typename t_normal,
+                  typename t_rhs>
         void RHS
         (
             const t_zeta_col& zeta_col,
@@ -48,8 +212,10 @@ namespace UVLM
             const t_gamma_star& gamma_star,
             const t_normal& normal,
             const UVLM::Types::VMopts& options,
-            UVLM::Types::VectorX& rhs,
-            const uint& Ktotal
+            t_rhs& rhs,
+            const uint& Ktotal,
+            const bool& wake_velocity = true,
+            const int& n_wake_rows = -1
         );
 
 
@@ -62,12 +228,13 @@ namespace UVLM
         );
 
 
-        template <typename t_gamma,
+        template <typename t_gamma_flat,
+                  typename t_gamma,
                   typename t_zeta_col,
                   typename t_zeta_star>
         void reconstruct_gamma
         (
-            const UVLM::Types::VectorX& gamma_flat,
+            const t_gamma_flat& gamma_flat,
             t_gamma& gamma,
             const t_zeta_col& zeta_col,
             const t_zeta_star& zeta_star,
@@ -99,6 +266,199 @@ void UVLM::Matrix::AIC
     const bool horseshoe,
     t_aic& aic
 )
+{
+    UVLM::Matrix::AIC_tiles(zeta,
+                            zeta_col,
+                            zeta_star,
+                            normals,
+                            options,
+                            horseshoe,
+                            std::vector<bool>(),
+                            aic);
+}
+
+/*-----------------------------------------------------------------------------
+
+-----------------------------------------------------------------------------*/
+// Fills the AIC in tiles of collocation rows x source surface
+// (see UVLM::Threads::make_tiles), run in parallel.
+// If recompute is not empty, only the blocks of the surface pairs with
+// a surface to recompute are filled, and they are zeroed first; otherwise
+// all the blocks are accumulated into aic.
+template <typename t_zeta,
+          typename t_zeta_col,
+          typename t_zeta_star,
+          typename t_normals,
+          typename t_aic>
+void UVLM::Matrix::AIC_tiles
+(
+    const t_zeta& zeta,
+    const t_zeta_col& zeta_col,
+    const t_zeta_star& zeta_star,
+    const t_normals& normals,
+    const UVLM::Types::VMopts& options,
+    const bool horseshoe,
+    const std::vector<bool>& recompute,
+    t_aic& aic
+)
+{
+    const uint n_surf = options.NumSurfaces;
+    UVLM::Types::VecDimensions dimensions;
+    UVLM::Types::generate_dimensions(zeta_col, dimensions);
+
+    std::vector<uint> offset(n_surf, 0);
+    std::vector<double> source_rings(n_surf, 0.0);
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        if (i_surf > 0)
+        {
+            offset[i_surf] = offset[i_surf - 1] +
+                             dimensions[i_surf - 1].first*dimensions[i_surf - 1].second;
+        }
+        const uint M_star = zeta_star[i_surf][0].rows() - 1;
+        uint n_wake_rows = 1;
+        if (options.Steady && !horseshoe) {n_wake_rows = M_star;}
+        source_rings[i_surf] = (dimensions[i_surf].first + n_wake_rows)*
+                               dimensions[i_surf].second;
+    }
+
+    std::vector<UVLM::Threads::Tile> tiles;
+    UVLM::Threads::make_tiles(dimensions, source_rings, true, tiles);
+    if (!recompute.empty())
+    {
+        tiles.erase(std::remove_if(tiles.begin(),
+                                   tiles.end(),
+                                   [&recompute](const UVLM::Threads::Tile& tile)
+                                   {
+                                       return !recompute[tile.target] &&
+                                              !recompute[tile.source];
+                                   }),
+                    tiles.end());
+    }
+
+    UVLM::Threads::run_tiles(tiles, [&](const UVLM::Threads::Tile& tile)
+    {
+        const uint N = dimensions[tile.target].second;
+        const uint kk_surf = dimensions[tile.source].first*
+                             dimensions[tile.source].second;
+        Eigen::Block<t_aic> block = aic.block(offset[tile.target] + tile.row_begin*N,
+                                              offset[tile.source],
+                                              (tile.row_end - tile.row_begin)*N,
+                                              kk_surf);
+        if (!recompute.empty()) {block.setZero();}
+        UVLM::Matrix::AIC_block(tile.target,
+                                tile.source,
+                                tile.row_begin,
+                                tile.row_end,
+                                zeta,
+                                zeta_col,
+                                zeta_star,
+                                normals,
+                                options,
+                                horseshoe,
+                                block);
+    });
+}
+
+/*-----------------------------------------------------------------------------
+
+-----------------------------------------------------------------------------*/
+// Influence of the panels (and wake) of ii_surf on the collocation point
+// rows [row_begin, row_end) of icol_surf. block is accumulated, not
+// overwritten.
+template <typename t_zeta,
+          typename t_zeta_col,
+          typename t_zeta_star,
+          typename t_normals,
+          typename t_block>
+void UVLM::Matrix::AIC_block
+(
+    const uint& icol_surf,
+    const uint& ii_surf,
+    const uint& row_begin,
+    const uint& row_end,
+    const t_zeta& zeta,
+    const t_zeta_col& zeta_col,
+    const t_zeta_star& zeta_star,
+    const t_normals& normals,
+    const UVLM::Types::VMopts& options,
+    const bool horseshoe,
+    t_block& block
+)
+{
+    typedef typename std::decay<decltype(zeta_col[icol_surf][0].middleRows(0, 1))>::type t_target;
+    typedef typename std::decay<decltype(normals[icol_surf][0].middleRows(0, 1))>::type t_normal;
+    std::vector<t_target> target;
+    std::vector<t_normal> target_normals;
+    for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+    {
+        target.push_back(zeta_col[icol_surf][i_dim].middleRows(row_begin, row_end - row_begin));
+        target_normals.push_back(normals[icol_surf][i_dim].middleRows(row_begin, row_end - row_begin));
+    }
+
+    UVLM::Types::MatrixX dummy_gamma;
+    UVLM::Types::MatrixX dummy_gamma_star;
+    // steady wake coefficients
+    dummy_gamma.setOnes(zeta[ii_surf][0].rows() - 1,
+                        zeta[ii_surf][0].cols() - 1);
+    dummy_gamma_star.setOnes(zeta_star[ii_surf][0].rows() - 1,
+                             zeta_star[ii_surf][0].cols() - 1);
+    if (options.Steady)
+    {
+        UVLM::BiotSavart::multisurface_steady_wake
+        (
+            zeta[ii_surf],
+            zeta_star[ii_surf],
+            dummy_gamma,
+            dummy_gamma_star,
+            target,
+            horseshoe,
+            block,
+            options.ImageMethod,
+            target_normals
+        );
+    } else // unsteady case
+    {
+        UVLM::BiotSavart::multisurface_steady_wake
+        (
+            zeta[ii_surf],
+            zeta_star[ii_surf],
+            dummy_gamma,
+            dummy_gamma_star.topRows<1>(),
+            target,
+            false,
+            block,
+            options.ImageMethod,
+            target_normals
+        );
+    }
+}
+
+/*-----------------------------------------------------------------------------
+
+-----------------------------------------------------------------------------*/
+// Same as AIC, but only the blocks of the surface pairs where at least one
+// of the surfaces changed since the last call are recomputed (cache.aic).
+// A surface changes if its lattice or the wake rows its influence depends
+// on change: the first row of panels in the unsteady case, the whole wake
+// in the steady one. changed is set per surface; any change in the
+// dimensions or in the options resets the cache.
+template <typename t_zeta,
+          typename t_zeta_col,
+          typename t_zeta_star,
+          typename t_normals>
+void UVLM::Matrix::AIC_cached
+(
+    const uint& Ktotal,
+    const t_zeta& zeta,
+    const t_zeta_col& zeta_col,
+    const t_zeta_star& zeta_star,
+    const t_normals& normals,
+    const UVLM::Types::VMopts& options,
+    const bool horseshoe,
+    UVLM::Matrix::BlockCache& cache,
+    std::vector<bool>& changed
+)
 {
     const uint n_surf = options.NumSurfaces;
     UVLM::Types::VecDimensions dimensions;
@@ -106,80 +466,389 @@ void UVLM::Matrix::AIC
     UVLM::Types::VecDimensions dimensions_star;
     UVLM::Types::generate_dimensions(zeta_star, dimensions_star, -1);
 
+    if (!cache.aic_valid ||
+        cache.steady != options.Steady ||
+        cache.horseshoe != horseshoe ||
+        cache.image_method != options.ImageMethod ||
+        cache.dimensions != dimensions ||
+        cache.dimensions_star != dimensions_star)
+    {
+        cache.aic_valid = false;
+        cache.lu_valid = false;
+        cache.unchanged_valid = false;
+        cache.steady = options.Steady;
+        cache.horseshoe = horseshoe;
+        cache.image_method = options.ImageMethod;
+        cache.dimensions = dimensions;
+        cache.dimensions_star = dimensions_star;
+        cache.surface_keys.assign(n_surf, 0);
+        UVLM::Threads::first_touch(cache.aic, Ktotal, Ktotal);
+    }
+
+    changed.assign(n_surf, false);
+    bool any_changed = false;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        const uint64_t key = UVLM::Matrix::surface_key(zeta[i_surf],
+                                                       zeta_star[i_surf],
+                                                       options);
+        changed[i_surf] = !cache.aic_valid || key != cache.surface_keys[i_surf];
+        cache.surface_keys[i_surf] = key;
+        any_changed = any_changed || changed[i_surf];
+    }
+    cache.aic_valid = true;
+    if (!any_changed) {return;}
+    cache.lu_valid = false;
 
-    // build the offsets beforehand
-    // (parallel variation)
-    // std::vector<uint> collocation_offset;
-    std::vector<uint> offset;
+    UVLM::Matrix::AIC_tiles(zeta,
+                            zeta_col,
+                            zeta_star,
+                            normals,
+                            options,
+                            horseshoe,
+                            changed,
+                            cache.aic);
+}
+
+/*-----------------------------------------------------------------------------
+
+-----------------------------------------------------------------------------*/
+// Direct solution of cache.aic gamma_flat = rhs after AIC_cached.
+// If no surface changed, the factorisation of the whole AIC is reused.
+// Otherwise, with U the panels of the unchanged surfaces and C the ones of
+// the changed surfaces, the system is solved through the Schur complement
+//      S = A_CC - A_CU A_UU^{-1} A_UC
+// where the LU of A_UU is kept while those surfaces do not change, so only
+// a system of the size of the changed surfaces is factorised.
+inline void UVLM::Matrix::solve_blockwise
+(
+    UVLM::Matrix::BlockCache& cache,
+    const std::vector<bool>& changed,
+    const UVLM::Types::VectorX& rhs,
+    UVLM::Types::VectorX& gamma_flat
+)
+{
+    const uint n_surf = changed.size();
+    std::vector<int> unchanged_panels;
+    std::vector<int> changed_panels;
+    uint64_t unchanged_key = 14695981039346656037ULL;
     uint i_offset = 0;
-    for (uint icol_surf=0; icol_surf<n_surf; ++icol_surf)
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
     {
-        offset.push_back(i_offset);
-        uint k_surf = dimensions[icol_surf].first*
-                      dimensions[icol_surf].second;
-
-        // uint ii_offset = 0;
-        // for (uint ii_surf=0; ii_surf<n_surf; ++ii_surf)
-        // {
-        //     uint kk_surf = dimensions[ii_surf].first*
-        //                            dimensions[ii_surf].second;
-        //     ii_offset += kk_surf;
-        // }
+        const uint k_surf = cache.dimensions[i_surf].first*
+                            cache.dimensions[i_surf].second;
+        std::vector<int>& panels = changed[i_surf] ? changed_panels:unchanged_panels;
+        for (uint i=0; i<k_surf; ++i) {panels.push_back(i_offset + i);}
         i_offset += k_surf;
+        if (!changed[i_surf])
+        {
+            unchanged_key ^= cache.surface_keys[i_surf] + i_surf;
+            unchanged_key *= 1099511628211ULL;
+        }
     }
 
-    // fill up AIC
-    // uint i_offset = 0;
-    for (uint icol_surf=0; icol_surf<n_surf; ++icol_surf)
+    if (unchanged_panels.empty() || changed_panels.empty())
+    {
+        if (!cache.lu_valid)
+        {
+            cache.lu.compute(cache.aic);
+            cache.lu_valid = true;
+        }
+        gamma_flat = cache.lu.solve(rhs);
+        return;
+    }
+
+    if (!cache.unchanged_valid || cache.unchanged_key != unchanged_key)
     {
-        uint k_surf = dimensions[icol_surf].first*
-                      dimensions[icol_surf].second;
+        cache.unchanged_lu.compute(cache.aic(unchanged_panels, unchanged_panels));
+        cache.unchanged_key = unchanged_key;
+        cache.unchanged_valid = true;
+    }
 
-        uint ii_offset = 0;
-        for (uint ii_surf=0; ii_surf<n_surf; ++ii_surf)
+    const UVLM::Types::MatrixX a_cu = cache.aic(changed_panels, unchanged_panels);
+    const UVLM::Types::MatrixX x =
+        cache.unchanged_lu.solve(cache.aic(unchanged_panels, changed_panels));
+    const UVLM::Types::MatrixX schur =
+        cache.aic(changed_panels, changed_panels) - a_cu*x;
+    const UVLM::Types::VectorX y =
+        cache.unchanged_lu.solve(rhs(unchanged_panels));
+    const UVLM::Types::VectorX gamma_changed =
+        schur.partialPivLu().solve(rhs(changed_panels) - a_cu*y);
+
+    gamma_flat.resize(rhs.size());
+    gamma_flat(changed_panels) = gamma_changed;
+    gamma_flat(unchanged_panels) = y - x*gamma_changed;
+}
+
+/*-----------------------------------------------------------------------------
+
+-----------------------------------------------------------------------------*/
+// Hash of the geometry the AIC blocks of one surface depend on.
+template <typename t_zeta,
+          typename t_zeta_star>
+uint64_t UVLM::Matrix::surface_key
+(
+    const t_zeta& zeta,
+    const t_zeta_star& zeta_star,
+    const UVLM::Types::VMopts& options
+)
+{
+    const int n_rows_star = options.Steady ? -1:2;
+    return UVLM::Types::hash_VecMat(zeta_star,
+                                    n_rows_star,
+                                    UVLM::Types::hash_VecMat(zeta));
+}
+
+/*-----------------------------------------------------------------------------
+
+-----------------------------------------------------------------------------*/
+// Unsteady solve for a lattice that only moved rigidly.
+// The body-body influence coefficients (normal velocities of unit rings)
+// do not change with a rigid motion, so the AIC is
+//      A = B + W E^T
+// with B the body AIC, factorised once, W the influence of the first row
+// of wake rings (K x n_te) and E the trailing edge panels. Only W is
+// recomputed and the system is solved with the Woodbury identity:
+//      Z = B^{-1} W, y = B^{-1} rhs
+//      gamma = y - Z (I + E^T Z)^{-1} E^T y
+// The RHS is built with the current normals, so it needs no transform.
+// update_rigid assembles W (and B when it is not factorised yet),
+// solve_rigid does the factorisations (B and the capacitance matrix
+// I + E^T Z) and applies them, so they can run outside a task region.
+// update_rigid returns false (nothing done) if the motion is not rigid, if
+// the AIC did not change at all (solve_blockwise reuses its factorisation
+// then) or with options the invariance does not hold for (steady, image
+// method). A non rigid lattice becomes the new reference.
+template <typename t_zeta,
+          typename t_zeta_col,
+          typename t_zeta_star,
+          typename t_normals>
+bool UVLM::Matrix::update_rigid
+(
+    const t_zeta& zeta,
+    const t_zeta_col& zeta_col,
+    const t_zeta_star& zeta_star,
+    const t_normals& normals,
+    const UVLM::Types::VMopts& options,
+    UVLM::Matrix::BlockCache& cache
+)
+{
+    if (options.Steady || options.ImageMethod) {return false;}
+
+    const uint n_surf = options.NumSurfaces;
+    UVLM::Types::VecDimensions dimensions;
+    UVLM::Types::generate_dimensions(zeta_col, dimensions);
+    UVLM::Types::VecDimensions dimensions_star;
+    UVLM::Types::generate_dimensions(zeta_star, dimensions_star, -1);
+
+    UVLM::Types::MatrixX vertices;
+    const UVLM::Types::Real residual = UVLM::Matrix::rigid_fit(zeta,
+                                                               cache.reference_vertices,
+                                                               vertices);
+    if (!cache.reference_valid ||
+        residual > UVLM::Matrix::rigid_motion_tolerance)
+    {
+        cache.reference_vertices = vertices;
+        cache.reference_valid = true;
+        cache.body_valid = false;
+        return false;
+    }
+
+    bool unchanged = cache.aic_valid &&
+                     cache.steady == options.Steady &&
+                     !cache.horseshoe &&
+                     cache.image_method == options.ImageMethod &&
+                     cache.dimensions == dimensions &&
+                     cache.dimensions_star == dimensions_star;
+    for (uint i_surf=0; unchanged && i_surf<n_surf; ++i_surf)
+    {
+        unchanged = cache.surface_keys[i_surf] ==
+            UVLM::Matrix::surface_key(zeta[i_surf], zeta_star[i_surf], options);
+    }
+    if (unchanged) {return false;}
+
+    UVLM::Types::MatrixX& influence = cache.wake_influence;
+    std::vector<int>& trailing_edge = cache.trailing_edge;
+    UVLM::Matrix::wake_row_influence(zeta_col,
+                                     zeta_star,
+                                     normals,
+                                     influence,
+                                     trailing_edge);
+    const uint Ktotal = influence.rows();
+    const uint n_te = trailing_edge.size();
+
+    if (!cache.body_valid ||
+        cache.body_lu.rows() != static_cast<int>(Ktotal))
+    {
+        UVLM::Types::MatrixX& body = cache.body;
+        UVLM::Threads::first_touch(body, Ktotal, Ktotal);
+        UVLM::Matrix::AIC(Ktotal,
+                          zeta,
+                          zeta_col,
+                          zeta_star,
+                          zeta_col,
+                          normals,
+                          options,
+                          false,
+                          body);
+        for (uint i_te=0; i_te<n_te; ++i_te)
         {
-            uint kk_surf = dimensions[ii_surf].first*
-                                   dimensions[ii_surf].second;
-            UVLM::Types::MatrixX dummy_gamma;
-            UVLM::Types::MatrixX dummy_gamma_star;
-            UVLM::Types::Block block = aic.block(offset[icol_surf], offset[ii_surf], k_surf, kk_surf);
-            // steady wake coefficients
-            dummy_gamma.setOnes(dimensions[ii_surf].first,
-                                dimensions[ii_surf].second);
-            dummy_gamma_star.setOnes(dimensions_star[ii_surf].first,
-                                     dimensions_star[ii_surf].second);
-            if (options.Steady)
-            {
-                UVLM::BiotSavart::multisurface_steady_wake
-                (
-                    zeta[ii_surf],
-                    zeta_star[ii_surf],
-                    dummy_gamma,
-                    dummy_gamma_star,
-                    zeta_col[icol_surf],
-                    horseshoe,
-                    block,
-                    options.ImageMethod,
-                    normals[icol_surf]
-                );
-            } else // unsteady case
+            body.col(trailing_edge[i_te]) -= influence.col(i_te);
+        }
+        cache.body_valid = true;
+    }
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+
+-----------------------------------------------------------------------------*/
+inline void UVLM::Matrix::solve_rigid
+(
+    UVLM::Matrix::BlockCache& cache,
+    const UVLM::Types::VectorX& rhs,
+    UVLM::Types::VectorX& gamma_flat
+)
+{
+    if (cache.body.size() > 0)
+    {
+        cache.body_lu.compute(cache.body);
+        cache.body.resize(0, 0);
+    }
+    cache.body_wake = cache.body_lu.solve(cache.wake_influence);
+    UVLM::Types::MatrixX capacitance = cache.body_wake(cache.trailing_edge, Eigen::all);
+    capacitance.diagonal().array() += 1.0;
+    cache.capacitance_lu.compute(capacitance);
+
+    const UVLM::Types::VectorX y = cache.body_lu.solve(rhs);
+    gamma_flat = y - cache.body_wake*cache.capacitance_lu.solve(
+        UVLM::Types::VectorX(y(cache.trailing_edge)));
+}
+
+/*-----------------------------------------------------------------------------
+
+-----------------------------------------------------------------------------*/
+// Kabsch fit of the rigid motion taking reference_vertices to the vertices
+// of zeta (returned in vertices, 3 x n_vertices).
+// Returns the rms distance after the fit relative to the rms radius of the
+// reference, or infinity if the sizes do not match.
+template <typename t_zeta>
+UVLM::Types::Real UVLM::Matrix::rigid_fit
+(
+    const t_zeta& zeta,
+    const UVLM::Types::MatrixX& reference_vertices,
+    UVLM::Types::MatrixX& vertices
+)
+{
+    uint n_vertices = 0;
+    for (uint i_surf=0; i_surf<zeta.size(); ++i_surf)
+    {
+        n_vertices += zeta[i_surf][0].size();
+    }
+    vertices.resize(UVLM::Constants::NDIM, n_vertices);
+    uint i_vertex = 0;
+    for (uint i_surf=0; i_surf<zeta.size(); ++i_surf)
+    {
+        for (uint i=0; i<zeta[i_surf][0].rows(); ++i)
+        {
+            for (uint j=0; j<zeta[i_surf][0].cols(); ++j)
             {
-                UVLM::BiotSavart::multisurface_steady_wake
-                (
-                    zeta[ii_surf],
-                    zeta_star[ii_surf],
-                    dummy_gamma,
-                    dummy_gamma_star.topRows<1>(),
-                    zeta_col[icol_surf],
-                    false,
-                    block,
-                    options.ImageMethod,
-                    normals[icol_surf]
-                );
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    vertices(i_dim, i_vertex) = zeta[i_surf][i_dim](i, j);
+                }
+                ++i_vertex;
             }
-            // ii_offset += kk_surf;
         }
-        // i_offset += k_surf;
+    }
+    if (reference_vertices.cols() != vertices.cols() || n_vertices == 0)
+    {
+        return std::numeric_limits<UVLM::Types::Real>::infinity();
+    }
+
+    const UVLM::Types::Vector3 reference_centre = reference_vertices.rowwise().mean();
+    const UVLM::Types::Vector3 centre = vertices.rowwise().mean();
+    const UVLM::Types::MatrixX p = reference_vertices.colwise() - reference_centre;
+    const UVLM::Types::MatrixX q = vertices.colwise() - centre;
+    const UVLM::Types::Matrix3 h = p*q.transpose();
+    Eigen::JacobiSVD<UVLM::Types::Matrix3> svd(h, Eigen::ComputeFullU | Eigen::ComputeFullV);
+    UVLM::Types::Matrix3 correction = UVLM::Types::Matrix3::Identity();
+    correction(2, 2) = (svd.matrixV()*svd.matrixU().transpose()).determinant() < 0.0 ? -1.0:1.0;
+    const UVLM::Types::Matrix3 rotation =
+        svd.matrixV()*correction*svd.matrixU().transpose();
+
+    const UVLM::Types::Real radius = p.norm();
+    if (radius == 0.0) {return std::numeric_limits<UVLM::Types::Real>::infinity();}
+    return (rotation*p - q).norm()/radius;
+}
+
+/*-----------------------------------------------------------------------------
+
+-----------------------------------------------------------------------------*/
+// Normal velocity at every collocation point induced by every ring of the
+// first wake row with unit circulation (Ktotal x n_te).
+// trailing_edge is the index of the panel every wake column sheds from.
+template <typename t_zeta_col,
+          typename t_zeta_star,
+          typename t_normals>
+void UVLM::Matrix::wake_row_influence
+(
+    const t_zeta_col& zeta_col,
+    const t_zeta_star& zeta_star,
+    const t_normals& normals,
+    UVLM::Types::MatrixX& influence,
+    std::vector<int>& trailing_edge
+)
+{
+    const uint n_surf = zeta_col.size();
+    std::vector<uint> col_offset(n_surf + 1, 0);
+    std::vector<uint> te_offset(n_surf + 1, 0);
+    trailing_edge.clear();
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        const uint M = zeta_col[i_surf][0].rows();
+        const uint N = zeta_col[i_surf][0].cols();
+        for (uint j=0; j<N; ++j)
+        {
+            trailing_edge.push_back(col_offset[i_surf] + (M - 1)*N + j);
+        }
+        col_offset[i_surf + 1] = col_offset[i_surf] + M*N;
+        te_offset[i_surf + 1] = te_offset[i_surf] + N;
+    }
+    influence.setZero(col_offset[n_surf], te_offset[n_surf]);
+
+    for (uint icol_surf=0; icol_surf<n_surf; ++icol_surf)
+    {
+        const uint M = zeta_col[icol_surf][0].rows();
+        const uint N = zeta_col[icol_surf][0].cols();
+        UVLM::Threads::parallel_for(M*N, [&](const int& i_panel)
+        {
+            const uint i = i_panel/N;
+            const uint j = i_panel%N;
+            UVLM::Types::Vector3 target_triad;
+            target_triad << zeta_col[icol_surf][0](i, j),
+                            zeta_col[icol_surf][1](i, j),
+                            zeta_col[icol_surf][2](i, j);
+            UVLM::Types::Vector3 normal;
+            normal << normals[icol_surf][0](i, j),
+                      normals[icol_surf][1](i, j),
+                      normals[icol_surf][2](i, j);
+            for (uint ii_surf=0; ii_surf<n_surf; ++ii_surf)
+            {
+                for (uint jj=0; jj<zeta_star[ii_surf][0].cols() - 1; ++jj)
+                {
+                    UVLM::Types::Vector3 uind = UVLM::Types::Vector3::Zero();
+                    UVLM::BiotSavart::vortex_ring(target_triad,
+                                                  zeta_star[ii_surf][0].template block<2,2>(0, jj),
+                                                  zeta_star[ii_surf][1].template block<2,2>(0, jj),
+                                                  zeta_star[ii_surf][2].template block<2,2>(0, jj),
+                                                  1.0,
+                                                  uind);
+                    influence(col_offset[icol_surf] + i*N + j,
+                              te_offset[ii_surf] + jj) = uind.dot(normal);
+                }
+            }
+        });
     }
 }
 
@@ -191,7 +860,8 @@ template <typename t_zeta_col,
           typename t_uext_col,
         //   typename t_zeta_dot_col,
           typename t_gamma_star,
-          typename t_normal>
+          typename t_normal,
+          typename t_rhs>
 void UVLM::Matrix::RHS
 (
     const t_zeta_col& zeta_col,
@@ -201,58 +871,86 @@ void UVLM::Matrix::RHS
     const t_gamma_star& gamma_star,
     const t_normal& normal,
     const UVLM::Types::VMopts& options,
-    UVLM::Types::VectorX& rhs,
-    const uint& Ktotal
+    t_rhs& rhs,
+    const uint& Ktotal,
+    const bool& wake_velocity,
+    const int& n_wake_rows
 )
 {
+    typedef typename t_rhs::Scalar t_scalar;
     const uint n_surf = options.NumSurfaces;
 
     // make a copy of uinc in order to add wake effects
-    UVLM::Types::VecVecMatrixX u_col;
+    UVLM::Types::GenericVecVecMatrixX<t_scalar> u_col;
     UVLM::Types::allocate_VecVecMat(u_col, uinc_col);
     UVLM::Types::copy_VecVecMat(uinc_col, u_col);
 
     rhs.setZero(Ktotal);
 
-    // filling up RHS
-    int ii = -1;
-    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
-    {
-        uint M = uinc_col[i_surf][0].rows();
-        uint N = uinc_col[i_surf][0].cols();
-
+    UVLM::Types::VecDimensions dimensions;
+    UVLM::Types::generate_dimensions(uinc_col, dimensions);
 
-        for (uint i=0; i<M; ++i)
+    // wake_velocity = false: the wake effect is already in uinc_col
+    // (see UVLM::Unsteady::far_wake_sweep)
+    if (!options.Steady && wake_velocity)
+    {
+        // we have to add the wake effect on the induced velocity:
+        // wake rings from the second row on (the first one is in the AIC)
+        // up to n_wake_rows (-1: all) and the last shed row, on the
+        // collocation points of all the surfaces at once
+        UVLM::BiotSavart::Segments<t_scalar> wake_segments;
+        UVLM::BiotSavart::Points<t_scalar> collocation_points;
+        const int wake_rows = UVLM::BiotSavart::shed_rows(gamma_star, n_wake_rows);
+        for (uint ii_surf=0; ii_surf<n_surf; ++ii_surf)
+        {
+            UVLM::BiotSavart::lattice_segments(zeta_star[ii_surf],
+                                               gamma_star[ii_surf],
+                                               [wake_rows](const int& i, const int&)
+                                               {
+                                                   return i < wake_rows ? 0:-1;
+                                               },
+                                               wake_segments,
+                                               1);
+            UVLM::BiotSavart::Points<t_scalar> surface_collocation;
+            UVLM::BiotSavart::surface_points(zeta_col[ii_surf], surface_collocation);
+            collocation_points.append(surface_collocation);
+        }
+        UVLM::BiotSavart::sort_segments(wake_segments);
+        UVLM::BiotSavart::Points<t_scalar> induced_vel;
+        UVLM::BiotSavart::induced_velocity(wake_segments,
+                                           collocation_points,
+                                           induced_vel);
+        UVLM::BiotSavart::wake_closure_velocity(zeta_star,
+                                                gamma_star,
+                                                collocation_points,
+                                                induced_vel,
+                                                n_wake_rows);
+        uint counter = 0;
+        for (uint i_surf=0; i_surf<n_surf; ++i_surf)
         {
-            for (uint j=0; j<N; ++j)
+            for (uint i=0; i<dimensions[i_surf].first; ++i)
             {
-                if (!options.Steady)
+                for (uint j=0; j<dimensions[i_surf].second; ++j)
                 {
-                    // we have to add the wake effect on the induced velocity.
-                    UVLM::Types::Vector3 collocation_coords;
-                    collocation_coords << zeta_col[i_surf][0](i,j),
-                                          zeta_col[i_surf][1](i,j),
-                                          zeta_col[i_surf][2](i,j);
-                    for (uint ii_surf=0; ii_surf<n_surf; ++ii_surf)
-                    {
-                        UVLM::Types::VecMatrixX induced_vel;
-                        UVLM::Types::allocate_VecMat(induced_vel, zeta_star[ii_surf], -1);
-
-                        UVLM::BiotSavart::surface
-                        (
-                            zeta_star[ii_surf],
-                            gamma_star[ii_surf],
-                            collocation_coords,
-                            induced_vel,
-                            1
-                        );
-                        u_col[i_surf][0](i, j) += induced_vel[0].sum();
-                        u_col[i_surf][1](i, j) += induced_vel[1].sum();
-                        u_col[i_surf][2](i, j) += induced_vel[2].sum();
-                    }
+                    u_col[i_surf][0](i, j) += induced_vel.x[counter];
+                    u_col[i_surf][1](i, j) += induced_vel.y[counter];
+                    u_col[i_surf][2](i, j) += induced_vel.z[counter];
+                    ++counter;
                 }
+            }
+        }
+    }
+
+    // filling up RHS
+    uint counter = 0;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        for (uint i=0; i<dimensions[i_surf].first; ++i)
+        {
+            for (uint j=0; j<dimensions[i_surf].second; ++j)
+            {
                 // dot product of uinc and panel normal
-                rhs(++ii) =
+                rhs(counter++) =
                 -(
                     u_col[i_surf][0](i,j) * normal[i_surf][0](i,j) +
                     u_col[i_surf][1](i,j) * normal[i_surf][1](i,j) +
@@ -291,12 +989,13 @@ void UVLM::Matrix::generate_assembly_offset
     }
 }
 
-template <typename t_gamma,
+template <typename t_gamma_flat,
+          typename t_gamma,
           typename t_zeta_col,
           typename t_zeta_star>
 void UVLM::Matrix::reconstruct_gamma
 (
-    const UVLM::Types::VectorX& gamma_flat,
+    const t_gamma_flat& gamma_flat,
     t_gamma& gamma,
     const t_zeta_col& zeta_col,
     const t_zeta_star& zeta_star,
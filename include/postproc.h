@@ -9,6 +9,144 @@ namespace UVLM
 {
     namespace PostProc
     {
+        // Midpoints of the bound segments, in the order the force
+        // calculations below visit them (trailing edge segments are
+        // skipped).
+        template <typename t_zeta,
+                  typename t_gamma,
+                  typename t_scalar>
+        void segment_midpoints
+        (
+            const t_zeta& zeta,
+            const t_gamma& gamma,
+            UVLM::BiotSavart::Points<t_scalar>& midpoints
+        )
+        {
+            const uint n_surf = zeta.size();
+            midpoints.resize(0);
+            for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+            {
+                const uint M = gamma[i_surf].rows();
+                const uint N = gamma[i_surf].cols();
+                for (uint i_M=0; i_M<M; ++i_M)
+                {
+                    for (uint i_N=0; i_N<N; ++i_N)
+                    {
+                        const unsigned int n_segment = 4;
+                        for (unsigned int i_segment=0; i_segment<n_segment; ++i_segment)
+                        {
+                            if ((i_segment == 1) && (i_M == M - 1))
+                            {
+                                // trailing edge
+                                continue;
+                            }
+                            unsigned int start = i_segment;
+                            unsigned int end = (start + 1)%n_segment;
+                            uint i_start = i_M + UVLM::Mapping::vortex_indices(start, 0);
+                            uint j_start = i_N + UVLM::Mapping::vortex_indices(start, 1);
+                            uint i_end = i_M + UVLM::Mapping::vortex_indices(end, 0);
+                            uint j_end = i_N + UVLM::Mapping::vortex_indices(end, 1);
+                            midpoints.x.push_back(0.5*(zeta[i_surf][0](i_start, j_start) +
+                                                       zeta[i_surf][0](i_end, j_end)));
+                            midpoints.y.push_back(0.5*(zeta[i_surf][1](i_start, j_start) +
+                                                       zeta[i_surf][1](i_end, j_end)));
+                            midpoints.z.push_back(0.5*(zeta[i_surf][2](i_start, j_start) +
+                                                       zeta[i_surf][2](i_end, j_end)));
+                        }
+                    }
+                }
+            }
+        }
+
+        // Velocity induced by all the surfaces and wakes at the segment
+        // midpoints (segment_midpoints).
+        // With discretised wakes all the midpoints are evaluated at once
+        // (UVLM::BiotSavart::induced_velocity), and only the first
+        // n_wake_rows rows of every wake are taken if n_wake_rows != -1
+        // (and never the rows not shed yet).
+        template <typename t_zeta,
+                  typename t_zeta_star,
+                  typename t_gamma,
+                  typename t_gamma_star,
+                  typename t_scalar>
+        void midpoint_induced_velocity
+        (
+            const t_zeta& zeta,
+            const t_zeta_star& zeta_star,
+            const t_gamma& gamma,
+            const t_gamma_star& gamma_star,
+            const UVLM::Types::VMopts& options,
+            UVLM::BiotSavart::Points<t_scalar>& v_ind,
+            const int& n_wake_rows = -1
+        )
+        {
+            const uint n_surf = zeta.size();
+            UVLM::BiotSavart::Points<t_scalar> midpoints;
+            segment_midpoints(zeta, gamma, midpoints);
+
+            if (!options.horseshoe)
+            {
+                UVLM::BiotSavart::Segments<t_scalar> segments;
+                auto ring_index = [](const int&, const int&) {return 0;};
+                const int wake_rows = UVLM::BiotSavart::shed_rows(gamma_star, n_wake_rows);
+                auto wake_ring_index = [wake_rows](const int& i, const int&)
+                {
+                    return i < wake_rows ? 0:-1;
+                };
+                for (uint ii_surf=0; ii_surf<n_surf; ++ii_surf)
+                {
+                    UVLM::BiotSavart::lattice_segments(zeta[ii_surf],
+                                                       gamma[ii_surf],
+                                                       ring_index,
+                                                       segments);
+                    UVLM::BiotSavart::lattice_segments(zeta_star[ii_surf],
+                                                       gamma_star[ii_surf],
+                                                       wake_ring_index,
+                                                       segments);
+                }
+                UVLM::BiotSavart::sort_segments(segments);
+                UVLM::BiotSavart::induced_velocity(segments, midpoints, v_ind);
+                if (!options.Steady)
+                {
+                    UVLM::BiotSavart::wake_closure_velocity(zeta_star,
+                                                            gamma_star,
+                                                            midpoints,
+                                                            v_ind,
+                                                            n_wake_rows);
+                }
+                return;
+            }
+
+            // horseshoe wakes
+            v_ind.resize(midpoints.size());
+            UVLM::Types::GenericVector3<t_scalar> rp;
+            for (uint k=0; k<midpoints.size(); ++k)
+            {
+                rp << midpoints.x[k], midpoints.y[k], midpoints.z[k];
+                for (uint ii_surf=0; ii_surf<n_surf; ++ii_surf)
+                {
+                    UVLM::Types::GenericVecMatrixX<t_scalar> temp_uout;
+                    UVLM::Types::allocate_VecMat(temp_uout,
+                                                 zeta[ii_surf],
+                                                 -1);
+                    UVLM::BiotSavart::surface_with_steady_wake
+                    (
+                        zeta[ii_surf],
+                        zeta_star[ii_surf],
+                        gamma[ii_surf],
+                        gamma_star[ii_surf],
+                        rp,
+                        options.horseshoe,
+                        temp_uout,
+                        options.ImageMethod
+                    );
+                    v_ind.x[k] += temp_uout[0].sum();
+                    v_ind.y[k] += temp_uout[1].sum();
+                    v_ind.z[k] += temp_uout[2].sum();
+                }
+            }
+        }
+
         template <typename t_zeta,
                   typename t_zeta_star,
                   typename t_gamma,
@@ -27,23 +165,33 @@ namespace UVLM
             const UVLM::Types::FlightConditions& flightconditions
         )
         {
+            typedef typename t_forces::value_type::value_type::Scalar t_scalar;
+            typedef UVLM::Types::GenericVector3<t_scalar> t_vector;
             // Set forces to 0
             UVLM::Types::initialise_VecVecMat(forces);
 
             // first calculate all the velocities at the corner points
-            UVLM::Types::VecVecMatrixX velocities;
+            UVLM::Types::GenericVecVecMatrixX<t_scalar> velocities;
             UVLM::Types::allocate_VecVecMat(velocities, zeta);
             // free stream contribution
             UVLM::Types::copy_VecVecMat(uext, velocities);
 
-            // not bothered with effciency.
-            // if it is so critical, it could be improved
+            // induced velocities at all the segment midpoints
+            UVLM::BiotSavart::Points<t_scalar> induced;
+            midpoint_induced_velocity(zeta,
+                                      zeta_star,
+                                      gamma,
+                                      gamma_star,
+                                      options,
+                                      induced);
+            uint i_midpoint = 0;
+
             const uint n_surf = zeta.size();
-            UVLM::Types::Vector3 dl;
-            UVLM::Types::Vector3 v;
-            UVLM::Types::Vector3 f;
-            UVLM::Types::Vector3 v_ind;
-            UVLM::Types::Vector3 rp;
+            t_vector dl;
+            t_vector v;
+            t_vector f;
+            t_vector v_ind;
+            t_vector rp;
             uint start;
             uint end;
             for (uint i_surf=0; i_surf<n_surf; ++i_surf)
@@ -55,8 +203,8 @@ namespace UVLM
                 {
                     for (uint i_N=0; i_N<N; ++i_N)
                     {
-                        UVLM::Types::Vector3 r1;
-                        UVLM::Types::Vector3 r2;
+                        t_vector r1;
+                        t_vector r2;
                         const unsigned int n_segment = 4;
                         for (unsigned int i_segment=0; i_segment<n_segment; ++i_segment)
                         {
@@ -83,28 +231,10 @@ namespace UVLM
                             rp = 0.5*(r1 + r2);
 
                             // induced vel by vortices at vp
-                            v_ind.setZero();
-                            for (uint ii_surf=0; ii_surf<n_surf; ++ii_surf)
-                            {
-                                UVLM::Types::VecMatrixX temp_uout;
-                                UVLM::Types::allocate_VecMat(temp_uout,
-                                                             zeta[ii_surf],
-                                                             -1);
-                                UVLM::BiotSavart::surface_with_steady_wake
-                                (
-                                    zeta[ii_surf],
-                                    zeta_star[ii_surf],
-                                    gamma[ii_surf],
-                                    gamma_star[ii_surf],
-                                    rp,
-                                    options.horseshoe,
-                                    temp_uout,
-                                    options.ImageMethod
-                                );
-                                v_ind(0) += temp_uout[0].sum();
-                                v_ind(1) += temp_uout[1].sum();
-                                v_ind(2) += temp_uout[2].sum();
-                            }
+                            v_ind << induced.x[i_midpoint],
+                                     induced.y[i_midpoint],
+                                     induced.z[i_midpoint];
+                            ++i_midpoint;
 
                             dl = r2 - r1;
 
@@ -153,7 +283,9 @@ namespace UVLM
             const t_rbm_velocity& rbm_velocity,
             t_forces&  forces,
             const UVLM::Types::VMopts options,
-            const UVLM::Types::FlightConditions& flightconditions
+            const UVLM::Types::FlightConditions& flightconditions,
+            const UVLM::BiotSavart::Points<UVLM::Types::Real>& far_wake_velocity =
+                UVLM::BiotSavart::Points<UVLM::Types::Real>()
         )
         {
             // Set forces to 0
@@ -175,8 +307,29 @@ namespace UVLM
                 velocities
             );
 
-            // not bothered with effciency.
-            // if it is so critical, it could be improved
+            // induced velocities at all the segment midpoints.
+            // far_wake_velocity, if given, is the velocity induced by the
+            // wake rows after the first one (UVLM::Unsteady::far_wake_sweep)
+            UVLM::BiotSavart::Points<UVLM::Types::Real> induced;
+            const bool far_wake = far_wake_velocity.size() > 0;
+            midpoint_induced_velocity(zeta,
+                                      zeta_star,
+                                      gamma,
+                                      gamma_star,
+                                      options,
+                                      induced,
+                                      far_wake ? 1:-1);
+            if (far_wake)
+            {
+                for (uint k=0; k<induced.size(); ++k)
+                {
+                    induced.x[k] += far_wake_velocity.x[k];
+                    induced.y[k] += far_wake_velocity.y[k];
+                    induced.z[k] += far_wake_velocity.z[k];
+                }
+            }
+            uint i_midpoint = 0;
+
             const uint n_surf = zeta.size();
             UVLM::Types::Vector3 dl;
             UVLM::Types::Vector3 v;
@@ -223,28 +376,10 @@ namespace UVLM
                             rp = 0.5*(r1 + r2);
 
                             // induced vel by vortices at vp
-                            v_ind.setZero();
-                            for (uint ii_surf=0; ii_surf<n_surf; ++ii_surf)
-                            {
-                                UVLM::Types::VecMatrixX temp_uout;
-                                UVLM::Types::allocate_VecMat(temp_uout,
-                                                             zeta[ii_surf],
-                                                             -1);
-                                UVLM::BiotSavart::surface_with_steady_wake
-                                (
-                                    zeta[ii_surf],
-                                    zeta_star[ii_surf],
-                                    gamma[ii_surf],
-                                    gamma_star[ii_surf],
-                                    rp,
-                                    options.horseshoe,
-                                    temp_uout,
-                                    options.ImageMethod
-                                );
-                                v_ind(0) += temp_uout[0].sum();
-                                v_ind(1) += temp_uout[1].sum();
-                                v_ind(2) += temp_uout[2].sum();
-                            }
+                            v_ind << induced.x[i_midpoint],
+                                     induced.y[i_midpoint],
+                                     induced.z[i_midpoint];
+                            ++i_midpoint;
 
                             dl = r2-r1;
 
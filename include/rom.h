@@ -0,0 +1,184 @@
+#pragma once
+
+#include "EigenInclude.h"
+#include "types.h"
+#include "linear.h"
+
+#include <iostream>
+#include <vector>
+
+// Model order reduction of the linearised UVLM (see linear.h).
+// The discrete-time system
+//      x^{n+1} = A x^n + B u^{n+1}
+//      y^{n+1} = C x^{n+1} + D u^{n+1}
+// has the transfer function G(z) = C (I - A/z)^{-1} B + D.
+// The reduced model is a Galerkin projection onto an orthonormal basis V,
+//      A_r = V^T A V, B_r = V^T B, C_r = C V, D_r = D
+// where V spans the block Krylov subspaces
+//      span{(I - A/s)^{-1} B, ((I - A/s)^{-1} A/s) (I - A/s)^{-1} B, ...}
+// at every expansion point s, so that the first n_moments moments of G(z)
+// about z = s are retained. Complex points are expanded with the real and
+// imaginary parts of the Krylov vectors, so V stays real and the moments
+// about the conjugate point are matched as well.
+// s = 1 is the steady (zero frequency) point; s = exp(i*omega*dt) matches
+// the response around the frequency omega.
+namespace UVLM
+{
+    namespace ROM
+    {
+        // DECLARATIONS
+        void krylov
+        (
+            const UVLM::Linear::StateSpace& ss,
+            const std::vector<UVLM::Types::Complex>& expansion_points,
+            const std::vector<uint>& n_moments,
+            UVLM::Linear::StateSpace& rom,
+            UVLM::Types::MatrixX& V,
+            const uint& max_states = 0,
+            const UVLM::Types::Real& deflation_tolerance = 1e-10
+        );
+
+        bool orthonormalise
+        (
+            UVLM::Types::MatrixX& V,
+            uint& n_basis,
+            UVLM::Types::VectorX vector,
+            const UVLM::Types::Real& deflation_tolerance
+        );
+    }
+}
+
+
+// Adds vector to the first n_basis columns of V after two passes of
+// Gram-Schmidt. Returns false (and leaves V untouched) if the vector is
+// linearly dependent on the basis.
+inline bool UVLM::ROM::orthonormalise
+(
+    UVLM::Types::MatrixX& V,
+    uint& n_basis,
+    UVLM::Types::VectorX vector,
+    const UVLM::Types::Real& deflation_tolerance
+)
+{
+    const UVLM::Types::Real norm = vector.norm();
+    if (norm == 0.0 || n_basis == V.cols())
+    {
+        return false;
+    }
+    for (uint i_pass=0; i_pass<2; ++i_pass)
+    {
+        if (n_basis > 0)
+        {
+            const UVLM::Types::VectorX projection =
+                V.leftCols(n_basis).transpose()*vector;
+            vector -= V.leftCols(n_basis)*projection;
+        }
+    }
+    const UVLM::Types::Real new_norm = vector.norm();
+    if (new_norm <= deflation_tolerance*norm)
+    {
+        return false;
+    }
+    V.col(n_basis) = vector/new_norm;
+    ++n_basis;
+    return true;
+}
+
+
+// Block Arnoldi at every expansion point.
+// max_states = 0 does not limit the size of the reduced model.
+inline void UVLM::ROM::krylov
+(
+    const UVLM::Linear::StateSpace& ss,
+    const std::vector<UVLM::Types::Complex>& expansion_points,
+    const std::vector<uint>& n_moments,
+    UVLM::Linear::StateSpace& rom,
+    UVLM::Types::MatrixX& V,
+    const uint& max_states,
+    const UVLM::Types::Real& deflation_tolerance
+)
+{
+    const uint n_states = ss.A.rows();
+    const uint n_inputs = ss.B.cols();
+    const uint n_points = expansion_points.size();
+    if (n_moments.size() != n_points)
+    {
+        std::cerr << "UVLM::ROM::krylov: one number of moments per "
+                  << "expansion point is required" << std::endl;
+        return;
+    }
+
+    uint max_basis = 0;
+    for (uint i_point=0; i_point<n_points; ++i_point)
+    {
+        const uint n_parts = (expansion_points[i_point].imag() == 0.0) ? 1:2;
+        max_basis += n_parts*n_moments[i_point]*n_inputs;
+    }
+    max_basis = std::min(max_basis, n_states);
+    if (max_states > 0)
+    {
+        max_basis = std::min(max_basis, max_states);
+    }
+
+    V.setZero(n_states, max_basis);
+    uint n_basis = 0;
+    const UVLM::Types::MatrixXc A = ss.A.cast<UVLM::Types::Complex>();
+    for (uint i_point=0; i_point<n_points && n_basis<max_basis; ++i_point)
+    {
+        const UVLM::Types::Complex s = expansion_points[i_point];
+        if (std::abs(s) == 0.0)
+        {
+            std::cerr << "UVLM::ROM::krylov: expansion point z = 0 is not valid"
+                      << std::endl;
+            continue;
+        }
+        const bool is_real = (s.imag() == 0.0);
+        UVLM::Types::MatrixXc pencil = -A/s;
+        pencil.diagonal().array() += 1.0;
+        Eigen::PartialPivLU<UVLM::Types::MatrixXc> pencil_lu(pencil);
+
+        UVLM::Types::MatrixXc block = pencil_lu.solve(
+            UVLM::Types::MatrixXc(ss.B.cast<UVLM::Types::Complex>()));
+        for (uint i_moment=0; i_moment<n_moments[i_point]; ++i_moment)
+        {
+            // only the directions that survive the deflation generate
+            // the next block
+            std::vector<uint> kept;
+            for (uint i_col=0; i_col<block.cols() && n_basis<max_basis; ++i_col)
+            {
+                bool added = UVLM::ROM::orthonormalise(V,
+                                                       n_basis,
+                                                       block.col(i_col).real(),
+                                                       deflation_tolerance);
+                if (!is_real)
+                {
+                    added = UVLM::ROM::orthonormalise(V,
+                                                      n_basis,
+                                                      block.col(i_col).imag(),
+                                                      deflation_tolerance) || added;
+                }
+                if (added)
+                {
+                    kept.push_back(i_col);
+                }
+            }
+            if (kept.empty() || n_basis == max_basis ||
+                i_moment == n_moments[i_point] - 1)
+            {
+                break;
+            }
+            UVLM::Types::MatrixXc next(n_states, kept.size());
+            for (uint i_col=0; i_col<kept.size(); ++i_col)
+            {
+                next.col(i_col) = block.col(kept[i_col]);
+            }
+            block = pencil_lu.solve(UVLM::Types::MatrixXc(A*next/s));
+        }
+    }
+    V.conservativeResize(n_states, n_basis);
+
+    rom.A = V.transpose()*ss.A*V;
+    rom.B = V.transpose()*ss.B;
+    rom.C = ss.C*V;
+    rom.D = ss.D;
+}
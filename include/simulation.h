@@ -0,0 +1,39 @@
+#pragma once
+
+#include "EigenInclude.h"
+#include "types.h"
+#include "matrix.h"
+#include "wake.h"
+#include "unsteady_utils.h"
+#include "ensemble.h"
+
+// Data a simulation keeps between its calls to the solvers (time steps,
+// rollup iterations): caches keyed by hashes of the geometry they were
+// built for and the history of the wake convection. It belongs to the caller (UVLM::CppInterface::simulation),
+// so simulations stepped alternately or from different threads do not
+// share or evict each other's entries. One State must not be used by two
+// solvers at the same time.
+namespace UVLM
+{
+    namespace Simulation
+    {
+        struct State
+        {
+            // AIC blocks and factorisations (UVLM::Matrix::AIC_cached,
+            // UVLM::Matrix::update_rigid)
+            UVLM::Matrix::BlockCache blocks;
+            // far wake velocity on the wake vertices
+            // (UVLM::Unsteady::far_wake_sweep)
+            UVLM::Unsteady::Utils::FarWakeCache far_wake;
+            // full evaluations of the sub-cycled wake self-induction
+            // (UVLM::Unsteady::Utils::subcycled_wake_self_induction)
+            UVLM::Unsteady::Utils::SubcyclingState subcycling;
+            // wake convection history and counters
+            // (UVLM::Wake::Discretised::convect_wake)
+            UVLM::Wake::Discretised::IntegrationState integration;
+            // AIC factorisation and wake influence of the ensemble
+            // (UVLM::Ensemble::solver)
+            UVLM::Ensemble::Cache ensemble;
+        };
+    }
+}
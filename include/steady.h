@@ -7,11 +7,14 @@
 #include "geometry.h"
 #include "biotsavart.h"
 #include "matrix.h"
+#include "simulation.h"
 #include "wake.h"
 #include "postproc.h"
 #include "linear_solver.h"
 
 #include <iostream>
+#include <vector>
+#include <cmath>
 
 // DECLARATIONS
 namespace UVLM
@@ -35,7 +38,8 @@ namespace UVLM
             t_gamma_star& gamma_star,
             t_forces& forces,
             const UVLM::Types::VMopts& options,
-            const UVLM::Types::FlightConditions& flightconditions
+            const UVLM::Types::FlightConditions& flightconditions,
+            UVLM::Simulation::State& state
         );
 
         template <typename t_zeta,
@@ -74,7 +78,130 @@ namespace UVLM
             t_gamma_star& gamma_star,
             t_normals& normals,
             const UVLM::Types::VMopts& options,
-            const UVLM::Types::FlightConditions& flightconditions
+            const UVLM::Types::FlightConditions& flightconditions,
+            UVLM::Matrix::BlockCache& cache,
+            const bool& rhs_wake_velocity = true,
+            const int& rhs_wake_rows = -1
+        );
+
+        // Linear system of solve_discretised. assemble_discretised builds
+        // the RHS and the AIC (concurrent tasks in a task region),
+        // solve_assembled factorises and solves it; both reuse the blocks
+        // in the cache of the simulation. UVLM::Unsteady::solver
+        // calls the second one after its task region, so Eigen can use
+        // every thread for the factorisation.
+        struct System
+        {
+            UVLM::Types::VectorX rhs;
+            UVLM::Types::MatrixX aic;
+            std::vector<bool> changed;
+            bool rigid = false;
+        };
+
+        template <typename t_zeta,
+                  typename t_zeta_col,
+                  typename t_uext_col,
+                  typename t_zeta_star,
+                  typename t_gamma_star,
+                  typename t_normals>
+        void assemble_discretised
+        (
+            t_zeta& zeta,
+            t_zeta_col& zeta_col,
+            t_uext_col& uext_col,
+            t_zeta_star& zeta_star,
+            t_gamma_star& gamma_star,
+            t_normals& normals,
+            const UVLM::Types::VMopts& options,
+            UVLM::Steady::System& system,
+            UVLM::Matrix::BlockCache& cache,
+            const bool& rhs_wake_velocity = true,
+            const int& rhs_wake_rows = -1
+        );
+
+        template <typename t_zeta_col,
+                  typename t_zeta_star,
+                  typename t_gamma,
+                  typename t_gamma_star>
+        void solve_assembled
+        (
+            t_zeta_col& zeta_col,
+            t_zeta_star& zeta_star,
+            t_gamma& gamma,
+            t_gamma_star& gamma_star,
+            const UVLM::Types::VMopts& options,
+            UVLM::Steady::System& system,
+            UVLM::Matrix::BlockCache& cache
+        );
+
+        // Acceleration of the rollup iterations of the steady solver
+        // (the fixed point zeta_star = G(zeta_star) of a convection step
+        // and a solve):
+        //  0: none (plain fixed point iteration)
+        //  1: Anderson mixing of the wake vertex positions with the last
+        //     depth iterations; mixing is the relaxation of the residual
+        //     (1: no relaxation).
+        // With march, every iteration applies the convection increments
+        // row by row from the trailing edge (march_rows), so the wake
+        // does not need one iteration per row to settle.
+        // With acceleration, the iterations stop when the fixed point
+        // residual |G(zeta_star) - zeta_star| relative to the initial wake
+        // is below rollup_tolerance.
+        struct Rollup
+        {
+            uint acceleration = 0;
+            uint depth = 5;
+            double mixing = 1.0;
+            bool march = false;
+        };
+
+        inline Rollup& rollup()
+        {
+            static Rollup steady_rollup;
+            return steady_rollup;
+        }
+
+        // Diagnostics of the last rollup: iterations, evaluations of the
+        // wake velocity, AIC refreshes, residual of every iteration and
+        // whether rollup_tolerance was reached.
+        struct RollupDiagnostics
+        {
+            uint iterations = 0;
+            uint velocity_evaluations = 0;
+            uint aic_refreshes = 0;
+            std::vector<double> residuals;
+            bool converged = false;
+        };
+
+        inline RollupDiagnostics& rollup_diagnostics()
+        {
+            static RollupDiagnostics steady_rollup_diagnostics;
+            return steady_rollup_diagnostics;
+        }
+
+        // differences of the last iterates and images of the Anderson
+        // mixing, and the last ones
+        struct AndersonHistory
+        {
+            std::vector<UVLM::Types::VectorX> residual_differences;
+            std::vector<UVLM::Types::VectorX> image_differences;
+            UVLM::Types::VectorX residual;
+            UVLM::Types::VectorX image;
+        };
+
+        template <typename t_zeta_star>
+        void march_rows
+        (
+            const UVLM::Types::VecVecMatrixX& iterate,
+            t_zeta_star& zeta_star
+        );
+
+        template <typename t_zeta_star>
+        double anderson_mixing
+        (
+            const UVLM::Types::VecVecMatrixX& iterate,
+            t_zeta_star& zeta_star,
+            UVLM::Steady::AndersonHistory& history
         );
     }
 }
@@ -99,7 +226,8 @@ void UVLM::Steady::solver
     t_gamma_star& gamma_star,
     t_forces& forces,
     const UVLM::Types::VMopts& options,
-    const UVLM::Types::FlightConditions& flightconditions
+    const UVLM::Types::FlightConditions& flightconditions,
+    UVLM::Simulation::State& state
 )
 {
     // Generate collocation points info
@@ -163,6 +291,13 @@ void UVLM::Steady::solver
     double zeta_star_norm_previous = 0.0;
     double zeta_star_norm = 0.0;
 
+    UVLM::Steady::RollupDiagnostics& diagnostics = UVLM::Steady::rollup_diagnostics();
+    diagnostics = UVLM::Steady::RollupDiagnostics();
+    const uint64_t evaluations_first = state.integration.evaluations;
+    const bool anderson = UVLM::Steady::rollup().acceleration == 1;
+    UVLM::Steady::AndersonHistory anderson_history;
+    UVLM::Types::VecVecMatrixX zeta_star_iterate;
+
     UVLM::Types::VecVecMatrixX zeta_star_previous;
     if (options.n_rollup != 0)
     {
@@ -177,30 +312,45 @@ void UVLM::Steady::solver
     // ROLLUP LOOP--------------------------------------------------------
     for (uint i_rollup=0; i_rollup<options.n_rollup; ++i_rollup)
     {
+        if (anderson || UVLM::Steady::rollup().march)
+        {
+            UVLM::Types::allocate_VecVecMat(zeta_star_iterate, zeta_star);
+            UVLM::Types::copy_VecVecMat(zeta_star, zeta_star_iterate);
+        }
         // determine convection velocity u_ind
-        UVLM::Types::VecVecMatrixX u_ind;
-        UVLM::Types::allocate_VecVecMat(u_ind,
-                                        zeta_star);
-        // induced velocity by vortex rings
-        UVLM::BiotSavart::total_induced_velocity_on_wake(
-            zeta,
-            zeta_star,
-            gamma,
-            gamma_star,
-            u_ind);
-        // convection velocity of the background flow
-        for (uint i_surf=0; i_surf<zeta.size(); ++i_surf)
+        auto velocity = [&](const auto& positions,
+                            UVLM::Types::VecVecMatrixX& u_ind,
+                            const uint&)
         {
-            for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+            // induced velocity by vortex rings
+            // (the wake closure is left out with a steady AIC, see
+            // UVLM::BiotSavart::WakeClosure)
+            UVLM::BiotSavart::total_induced_velocity_on_wake(
+                zeta,
+                positions,
+                gamma,
+                gamma_star,
+                u_ind,
+                false,
+                VORTEX_RADIUS,
+                -1,
+                -1,
+                !options.Steady);
+            // convection velocity of the background flow
+            for (uint i_surf=0; i_surf<zeta.size(); ++i_surf)
             {
-                u_ind[i_surf][i_dim].array() += u_steady(i_dim);
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    u_ind[i_surf][i_dim].array() += u_steady(i_dim);
+                }
             }
-        }
+        };
 
         // convect based on u_ind for all the grid.
-        UVLM::Wake::Discretised::convect(zeta_star,
-                                         u_ind,
-                                         options.dt);
+        UVLM::Wake::Discretised::convect_wake(zeta_star,
+                                              velocity,
+                                              options.dt,
+                                              state.integration);
         // move wake 1 row down and discard last row (far field)
         UVLM::Wake::General::displace_VecVecMat(zeta_star);
         UVLM::Wake::General::displace_VecMat(gamma_star);
@@ -213,6 +363,19 @@ void UVLM::Steady::solver
                     zeta[i_surf][i_dim].template bottomRows<1>();
             }
         }
+        if (UVLM::Steady::rollup().march)
+        {
+            UVLM::Steady::march_rows(zeta_star_iterate, zeta_star);
+        }
+        double anderson_residual = 0.0;
+        if (anderson)
+        {
+            anderson_residual = UVLM::Steady::anderson_mixing(zeta_star_iterate,
+                                                              zeta_star,
+                                                              anderson_history);
+        }
+        UVLM::Wake::Discretised::end_convection_step(zeta_star,
+                                                     state.integration);
 
         // generate AIC again
         if (i_rollup%options.rollup_aic_refresh == 0)
@@ -227,11 +390,27 @@ void UVLM::Steady::solver
                 gamma_star,
                 normals,
                 options,
-                flightconditions
+                flightconditions,
+                state.blocks
             );
+            ++diagnostics.aic_refreshes;
         }
+        ++diagnostics.iterations;
+        diagnostics.velocity_evaluations =
+            state.integration.evaluations - evaluations_first;
 
         // convergence check -------------------
+        if (anderson)
+        {
+            const double eps = anderson_residual/zeta_star_norm_first;
+            diagnostics.residuals.push_back(eps);
+            if (eps < options.rollup_tolerance)
+            {
+                diagnostics.converged = true;
+                break;
+            }
+            continue;
+        }
         zeta_star_norm = UVLM::Types::norm_VecVec_mat(zeta_star);
         if (i_rollup != 0)
         {
@@ -239,9 +418,11 @@ void UVLM::Steady::solver
             //                       /zeta_star_norm_first);
             double eps = std::abs(UVLM::Types::norm_VecVec_mat(zeta_star - zeta_star_previous))/zeta_star_norm_first;
             // std::cout << i_rollup << ", " << eps << std::endl;
+            diagnostics.residuals.push_back(eps);
             if (eps < options.rollup_tolerance)
             {
                 // std::cout << "converged" << std::endl;
+                diagnostics.converged = true;
                 break;
             }
             zeta_star_norm_previous = zeta_star_norm;
@@ -372,7 +553,55 @@ void UVLM::Steady::solve_discretised
     t_gamma_star& gamma_star,
     t_normals& normals,
     const UVLM::Types::VMopts& options,
-    const UVLM::Types::FlightConditions& flightconditions
+    const UVLM::Types::FlightConditions& flightconditions,
+    UVLM::Matrix::BlockCache& cache,
+    const bool& rhs_wake_velocity,
+    const int& rhs_wake_rows
+)
+{
+    UVLM::Steady::System system;
+    UVLM::Steady::assemble_discretised(zeta,
+                                       zeta_col,
+                                       uext_col,
+                                       zeta_star,
+                                       gamma_star,
+                                       normals,
+                                       options,
+                                       system,
+                                       cache,
+                                       rhs_wake_velocity,
+                                       rhs_wake_rows);
+    UVLM::Steady::solve_assembled(zeta_col,
+                                  zeta_star,
+                                  gamma,
+                                  gamma_star,
+                                  options,
+                                  system,
+                                  cache);
+}
+
+/*-----------------------------------------------------------------------------
+
+-----------------------------------------------------------------------------*/
+template <typename t_zeta,
+          typename t_zeta_col,
+          typename t_uext_col,
+          typename t_zeta_star,
+          typename t_gamma_star,
+          typename t_normals>
+void UVLM::Steady::assemble_discretised
+(
+    t_zeta& zeta,
+    t_zeta_col& zeta_col,
+    t_uext_col& uext_col,
+    t_zeta_star& zeta_star,
+    t_gamma_star& gamma_star,
+    t_normals& normals,
+    const UVLM::Types::VMopts& options,
+    UVLM::Steady::System& system,
+    UVLM::Matrix::BlockCache& cache,
+    const bool& rhs_wake_velocity,
+    const int& rhs_wake_rows
 )
 {
     const uint n_surf = options.NumSurfaces;
@@ -387,11 +616,13 @@ void UVLM::Steady::solve_discretised
     }
     const uint Ktotal = ii;
 
-    UVLM::Types::VectorX rhs;
-    UVLM::Types::MatrixX aic = UVLM::Types::MatrixX::Zero(Ktotal, Ktotal);
-    // #pragma omp parallel sections
+    // RHS and AIC are independent tasks. They run concurrently when
+    // called from a task region (UVLM::Unsteady::solver), and one after
+    // the other otherwise.
+    system.rigid = false;
+    #pragma omp taskgroup
     {
-        // #pragma omp section
+        #pragma omp task default(shared)
         {
             // RHS generation
             UVLM::Matrix::RHS(zeta_col,
@@ -400,33 +631,94 @@ void UVLM::Steady::solve_discretised
                               gamma_star,
                               normals,
                               options,
-                              rhs,
-                              Ktotal);
+                              system.rhs,
+                              Ktotal,
+                              rhs_wake_velocity,
+                              rhs_wake_rows);
         }
-        // #pragma omp section
+        #pragma omp task default(shared)
         {
-            // AIC generation
-            UVLM::Matrix::AIC(Ktotal,
-                              zeta,
-                              zeta_col,
-                              zeta_star,
-                              uext_col,
-                              normals,
-                              options,
-                              false,
-                              aic);
+            if (options.iterative_solver)
+            {
+                // AIC generation
+                UVLM::Threads::first_touch(system.aic, Ktotal, Ktotal);
+                UVLM::Matrix::AIC(Ktotal,
+                                  zeta,
+                                  zeta_col,
+                                  zeta_star,
+                                  uext_col,
+                                  normals,
+                                  options,
+                                  false,
+                                  system.aic);
+            } else
+            {
+                // only the blocks of the surfaces that moved since the
+                // last call are recomputed.
+                // A rigidly moving lattice reuses the body AIC factorisation
+                system.rigid = UVLM::Matrix::update_rigid(zeta,
+                                                          zeta_col,
+                                                          zeta_star,
+                                                          normals,
+                                                          options,
+                                                          cache);
+                if (!system.rigid)
+                {
+                    UVLM::Matrix::AIC_cached(Ktotal,
+                                             zeta,
+                                             zeta_col,
+                                             zeta_star,
+                                             normals,
+                                             options,
+                                             false,
+                                             cache,
+                                             system.changed);
+                }
+            }
         }
     }
+}
+
+/*-----------------------------------------------------------------------------
+
+-----------------------------------------------------------------------------*/
+template <typename t_zeta_col,
+          typename t_zeta_star,
+          typename t_gamma,
+          typename t_gamma_star>
+void UVLM::Steady::solve_assembled
+(
+    t_zeta_col& zeta_col,
+    t_zeta_star& zeta_star,
+    t_gamma& gamma,
+    t_gamma_star& gamma_star,
+    const UVLM::Types::VMopts& options,
+    UVLM::Steady::System& system,
+    UVLM::Matrix::BlockCache& cache
+)
+{
     UVLM::Types::VectorX gamma_flat;
-    // std::cout << aic << std::endl;
-    // gamma_flat = aic.partialPivLu().solve(rhs);
-    UVLM::LinearSolver::solve_system
-    (
-        aic,
-        rhs,
-        options,
-        gamma_flat
-    );
+    if (options.iterative_solver)
+    {
+        UVLM::LinearSolver::solve_system
+        (
+            system.aic,
+            system.rhs,
+            options,
+            gamma_flat
+        );
+    } else if (system.rigid)
+    {
+        UVLM::Matrix::solve_rigid(cache,
+                                  system.rhs,
+                                  gamma_flat);
+    } else
+    {
+        UVLM::Matrix::solve_blockwise(cache,
+                                      system.changed,
+                                      system.rhs,
+                                      gamma_flat);
+    }
 
     // probably could be done better with a Map
     UVLM::Matrix::reconstruct_gamma(gamma_flat,
@@ -443,3 +735,135 @@ void UVLM::Steady::solve_discretised
                                                 in_n_rows);
 
 }
+
+
+// One Anderson mixing step of the rollup. iterate is the wake at the
+// beginning of the iteration (x) and zeta_star its image G(x) on input;
+// on output zeta_star is the next iterate
+//      x + mixing*f - (dX + mixing*dF) c
+// with f = G(x) - x and c the least squares solution of dF c = f over
+// the differences of the last depth residuals (dF) and iterates (dX).
+// Returns the norm of f (as UVLM::Types::norm_VecVec_mat).
+template <typename t_zeta_star>
+double UVLM::Steady::anderson_mixing
+(
+    const UVLM::Types::VecVecMatrixX& iterate,
+    t_zeta_star& zeta_star,
+    UVLM::Steady::AndersonHistory& history
+)
+{
+    const uint n_surf = zeta_star.size();
+    uint n = 0;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        n += UVLM::Constants::NDIM*zeta_star[i_surf][0].size();
+    }
+    UVLM::Types::VectorX image(n);
+    UVLM::Types::VectorX residual(n);
+    double residual_norm = 0.0;
+    uint offset = 0;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+        {
+            const uint M = zeta_star[i_surf][i_dim].rows();
+            const uint N = zeta_star[i_surf][i_dim].cols();
+            double squared = 0.0;
+            for (uint i=0; i<M; ++i)
+            {
+                for (uint j=0; j<N; ++j)
+                {
+                    image(offset) = zeta_star[i_surf][i_dim](i, j);
+                    residual(offset) = image(offset) - iterate[i_surf][i_dim](i, j);
+                    squared += residual(offset)*residual(offset);
+                    ++offset;
+                }
+            }
+            residual_norm += std::sqrt(squared);
+        }
+    }
+
+    const UVLM::Steady::Rollup& settings = UVLM::Steady::rollup();
+    if (history.residual.size() == n)
+    {
+        history.residual_differences.push_back(residual - history.residual);
+        history.image_differences.push_back(image - history.image);
+    } else
+    {
+        history.residual_differences.clear();
+        history.image_differences.clear();
+    }
+    while (history.residual_differences.size() > settings.depth)
+    {
+        history.residual_differences.erase(history.residual_differences.begin());
+        history.image_differences.erase(history.image_differences.begin());
+    }
+    history.residual = residual;
+    history.image = image;
+
+    // x + mixing*f = G(x) - (1 - mixing)*f
+    UVLM::Types::VectorX next = image - (1.0 - settings.mixing)*residual;
+    const uint m = history.residual_differences.size();
+    if (m > 0)
+    {
+        UVLM::Types::MatrixX residual_differences(n, m);
+        UVLM::Types::MatrixX image_differences(n, m);
+        for (uint k=0; k<m; ++k)
+        {
+            residual_differences.col(k) = history.residual_differences[k];
+            image_differences.col(k) = history.image_differences[k];
+        }
+        const UVLM::Types::VectorX c =
+            residual_differences.colPivHouseholderQr().solve(residual);
+        // dX + mixing*dF = dG - (1 - mixing)*dF
+        next -= (image_differences - (1.0 - settings.mixing)*residual_differences)*c;
+    }
+
+    offset = 0;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+        {
+            for (uint i=0; i<zeta_star[i_surf][i_dim].rows(); ++i)
+            {
+                for (uint j=0; j<zeta_star[i_surf][i_dim].cols(); ++j)
+                {
+                    zeta_star[i_surf][i_dim](i, j) = next(offset++);
+                }
+            }
+        }
+    }
+    return residual_norm;
+}
+
+
+// Marching version of a rollup iteration. On input zeta_star is the
+// image of iterate by a convection step and the displacement of the rows,
+// so row i moved from row i - 1 of iterate by the convection increment
+// of that vertex. The increments are applied from the trailing edge on,
+// every row from the new position of the previous one:
+//      x_i = x_{i - 1} + (zeta_star_i - iterate_{i - 1})
+// The fixed point is the same, but a change at the trailing edge reaches
+// all the wake in one iteration instead of one row per iteration.
+template <typename t_zeta_star>
+void UVLM::Steady::march_rows
+(
+    const UVLM::Types::VecVecMatrixX& iterate,
+    t_zeta_star& zeta_star
+)
+{
+    const uint n_surf = zeta_star.size();
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+        {
+            for (uint i=1; i<zeta_star[i_surf][i_dim].rows(); ++i)
+            {
+                zeta_star[i_surf][i_dim].row(i) =
+                    zeta_star[i_surf][i_dim].row(i - 1) +
+                    zeta_star[i_surf][i_dim].row(i) -
+                    iterate[i_surf][i_dim].row(i - 1);
+            }
+        }
+    }
+}
@@ -0,0 +1,386 @@
+#pragma once
+
+#include "EigenInclude.h"
+#include "types.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// Thread configuration shared by all the C interface calls.
+// The OpenMP runtime keeps its worker threads alive between parallel
+// regions, so the same pool serves every call (run_VLM, run_UVLM...)
+// without creating threads again. Every C interface call opens a
+// Configuration with NumCores, which sets the OpenMP and Eigen settings
+// for the call and gives the host process (e.g. the Python interpreter)
+// its own settings back when it returns.
+// Several simulations can share a node by giving every process its own
+// NumCores and, optionally, its own range of cores to pin the pool to
+// (set_affinity, exported as set_threads_affinity_UVLM).
+namespace UVLM
+{
+    namespace Threads
+    {
+        struct Settings
+        {
+            uint n_threads = 0;
+            bool pin = false;
+            uint first_core = 0;
+            bool pin_caller = false;
+            bool pinned = false;
+        };
+
+        inline Settings& settings()
+        {
+            static Settings thread_settings;
+            return thread_settings;
+        }
+
+        // Settings of one C interface call, restored on destruction.
+        // n_threads == 0 keeps the settings of the host.
+        // Nested parallel regions are disabled, so a parallel loop inside
+        // a task of the time step task graph does not oversubscribe the
+        // node.
+        class Configuration
+        {
+        private:
+            bool active = false;
+            int eigen_threads;
+#ifdef _OPENMP
+            int omp_dynamic;
+            int omp_max_active_levels;
+            int omp_max_threads;
+#endif
+        public:
+            explicit Configuration(const uint& n_threads);
+            ~Configuration();
+            Configuration(const Configuration&) = delete;
+            Configuration& operator=(const Configuration&) = delete;
+        };
+
+        // DECLARATIONS
+        inline void set_affinity
+        (
+            const bool& pin,
+            const uint& first_core,
+            const bool& pin_caller = false
+        );
+
+        inline void pin_threads();
+
+        template <typename t_mat>
+        void first_touch
+        (
+            t_mat& mat,
+            const uint& rows,
+            const uint& cols
+        );
+
+        // Unit of work of an influence computation: rows
+        // [row_begin, row_end) of the target points of surface target
+        // (collocation points or wake vertices) against the rings of
+        // surface source (-1: all the sources).
+        // cost is the number of targets times the number of rings.
+        struct Tile
+        {
+            uint target;
+            uint row_begin;
+            uint row_end;
+            int source;
+            double cost;
+        };
+
+        const uint tiles_per_thread = 4;
+
+        void make_tiles
+        (
+            const UVLM::Types::VecDimensions& targets,
+            const std::vector<double>& source_rings,
+            const bool& split_sources,
+            std::vector<UVLM::Threads::Tile>& tiles
+        );
+
+        template <typename t_function>
+        void run_tiles
+        (
+            const std::vector<UVLM::Threads::Tile>& tiles,
+            const t_function& function
+        );
+
+        template <typename t_function>
+        void parallel_for
+        (
+            const int& n,
+            const t_function& function,
+            const bool& dynamic = false
+        );
+    }
+}
+
+
+inline UVLM::Threads::Configuration::Configuration
+(
+    const uint& n_threads
+)
+{
+    if (n_threads == 0) {return;}
+    active = true;
+    eigen_threads = Eigen::nbThreads();
+#ifdef _OPENMP
+    omp_dynamic = omp_get_dynamic();
+    omp_max_active_levels = omp_get_max_active_levels();
+    omp_max_threads = omp_get_max_threads();
+    omp_set_dynamic(0);
+    omp_set_max_active_levels(1);
+    omp_set_num_threads(n_threads);
+#endif
+    Eigen::setNbThreads(n_threads);
+
+    UVLM::Threads::Settings& thread_settings = UVLM::Threads::settings();
+    if (n_threads != thread_settings.n_threads)
+    {
+        thread_settings.n_threads = n_threads;
+        thread_settings.pinned = false;
+    }
+    if (thread_settings.pin && !thread_settings.pinned)
+    {
+        UVLM::Threads::pin_threads();
+    }
+}
+
+
+inline UVLM::Threads::Configuration::~Configuration()
+{
+    if (!active) {return;}
+#ifdef _OPENMP
+    omp_set_dynamic(omp_dynamic);
+    omp_set_max_active_levels(omp_max_active_levels);
+    omp_set_num_threads(omp_max_threads);
+#endif
+    Eigen::setNbThreads(eigen_threads);
+}
+
+
+inline void UVLM::Threads::set_affinity
+(
+    const bool& pin,
+    const uint& first_core,
+    const bool& pin_caller
+)
+{
+    UVLM::Threads::Settings& thread_settings = UVLM::Threads::settings();
+    thread_settings.pin = pin;
+    thread_settings.first_core = first_core;
+    thread_settings.pin_caller = pin_caller;
+    thread_settings.pinned = false;
+}
+
+
+// Thread i of the pool is bound to core first_core + i. The calling
+// thread is thread 0 of the pool and belongs to the host, so it is only
+// bound (to first_core) if pin_caller; otherwise first_core stays free
+// for it. The binding of the workers outlives the call, as the runtime
+// reuses them for the parallel regions of the host too.
+// Only available on Linux; elsewhere the placement is left to the OpenMP
+// runtime (OMP_PROC_BIND, OMP_PLACES).
+inline void UVLM::Threads::pin_threads()
+{
+    UVLM::Threads::Settings& thread_settings = UVLM::Threads::settings();
+#if defined(__linux__) && defined(_OPENMP)
+    #pragma omp parallel
+    {
+        const int i_thread = omp_get_thread_num();
+        if (i_thread > 0 || thread_settings.pin_caller)
+        {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(thread_settings.first_core + i_thread, &cpu_set);
+            if (sched_setaffinity(0, sizeof(cpu_set_t), &cpu_set) != 0)
+            {
+                #pragma omp critical
+                std::cerr << "Thread " << i_thread
+                          << " could not be pinned to core "
+                          << thread_settings.first_core + i_thread
+                          << std::endl;
+            }
+        }
+    }
+#else
+    std::cerr << "Thread pinning is not supported on this platform"
+              << std::endl;
+#endif
+    thread_settings.pinned = true;
+}
+
+
+// Resizes mat and zeroes it in parallel, in contiguous row ranges with the
+// static schedule, so on NUMA nodes every page is first touched by (and
+// placed close to) the thread that will work on those rows.
+template <typename t_mat>
+void UVLM::Threads::first_touch
+(
+    t_mat& mat,
+    const uint& rows,
+    const uint& cols
+)
+{
+    mat.resize(rows, cols);
+    UVLM::Threads::parallel_for(rows, [&](const int& i)
+    {
+        mat.row(i).setZero();
+    });
+}
+
+
+// targets: rows and columns of the target points of every surface.
+// source_rings: number of rings of every source surface (including its
+// wake rings where they are part of the influence).
+// Every (target, source) pair, or every target with all the sources if
+// !split_sources, is split in row ranges of about
+// total cost/(tiles_per_thread*n_threads), so a long wing and a small
+// tail give tiles of similar cost. Tiles are sorted by decreasing cost,
+// so the expensive ones start first.
+inline void UVLM::Threads::make_tiles
+(
+    const UVLM::Types::VecDimensions& targets,
+    const std::vector<double>& source_rings,
+    const bool& split_sources,
+    std::vector<UVLM::Threads::Tile>& tiles
+)
+{
+    uint n_threads = 1;
+#ifdef _OPENMP
+    n_threads = omp_get_max_threads();
+#endif
+    const uint n_targets = targets.size();
+    const uint n_sources = split_sources ? source_rings.size():1;
+    double all_rings = 0.0;
+    for (uint i_source=0; i_source<source_rings.size(); ++i_source)
+    {
+        all_rings += source_rings[i_source];
+    }
+    double total_cost = 0.0;
+    for (uint i_target=0; i_target<n_targets; ++i_target)
+    {
+        total_cost += targets[i_target].first*targets[i_target].second*all_rings;
+    }
+    const double tile_cost = std::max(1.0, total_cost/(tiles_per_thread*n_threads));
+
+    tiles.clear();
+    for (uint i_target=0; i_target<n_targets; ++i_target)
+    {
+        const uint M = targets[i_target].first;
+        const uint N = targets[i_target].second;
+        if (M*N == 0) {continue;}
+        for (uint i_source=0; i_source<n_sources; ++i_source)
+        {
+            const double rings = split_sources ? source_rings[i_source]:all_rings;
+            const uint n_tiles = std::min<uint>(M, std::ceil(M*N*rings/tile_cost));
+            for (uint i_tile=0; i_tile<std::max<uint>(n_tiles, 1); ++i_tile)
+            {
+                UVLM::Threads::Tile tile;
+                tile.target = i_target;
+                tile.row_begin = (i_tile*M)/std::max<uint>(n_tiles, 1);
+                tile.row_end = ((i_tile + 1)*M)/std::max<uint>(n_tiles, 1);
+                tile.source = split_sources ? static_cast<int>(i_source):-1;
+                tile.cost = (tile.row_end - tile.row_begin)*N*rings;
+                tiles.push_back(tile);
+            }
+        }
+    }
+    std::stable_sort(tiles.begin(),
+                     tiles.end(),
+                     [](const UVLM::Threads::Tile& a, const UVLM::Threads::Tile& b)
+                     {return a.cost > b.cost;});
+}
+
+
+// Calls function(tile) for all the tiles, which must write to disjoint
+// outputs. Inside a parallel region (the time step task graph) every tile
+// is a task, so idle threads of the team pick them up; otherwise they are
+// handed out one by one with a dynamic schedule.
+template <typename t_function>
+void UVLM::Threads::run_tiles
+(
+    const std::vector<UVLM::Threads::Tile>& tiles,
+    const t_function& function
+)
+{
+    const int n_tiles = tiles.size();
+#ifdef _OPENMP
+    if (omp_in_parallel())
+    {
+        #pragma omp taskloop grainsize(1) default(shared)
+        for (int i_tile=0; i_tile<n_tiles; ++i_tile)
+        {
+            function(tiles[i_tile]);
+        }
+        return;
+    }
+#endif
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int i_tile=0; i_tile<n_tiles; ++i_tile)
+    {
+        function(tiles[i_tile]);
+    }
+}
+
+
+// Calls function(i) for i in [0, n), which must write to disjoint outputs.
+// As in run_tiles, inside a parallel region the iterations are a taskloop
+// (a nested parallel for would run on a single thread); otherwise they are
+// a parallel for with the static schedule or, if dynamic, handed out one
+// by one.
+template <typename t_function>
+void UVLM::Threads::parallel_for
+(
+    const int& n,
+    const t_function& function,
+    const bool& dynamic
+)
+{
+#ifdef _OPENMP
+    if (omp_in_parallel())
+    {
+        if (dynamic)
+        {
+            #pragma omp taskloop grainsize(1) default(shared)
+            for (int i=0; i<n; ++i)
+            {
+                function(i);
+            }
+        } else
+        {
+            #pragma omp taskloop default(shared)
+            for (int i=0; i<n; ++i)
+            {
+                function(i);
+            }
+        }
+        return;
+    }
+#endif
+    if (dynamic)
+    {
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int i=0; i<n; ++i)
+        {
+            function(i);
+        }
+    } else
+    {
+        #pragma omp parallel for schedule(static)
+        for (int i=0; i<n; ++i)
+        {
+            function(i);
+        }
+    }
+}
@@ -44,6 +44,16 @@ namespace UVLM
             }
         }
 
+        // skew-symmetric matrix of v, so that skew(v)*a = v x a
+        inline UVLM::Types::Matrix3 skew(const UVLM::Types::Vector3& v)
+        {
+            UVLM::Types::Matrix3 out;
+            out <<    0.0, -v(2),  v(1),
+                     v(2),   0.0, -v(0),
+                    -v(1),  v(0),   0.0;
+            return out;
+        }
+
         template <typename t_1,
                   typename t_2,
                   typename t_out>
@@ -0,0 +1,873 @@
+#pragma once
+
+#include "EigenInclude.h"
+#include "types.h"
+#include "constants.h"
+#include "mapping.h"
+#include "geometry.h"
+#include "biotsavart.h"
+#include "matrix.h"
+#include "wake.h"
+#include "postproc.h"
+#include "adjoint.h"
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+// Trim of the steady VLM.
+// The trim variables (angle of attack, sideslip and the rotation of a
+// control surface) are iterated with Newton's method until the chosen
+// objectives (UVLM::Adjoint::objectives) reach their targets.
+// The horseshoe wake is frozen along the freestream direction at the
+// start of the iterations, so the AIC of the undeflected geometry is
+// factorised only once:
+//  - alpha and beta rotate uext, which only changes the RHS;
+//  - a control surface rotation changes the rows and columns of the
+//    panels with a moved corner, and the deflected system is solved with
+//    the Woodbury identity on top of the cached factorisation.
+// After convergence the wake is realigned with the trimmed freestream and
+// the iterations restart, until the realignment does not move the
+// objectives out of tolerance. The final state is then the one run_VLM
+// gives for the trimmed inputs (without wake rollup).
+namespace UVLM
+{
+    namespace Trim
+    {
+        // trim variables (increments about the input state, in rad)
+        // positive alpha rotates the freestream towards +z of the
+        // body, positive beta towards +y.
+        const uint alpha = 0;
+        const uint beta = 1;
+        const uint control = 2;
+
+        // The vertices of panels (numbered as gamma in linear.h) rotate
+        // about the hinge line by the control angle.
+        struct ControlSurface
+        {
+            std::vector<uint> panels;
+            UVLM::Types::Vector3 hinge_point = UVLM::Types::Vector3::Zero();
+            UVLM::Types::Vector3 hinge_axis = UVLM::Types::Vector3::UnitY();
+        };
+
+        // objectives: indices of UVLM::Adjoint::objectives, one per
+        // variable
+        struct Settings
+        {
+            std::vector<uint> variables;
+            std::vector<uint> objectives;
+            UVLM::Types::VectorX targets;
+            UVLM::Types::Vector3 reference_point = UVLM::Types::Vector3::Zero();
+            ControlSurface control_surface;
+            uint max_iterations = 30;
+            UVLM::Types::Real tolerance = 1e-8;
+            UVLM::Types::Real step = 1e-6;
+        };
+
+        // Horseshoe system of the undeflected geometry and the low-rank
+        // correction of the last control angle:
+        //      AIC(angle) = aic + U V^T
+        // with U V^T only in the rows and columns of moved_panels.
+        struct System
+        {
+            UVLM::Types::Vector3 wake_direction;
+            UVLM::Types::MatrixX aic;
+            Eigen::PartialPivLU<UVLM::Types::MatrixX> aic_lu;
+            std::vector<uint> moved_panels;
+
+            bool correction_valid = false;
+            UVLM::Types::Real correction_angle = 0.0;
+            UVLM::Types::MatrixX delta_rows;
+            UVLM::Types::MatrixX aic_inv_u;
+            Eigen::PartialPivLU<UVLM::Types::MatrixX> capacitance_lu;
+        };
+
+        struct State
+        {
+            UVLM::Types::VecVecMatrixX zeta;
+            UVLM::Types::VecVecMatrixX uext;
+            UVLM::Types::VecVecMatrixX zeta_star;
+            UVLM::Types::VecMatrixX gamma;
+            UVLM::Types::VecMatrixX gamma_star;
+            UVLM::Types::VecVecMatrixX forces;
+            UVLM::Types::FlightConditions flightconditions;
+            UVLM::Types::VectorX objectives;
+        };
+
+        // DECLARATIONS
+        template <typename t_zeta,
+                  typename t_uext,
+                  typename t_zeta_star,
+                  typename t_gamma,
+                  typename t_gamma_star,
+                  typename t_forces>
+        bool trim
+        (
+            t_zeta& zeta,
+            t_uext& uext,
+            t_zeta_star& zeta_star,
+            t_gamma& gamma,
+            t_gamma_star& gamma_star,
+            t_forces& forces,
+            const UVLM::Trim::Settings& settings,
+            const UVLM::Types::VMopts& options,
+            const UVLM::Types::FlightConditions& flightconditions,
+            UVLM::Types::VectorX& trim_values
+        );
+
+        template <typename t_zeta,
+                  typename t_uext>
+        void evaluate
+        (
+            UVLM::Trim::System& system,
+            const t_zeta& zeta,
+            const t_uext& uext,
+            const UVLM::Types::VectorX& trim_values,
+            const UVLM::Trim::Settings& settings,
+            const UVLM::Types::VMopts& options,
+            const UVLM::Types::FlightConditions& flightconditions,
+            UVLM::Trim::State& state
+        );
+
+        template <typename t_zeta,
+                  typename t_zeta_star>
+        void assemble
+        (
+            const t_zeta& zeta,
+            const t_zeta_star& zeta_star,
+            const UVLM::Trim::Settings& settings,
+            const UVLM::Types::VMopts& options,
+            const UVLM::Types::Vector3& wake_direction,
+            UVLM::Trim::System& system
+        );
+
+        template <typename t_zeta,
+                  typename t_zeta_star,
+                  typename t_zeta_col,
+                  typename t_normals>
+        void solve
+        (
+            UVLM::Trim::System& system,
+            const t_zeta& zeta,
+            const t_zeta_star& zeta_star,
+            const t_zeta_col& zeta_col,
+            const t_normals& normals,
+            const UVLM::Types::Real& control_angle,
+            const UVLM::Types::VectorX& rhs,
+            UVLM::Types::VectorX& gamma_flat
+        );
+
+        template <typename t_zeta,
+                  typename t_zeta_star>
+        UVLM::Types::Real influence
+        (
+            const t_zeta& zeta,
+            const t_zeta_star& zeta_star,
+            const UVLM::Types::Vector3& collocation,
+            const UVLM::Types::Vector3& normal,
+            const uint& i_surf,
+            const uint& i,
+            const uint& j
+        );
+
+        template <typename t_zeta>
+        void deflect
+        (
+            const t_zeta& zeta,
+            const UVLM::Trim::ControlSurface& control_surface,
+            const UVLM::Types::Real& angle,
+            UVLM::Types::VecVecMatrixX& zeta_deflected
+        );
+
+        template <typename t_zeta>
+        void control_vertices
+        (
+            const t_zeta& zeta,
+            const UVLM::Trim::ControlSurface& control_surface,
+            UVLM::Types::VecMatrixX& mask
+        );
+
+        void freestream_rotation
+        (
+            const UVLM::Types::Real& alpha,
+            const UVLM::Types::Real& beta,
+            UVLM::Types::Matrix3& rotation
+        );
+
+        bool locate_panel
+        (
+            const UVLM::Types::VecDimensions& dimensions,
+            uint panel,
+            uint& i_surf,
+            uint& i,
+            uint& j
+        );
+    }
+}
+
+
+inline void UVLM::Trim::freestream_rotation
+(
+    const UVLM::Types::Real& alpha,
+    const UVLM::Types::Real& beta,
+    UVLM::Types::Matrix3& rotation
+)
+{
+    rotation = Eigen::AngleAxis<UVLM::Types::Real>(beta,
+                    UVLM::Types::Vector3::UnitZ()).toRotationMatrix()*
+               Eigen::AngleAxis<UVLM::Types::Real>(-alpha,
+                    UVLM::Types::Vector3::UnitY()).toRotationMatrix();
+}
+
+
+// panel is the index in the flattened gamma (all the surfaces).
+// Returns false if there is no such panel.
+inline bool UVLM::Trim::locate_panel
+(
+    const UVLM::Types::VecDimensions& dimensions,
+    uint panel,
+    uint& i_surf,
+    uint& i,
+    uint& j
+)
+{
+    for (i_surf=0; i_surf<dimensions.size(); ++i_surf)
+    {
+        const uint k_surf = dimensions[i_surf].first*dimensions[i_surf].second;
+        if (panel < k_surf)
+        {
+            i = panel/dimensions[i_surf].second;
+            j = panel%dimensions[i_surf].second;
+            return true;
+        }
+        panel -= k_surf;
+    }
+    return false;
+}
+
+
+// mask[i_surf](i, j) = 1 for the vertices of the control surface panels
+template <typename t_zeta>
+void UVLM::Trim::control_vertices
+(
+    const t_zeta& zeta,
+    const UVLM::Trim::ControlSurface& control_surface,
+    UVLM::Types::VecMatrixX& mask
+)
+{
+    UVLM::Types::VecDimensions dimensions;
+    UVLM::Types::generate_dimensions(zeta, dimensions, -1);
+    mask.clear();
+    UVLM::Types::allocate_VecMat(mask, dimensions, 1);
+    for (uint panel: control_surface.panels)
+    {
+        uint i_surf = 0;
+        uint i = 0;
+        uint j = 0;
+        if (!UVLM::Trim::locate_panel(dimensions, panel, i_surf, i, j))
+        {
+            std::cerr << "UVLM::Trim: control surface panel " << panel
+                      << " does not exist" << std::endl;
+            continue;
+        }
+        mask[i_surf].template block<2, 2>(i, j).setOnes();
+    }
+}
+
+
+template <typename t_zeta>
+void UVLM::Trim::deflect
+(
+    const t_zeta& zeta,
+    const UVLM::Trim::ControlSurface& control_surface,
+    const UVLM::Types::Real& angle,
+    UVLM::Types::VecVecMatrixX& zeta_deflected
+)
+{
+    if (zeta_deflected.empty())
+    {
+        UVLM::Types::allocate_VecVecMat(zeta_deflected, zeta);
+    }
+    UVLM::Types::copy_VecVecMat(zeta, zeta_deflected);
+    if (angle == 0.0 || control_surface.panels.empty())
+    {
+        return;
+    }
+
+    UVLM::Types::VecMatrixX mask;
+    UVLM::Trim::control_vertices(zeta, control_surface, mask);
+    const UVLM::Types::Matrix3 rotation =
+        Eigen::AngleAxis<UVLM::Types::Real>(angle,
+            control_surface.hinge_axis.normalized()).toRotationMatrix();
+    for (uint i_surf=0; i_surf<zeta.size(); ++i_surf)
+    {
+        for (uint i=0; i<mask[i_surf].rows(); ++i)
+        {
+            for (uint j=0; j<mask[i_surf].cols(); ++j)
+            {
+                if (mask[i_surf](i, j) == 0.0)
+                {
+                    continue;
+                }
+                UVLM::Types::Vector3 r;
+                r << zeta[i_surf][0](i, j),
+                     zeta[i_surf][1](i, j),
+                     zeta[i_surf][2](i, j);
+                r = control_surface.hinge_point +
+                    rotation*(r - control_surface.hinge_point);
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    zeta_deflected[i_surf][i_dim](i, j) = r(i_dim);
+                }
+            }
+        }
+    }
+}
+
+
+// Normal velocity at collocation induced by the unit vortex ring (i, j)
+// of i_surf, plus its horseshoe if it is on the trailing edge.
+// Same as an entry of UVLM::Matrix::AIC with horseshoe = true.
+template <typename t_zeta,
+          typename t_zeta_star>
+UVLM::Types::Real UVLM::Trim::influence
+(
+    const t_zeta& zeta,
+    const t_zeta_star& zeta_star,
+    const UVLM::Types::Vector3& collocation,
+    const UVLM::Types::Vector3& normal,
+    const uint& i_surf,
+    const uint& i,
+    const uint& j
+)
+{
+    UVLM::Types::Vector3 uind = UVLM::Types::Vector3::Zero();
+    UVLM::BiotSavart::vortex_ring(collocation,
+                                  zeta[i_surf][0].template block<2, 2>(i, j),
+                                  zeta[i_surf][1].template block<2, 2>(i, j),
+                                  zeta[i_surf][2].template block<2, 2>(i, j),
+                                  1.0,
+                                  uind);
+    if (i == zeta[i_surf][0].rows() - 2)
+    {
+        UVLM::BiotSavart::horseshoe(collocation,
+                                    zeta_star[i_surf][0].template block<2, 2>(0, j),
+                                    zeta_star[i_surf][1].template block<2, 2>(0, j),
+                                    zeta_star[i_surf][2].template block<2, 2>(0, j),
+                                    1.0,
+                                    uind);
+    }
+    return uind.dot(normal);
+}
+
+
+// Factorises the AIC of the undeflected geometry with the horseshoe
+// wake along wake_direction.
+template <typename t_zeta,
+          typename t_zeta_star>
+void UVLM::Trim::assemble
+(
+    const t_zeta& zeta,
+    const t_zeta_star& zeta_star,
+    const UVLM::Trim::Settings& settings,
+    const UVLM::Types::VMopts& options,
+    const UVLM::Types::Vector3& wake_direction,
+    UVLM::Trim::System& system
+)
+{
+    UVLM::Types::VMopts steady_options = options;
+    steady_options.Steady = true;
+    UVLM::Types::FlightConditions wake_conditions;
+    for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+    {
+        wake_conditions.uinf_direction[i_dim] = wake_direction(i_dim);
+    }
+
+    UVLM::Types::VecVecMatrixX zeta_col;
+    UVLM::Geometry::generate_colocationMesh(zeta, zeta_col);
+    UVLM::Types::VecVecMatrixX normals;
+    UVLM::Types::allocate_VecVecMat(normals, zeta_col);
+    UVLM::Geometry::generate_surfaceNormal(zeta, normals);
+    UVLM::Types::VecVecMatrixX horseshoe_star;
+    UVLM::Types::allocate_VecVecMat(horseshoe_star, zeta_star);
+    UVLM::Wake::Horseshoe::init<t_zeta, UVLM::Types::VecVecMatrixX&>(zeta,
+                                                                     horseshoe_star,
+                                                                     wake_conditions);
+
+    uint K = 0;
+    for (uint i_surf=0; i_surf<zeta_col.size(); ++i_surf)
+    {
+        K += zeta_col[i_surf][0].rows()*zeta_col[i_surf][0].cols();
+    }
+    system.wake_direction = wake_direction;
+    system.aic.setZero(K, K);
+    // uext_col is not used by the AIC
+    UVLM::Matrix::AIC(K,
+                      zeta,
+                      zeta_col,
+                      horseshoe_star,
+                      zeta_col,
+                      normals,
+                      steady_options,
+                      true,
+                      system.aic);
+    system.aic_lu.compute(system.aic);
+    system.correction_valid = false;
+
+    // panels with a corner on the control surface
+    system.moved_panels.clear();
+    if (settings.control_surface.panels.empty())
+    {
+        return;
+    }
+    UVLM::Types::VecMatrixX mask;
+    UVLM::Trim::control_vertices(zeta, settings.control_surface, mask);
+    uint panel = 0;
+    for (uint i_surf=0; i_surf<mask.size(); ++i_surf)
+    {
+        for (uint i=0; i<mask[i_surf].rows() - 1; ++i)
+        {
+            for (uint j=0; j<mask[i_surf].cols() - 1; ++j)
+            {
+                if (mask[i_surf].template block<2, 2>(i, j).sum() > 0.0)
+                {
+                    system.moved_panels.push_back(panel);
+                }
+                ++panel;
+            }
+        }
+    }
+}
+
+
+// gamma_flat = AIC(control_angle)^{-1} rhs
+// With S the moved panels and dA = AIC(angle) - aic,
+//      U = [E_S, dA(:, S) without the rows S], V^T = [dA(S, :); E_S^T]
+// and, with Z = aic^{-1} U and y = aic^{-1} rhs,
+//      gamma = y - Z (I + V^T Z)^{-1} V^T y
+// Z and the capacitance matrix are kept for the last angle.
+template <typename t_zeta,
+          typename t_zeta_star,
+          typename t_zeta_col,
+          typename t_normals>
+void UVLM::Trim::solve
+(
+    UVLM::Trim::System& system,
+    const t_zeta& zeta,
+    const t_zeta_star& zeta_star,
+    const t_zeta_col& zeta_col,
+    const t_normals& normals,
+    const UVLM::Types::Real& control_angle,
+    const UVLM::Types::VectorX& rhs,
+    UVLM::Types::VectorX& gamma_flat
+)
+{
+    const UVLM::Types::VectorX y = system.aic_lu.solve(rhs);
+    const uint k = system.moved_panels.size();
+    if (control_angle == 0.0 || k == 0)
+    {
+        gamma_flat = y;
+        return;
+    }
+
+    const uint K = rhs.size();
+    UVLM::Types::VecDimensions dimensions;
+    UVLM::Types::generate_dimensions(zeta_col, dimensions);
+    if (!system.correction_valid || system.correction_angle != control_angle)
+    {
+        // collocation points and normals of every panel
+        std::vector<UVLM::Types::Vector3> collocation(K);
+        std::vector<UVLM::Types::Vector3> normal(K);
+        uint panel = 0;
+        for (uint i_surf=0; i_surf<dimensions.size(); ++i_surf)
+        {
+            for (uint i=0; i<dimensions[i_surf].first; ++i)
+            {
+                for (uint j=0; j<dimensions[i_surf].second; ++j)
+                {
+                    for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                    {
+                        collocation[panel](i_dim) = zeta_col[i_surf][i_dim](i, j);
+                        normal[panel](i_dim) = normals[i_surf][i_dim](i, j);
+                    }
+                    ++panel;
+                }
+            }
+        }
+
+        std::vector<bool> moved(K, false);
+        for (uint panel: system.moved_panels)
+        {
+            moved[panel] = true;
+        }
+
+        UVLM::Types::MatrixX U = UVLM::Types::MatrixX::Zero(K, 2*k);
+        system.delta_rows.setZero(k, K);
+        for (uint i_moved=0; i_moved<k; ++i_moved)
+        {
+            const uint moved_panel = system.moved_panels[i_moved];
+            uint i_surf = 0;
+            uint i = 0;
+            uint j = 0;
+            if (!UVLM::Trim::locate_panel(dimensions, moved_panel, i_surf, i, j))
+            {
+                std::cerr << "UVLM::Trim: moved panel " << moved_panel
+                          << " does not exist, control surface ignored"
+                          << std::endl;
+                gamma_flat = y;
+                return;
+            }
+            U(moved_panel, i_moved) = 1.0;
+            // row: all the rings on the moved collocation point
+            uint source = 0;
+            for (uint ii_surf=0; ii_surf<dimensions.size(); ++ii_surf)
+            {
+                for (uint ii=0; ii<dimensions[ii_surf].first; ++ii)
+                {
+                    for (uint jj=0; jj<dimensions[ii_surf].second; ++jj)
+                    {
+                        system.delta_rows(i_moved, source) =
+                            UVLM::Trim::influence(zeta,
+                                                  zeta_star,
+                                                  collocation[moved_panel],
+                                                  normal[moved_panel],
+                                                  ii_surf,
+                                                  ii,
+                                                  jj)
+                            - system.aic(moved_panel, source);
+                        ++source;
+                    }
+                }
+            }
+            // column: the moved ring on the other collocation points
+            for (uint target=0; target<K; ++target)
+            {
+                if (moved[target])
+                {
+                    continue;
+                }
+                U(target, k + i_moved) =
+                    UVLM::Trim::influence(zeta,
+                                          zeta_star,
+                                          collocation[target],
+                                          normal[target],
+                                          i_surf,
+                                          i,
+                                          j)
+                    - system.aic(target, moved_panel);
+            }
+        }
+
+        system.aic_inv_u = system.aic_lu.solve(U);
+        UVLM::Types::MatrixX capacitance(2*k, 2*k);
+        capacitance.topRows(k) = system.delta_rows*system.aic_inv_u;
+        for (uint i_moved=0; i_moved<k; ++i_moved)
+        {
+            capacitance.row(k + i_moved) =
+                system.aic_inv_u.row(system.moved_panels[i_moved]);
+        }
+        capacitance.diagonal().array() += 1.0;
+        system.capacitance_lu.compute(capacitance);
+        system.correction_angle = control_angle;
+        system.correction_valid = true;
+    }
+
+    UVLM::Types::VectorX vt_y(2*k);
+    vt_y.head(k) = system.delta_rows*y;
+    for (uint i_moved=0; i_moved<k; ++i_moved)
+    {
+        vt_y(k + i_moved) = y(system.moved_panels[i_moved]);
+    }
+    gamma_flat = y - system.aic_inv_u*system.capacitance_lu.solve(vt_y);
+}
+
+
+// Steady solution and objectives for the trim values.
+// state has to be allocated.
+template <typename t_zeta,
+          typename t_uext>
+void UVLM::Trim::evaluate
+(
+    UVLM::Trim::System& system,
+    const t_zeta& zeta,
+    const t_uext& uext,
+    const UVLM::Types::VectorX& trim_values,
+    const UVLM::Trim::Settings& settings,
+    const UVLM::Types::VMopts& options,
+    const UVLM::Types::FlightConditions& flightconditions,
+    UVLM::Trim::State& state
+)
+{
+    UVLM::Types::Real alpha = 0.0;
+    UVLM::Types::Real beta = 0.0;
+    UVLM::Types::Real control_angle = 0.0;
+    for (uint i_var=0; i_var<settings.variables.size(); ++i_var)
+    {
+        switch (settings.variables[i_var])
+        {
+            case UVLM::Trim::alpha: alpha = trim_values(i_var); break;
+            case UVLM::Trim::beta: beta = trim_values(i_var); break;
+            case UVLM::Trim::control: control_angle = trim_values(i_var); break;
+        }
+    }
+
+    // freestream
+    UVLM::Types::Matrix3 rotation;
+    UVLM::Trim::freestream_rotation(alpha, beta, rotation);
+    state.flightconditions = flightconditions;
+    const UVLM::Types::Vector3 direction = rotation*
+        UVLM::Types::Vector3(flightconditions.uinf_direction[0],
+                             flightconditions.uinf_direction[1],
+                             flightconditions.uinf_direction[2]);
+    for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+    {
+        state.flightconditions.uinf_direction[i_dim] = direction(i_dim);
+    }
+    for (uint i_surf=0; i_surf<uext.size(); ++i_surf)
+    {
+        for (uint i=0; i<uext[i_surf][0].rows(); ++i)
+        {
+            for (uint j=0; j<uext[i_surf][0].cols(); ++j)
+            {
+                const UVLM::Types::Vector3 u = rotation*
+                    UVLM::Types::Vector3(uext[i_surf][0](i, j),
+                                         uext[i_surf][1](i, j),
+                                         uext[i_surf][2](i, j));
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    state.uext[i_surf][i_dim](i, j) = u(i_dim);
+                }
+            }
+        }
+    }
+
+    // geometry
+    UVLM::Trim::deflect(zeta, settings.control_surface, control_angle, state.zeta);
+    UVLM::Types::VecVecMatrixX zeta_col;
+    UVLM::Types::VecVecMatrixX uext_col;
+    UVLM::Geometry::generate_colocationMesh(state.zeta, zeta_col);
+    UVLM::Geometry::generate_colocationMesh(state.uext, uext_col);
+    UVLM::Types::VecVecMatrixX normals;
+    UVLM::Types::allocate_VecVecMat(normals, zeta_col);
+    UVLM::Geometry::generate_surfaceNormal(state.zeta, normals);
+    UVLM::Types::FlightConditions wake_conditions = flightconditions;
+    for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+    {
+        wake_conditions.uinf_direction[i_dim] = system.wake_direction(i_dim);
+    }
+    UVLM::Wake::Horseshoe::init<UVLM::Types::VecVecMatrixX,
+                                UVLM::Types::VecVecMatrixX&>(state.zeta,
+                                                             state.zeta_star,
+                                                             wake_conditions);
+
+    // solution
+    UVLM::Types::VMopts steady_options = options;
+    steady_options.Steady = true;
+    const uint K = system.aic.rows();
+    UVLM::Types::VectorX rhs;
+    UVLM::Matrix::RHS(zeta_col,
+                      state.zeta_star,
+                      uext_col,
+                      state.gamma_star,
+                      normals,
+                      steady_options,
+                      rhs,
+                      K);
+    UVLM::Types::VectorX gamma_flat;
+    UVLM::Trim::solve(system,
+                      state.zeta,
+                      state.zeta_star,
+                      zeta_col,
+                      normals,
+                      control_angle,
+                      rhs,
+                      gamma_flat);
+    UVLM::Matrix::reconstruct_gamma(gamma_flat,
+                                    state.gamma,
+                                    zeta_col,
+                                    state.zeta_star,
+                                    steady_options);
+    UVLM::Wake::Horseshoe::circulation_transfer(state.gamma,
+                                                state.gamma_star);
+
+    if (!options.horseshoe)
+    {
+        UVLM::Types::Vector3 u_steady;
+        u_steady << state.uext[0][0](0,0),
+                    state.uext[0][1](0,0),
+                    state.uext[0][2](0,0);
+        UVLM::Wake::Horseshoe::to_discretised(state.zeta_star,
+                                              state.gamma_star,
+                                              u_steady.norm()*options.dt);
+    }
+
+    UVLM::PostProc::calculate_static_forces(state.zeta,
+                                            state.zeta_star,
+                                            state.gamma,
+                                            state.gamma_star,
+                                            state.uext,
+                                            state.forces,
+                                            options,
+                                            state.flightconditions);
+    UVLM::Adjoint::objectives(state.zeta,
+                              state.forces,
+                              settings.reference_point,
+                              state.flightconditions,
+                              state.objectives);
+}
+
+
+// Newton iterations on the trim values (initial guess in trim_values),
+// with a finite difference Jacobian.
+// zeta, uext, zeta_star, gamma, gamma_star and forces are overwritten
+// with the trimmed state. Returns false if it does not converge.
+template <typename t_zeta,
+          typename t_uext,
+          typename t_zeta_star,
+          typename t_gamma,
+          typename t_gamma_star,
+          typename t_forces>
+bool UVLM::Trim::trim
+(
+    t_zeta& zeta,
+    t_uext& uext,
+    t_zeta_star& zeta_star,
+    t_gamma& gamma,
+    t_gamma_star& gamma_star,
+    t_forces& forces,
+    const UVLM::Trim::Settings& settings,
+    const UVLM::Types::VMopts& options,
+    const UVLM::Types::FlightConditions& flightconditions,
+    UVLM::Types::VectorX& trim_values
+)
+{
+    const uint n_variables = settings.variables.size();
+    if (settings.objectives.size() != n_variables ||
+        settings.targets.size() != n_variables ||
+        trim_values.size() != n_variables)
+    {
+        std::cerr << "UVLM::Trim::trim: one objective, target and initial "
+                  << "value per trim variable are required" << std::endl;
+        return false;
+    }
+    for (uint i_var=0; i_var<n_variables; ++i_var)
+    {
+        if (settings.variables[i_var] > UVLM::Trim::control ||
+            settings.objectives[i_var] >= UVLM::Adjoint::n_objectives)
+        {
+            std::cerr << "UVLM::Trim::trim: unknown trim variable or objective"
+                      << std::endl;
+            return false;
+        }
+    }
+    if (!options.horseshoe && options.n_rollup != 0)
+    {
+        std::cerr << "UVLM::Trim::trim: wake rollup is not supported, "
+                  << "the wake is kept straight" << std::endl;
+    }
+
+    // inputs are kept, the states are evaluated on copies
+    UVLM::Types::VecVecMatrixX zeta_ref;
+    UVLM::Types::VecVecMatrixX uext_ref;
+    UVLM::Types::allocate_VecVecMat(zeta_ref, zeta);
+    UVLM::Types::allocate_VecVecMat(uext_ref, uext);
+    UVLM::Types::copy_VecVecMat(zeta, zeta_ref);
+    UVLM::Types::copy_VecVecMat(uext, uext_ref);
+
+    UVLM::Trim::State state;
+    UVLM::Types::allocate_VecVecMat(state.uext, uext);
+    UVLM::Types::allocate_VecVecMat(state.zeta_star, zeta_star);
+    UVLM::Types::allocate_VecMat(state.gamma, gamma);
+    UVLM::Types::allocate_VecMat(state.gamma_star, gamma_star);
+    UVLM::Types::allocate_VecVecMat(state.forces, forces);
+    UVLM::Trim::State perturbed = state;
+
+    const UVLM::Types::Real tolerance =
+        settings.tolerance*std::max(1.0, settings.targets.cwiseAbs().maxCoeff());
+    const uint max_realignments = 10;
+    UVLM::Trim::System system;
+    UVLM::Types::VectorX residual(n_variables);
+    UVLM::Types::MatrixX jacobian(n_variables, n_variables);
+    bool converged = false;
+    bool newton_converged = false;
+    for (uint i_align=0; i_align<max_realignments && !converged; ++i_align)
+    {
+        // wake along the current freestream
+        UVLM::Types::Matrix3 rotation;
+        UVLM::Types::Real alpha = 0.0;
+        UVLM::Types::Real beta = 0.0;
+        for (uint i_var=0; i_var<n_variables; ++i_var)
+        {
+            if (settings.variables[i_var] == UVLM::Trim::alpha) {alpha = trim_values(i_var);}
+            if (settings.variables[i_var] == UVLM::Trim::beta) {beta = trim_values(i_var);}
+        }
+        UVLM::Trim::freestream_rotation(alpha, beta, rotation);
+        UVLM::Trim::assemble(zeta_ref,
+                             zeta_star,
+                             settings,
+                             options,
+                             rotation*UVLM::Types::Vector3(flightconditions.uinf_direction[0],
+                                                           flightconditions.uinf_direction[1],
+                                                           flightconditions.uinf_direction[2]),
+                             system);
+
+        newton_converged = false;
+        uint i_iter = 0;
+        for (; i_iter<settings.max_iterations; ++i_iter)
+        {
+            UVLM::Trim::evaluate(system, zeta_ref, uext_ref, trim_values,
+                                 settings, options, flightconditions, state);
+            for (uint i_var=0; i_var<n_variables; ++i_var)
+            {
+                residual(i_var) = state.objectives(settings.objectives[i_var])
+                                - settings.targets(i_var);
+            }
+            if (residual.cwiseAbs().maxCoeff() <= tolerance)
+            {
+                newton_converged = true;
+                break;
+            }
+
+            for (uint i_var=0; i_var<n_variables; ++i_var)
+            {
+                UVLM::Types::VectorX values = trim_values;
+                values(i_var) += settings.step;
+                UVLM::Trim::evaluate(system, zeta_ref, uext_ref, values,
+                                     settings, options, flightconditions, perturbed);
+                for (uint i_obj=0; i_obj<n_variables; ++i_obj)
+                {
+                    jacobian(i_obj, i_var) =
+                        (perturbed.objectives(settings.objectives[i_obj])
+                         - state.objectives(settings.objectives[i_obj]))/settings.step;
+                }
+            }
+            trim_values -= jacobian.partialPivLu().solve(residual);
+        }
+        if (!newton_converged)
+        {
+            break;
+        }
+        // converged without moving the freestream the wake is aligned with
+        converged = (i_iter == 0);
+    }
+    if (!newton_converged)
+    {
+        std::cerr << "UVLM::Trim::trim: not converged, residual = "
+                  << residual.transpose() << std::endl;
+    } else if (!converged)
+    {
+        std::cerr << "UVLM::Trim::trim: the wake direction has not settled after "
+                  << max_realignments << " realignments" << std::endl;
+    }
+
+    UVLM::Types::copy_VecVecMat(state.zeta, zeta);
+    UVLM::Types::copy_VecVecMat(state.uext, uext);
+    UVLM::Types::copy_VecVecMat(state.zeta_star, zeta_star);
+    UVLM::Types::copy_VecVecMat(state.forces, forces);
+    for (uint i_surf=0; i_surf<gamma.size(); ++i_surf)
+    {
+        gamma[i_surf] = state.gamma[i_surf];
+        gamma_star[i_surf] = state.gamma_star[i_surf];
+    }
+    return converged;
+}
@@ -4,6 +4,9 @@
 #include <vector>
 #include <utility>
 #include <iostream>
+#include <cstdint>
+#include <complex>
+#include <cmath>
 
 // convenience declarations
 typedef unsigned int uint;
@@ -34,12 +37,42 @@ namespace UVLM
         typedef Eigen::Matrix<Real, 3, 1> Vector3;
         typedef Eigen::Matrix<Real, 6, 1> Vector6;
         typedef Eigen::Matrix<Real, Eigen::Dynamic, 1> VectorX;
+        typedef Eigen::Matrix<Real, 3, 3> Matrix3;
         typedef Eigen::Map<VectorX> MapVectorX;
 
+        // Complex
+        typedef std::complex<Real> Complex;
+        typedef Eigen::Matrix<Complex, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> MatrixXc;
+        typedef Eigen::Matrix<Complex, Eigen::Dynamic, 1> VectorXc;
+
+        // Sparse
+        typedef Eigen::SparseMatrix<Real, Eigen::RowMajor> SparseMatrixX;
+
+        // Generic scalar (Real or Dual, see dual.h)
+        template <typename t_scalar>
+        using GenericMatrixX = Eigen::Matrix<t_scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+        template <typename t_scalar>
+        using GenericVecMatrixX = std::vector<GenericMatrixX<t_scalar>>;
+        template <typename t_scalar>
+        using GenericVecVecMatrixX = std::vector<GenericVecMatrixX<t_scalar>>;
+        template <typename t_scalar>
+        using GenericVector3 = Eigen::Matrix<t_scalar, 3, 1>;
+        template <typename t_scalar>
+        using GenericVectorX = Eigen::Matrix<t_scalar, Eigen::Dynamic, 1>;
+
         // std custom containers
         typedef std::pair<unsigned int, unsigned int> IntPair;
         typedef std::vector<IntPair> VecDimensions;
 
+        // value of a generic scalar (the Dual overload is in dual.h)
+        inline Real primal(const Real& a) {return a;}
+
+        // |a| <= tolerance (the Dual overload also needs zero tangents)
+        inline bool is_zero(const Real& a, const Real& tolerance = 0.0)
+        {
+            return std::abs(a) <= tolerance;
+        }
+
 
         struct VMopts
         {
@@ -153,10 +186,11 @@ namespace UVLM
             }
         }
 
-        template <typename t_dimensions_in>
+        template <typename t_mat,
+                  typename t_dimensions_in>
         inline void allocate_VecMat
         (
-            UVLM::Types::VecMatrixX& mat,
+            t_mat& mat,
             const t_dimensions_in& dimensions_in,
             const int& correction = 0,
             const double& initial_value = 0.0
@@ -175,9 +209,10 @@ namespace UVLM
             }
         }
 
+        template <typename t_mat>
         inline void initialise_VecMat
         (
-            UVLM::Types::VecMatrixX& mat,
+            t_mat& mat,
             const double& value = 0.0
         )
         {
@@ -255,10 +290,11 @@ namespace UVLM
             }
         }
 
-        template <typename t_dimensions>
+        template <typename t_mat,
+                  typename t_dimensions>
         inline void allocate_VecVecMat
         (
-            UVLM::Types::VecVecMatrixX& mat,
+            t_mat& mat,
             const t_dimensions& in_dimensions,
             const int& correction = 0
         )
@@ -316,6 +352,59 @@ namespace UVLM
             return norm;
         }
 
+        // FNV-1a hash of the contents of a VecMat (one surface).
+        // Only the first n_rows of every matrix are hashed if n_rows != -1.
+        // It can be chained with a previous hash through seed.
+        template <typename t_mat>
+        inline uint64_t hash_VecMat
+        (
+            const t_mat& mat,
+            const int& n_rows = -1,
+            uint64_t seed = 14695981039346656037ULL
+        )
+        {
+            uint64_t hash = seed;
+            uint n_dim = mat.size();
+            for (uint i_dim=0; i_dim<n_dim; ++i_dim)
+            {
+                const uint M = (n_rows == -1) ? mat[i_dim].rows():n_rows;
+                const uint N = mat[i_dim].cols();
+                for (uint i=0; i<M; ++i)
+                {
+                    for (uint j=0; j<N; ++j)
+                    {
+                        const double value = mat[i_dim](i, j);
+                        const unsigned char* bytes =
+                            reinterpret_cast<const unsigned char*>(&value);
+                        for (uint i_byte=0; i_byte<sizeof(double); ++i_byte)
+                        {
+                            hash ^= bytes[i_byte];
+                            hash *= 1099511628211ULL;
+                        }
+                    }
+                }
+            }
+            return hash;
+        }
+
+        // Same as hash_VecMat for all the surfaces.
+        template <typename t_mat>
+        inline uint64_t hash_VecVecMat
+        (
+            const t_mat& mat,
+            const int& n_rows = -1,
+            uint64_t seed = 14695981039346656037ULL
+        )
+        {
+            uint64_t hash = seed;
+            uint n_surf = mat.size();
+            for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+            {
+                hash = hash_VecMat(mat[i_surf], n_rows, hash);
+            }
+            return hash;
+        }
+
         template <typename t_mat>
         inline double max_VecVecMat
         (
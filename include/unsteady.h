@@ -10,6 +10,7 @@
 #include "matrix.h"
 #include "postproc.h"
 #include "steady.h"
+#include "simulation.h"
 #include "wake.h"
 
 #include <iostream>
@@ -46,7 +47,8 @@ namespace UVLM
             t_forces& forces,
             t_forces& dynamic_forces,
             const UVLM::Types::UVMopts& options,
-            const UVLM::Types::FlightConditions& flightconditions
+            const UVLM::Types::FlightConditions& flightconditions,
+            UVLM::Simulation::State& state
         );
 
         template <typename t_zeta,
@@ -70,7 +72,28 @@ namespace UVLM
             t_rbm_velocity& rbm_velocity,
             t_forces& forces,
             const UVLM::Types::VMopts& options,
-            const UVLM::Types::FlightConditions& flightconditions
+            const UVLM::Types::FlightConditions& flightconditions,
+            UVLM::Simulation::State& state
+        );
+
+        template <typename t_zeta,
+                  typename t_zeta_col,
+                  typename t_zeta_star,
+                  typename t_gamma,
+                  typename t_gamma_star,
+                  typename t_uext_col>
+        void far_wake_sweep
+        (
+            const t_zeta& zeta,
+            const t_zeta_col& zeta_col,
+            const t_zeta_star& zeta_star,
+            const t_gamma& gamma,
+            const t_gamma_star& gamma_star,
+            t_uext_col& uext_col,
+            UVLM::BiotSavart::Points<UVLM::Types::Real>& midpoint_velocity,
+            const bool& wake_vertices,
+            const int& active_rows,
+            UVLM::Unsteady::Utils::FarWakeCache& far_wake
         );
     }
 }
@@ -103,7 +126,8 @@ void UVLM::Unsteady::initialise
     t_rbm_velocity& rbm_velocity,
     t_forces& forces,
     const UVLM::Types::VMopts& options,
-    const UVLM::Types::FlightConditions& flightconditions
+    const UVLM::Types::FlightConditions& flightconditions,
+    UVLM::Simulation::State& state
 )
 {
     // incident velocity taking into account RBM, zeta_dot:
@@ -130,12 +154,132 @@ void UVLM::Unsteady::initialise
         gamma_star,
         forces,
         options,
-        flightconditions
+        flightconditions,
+        state
     );
     return;
 }
 
 
+// One pass of the wake rows after the first one (the bulk of the wake,
+// which does not change in the solve) over all the targets of the time
+// step at once:
+//  - collocation points: added to uext_col, so the RHS does not need to
+//    evaluate the wake again (Matrix::RHS with wake_velocity = false)
+//  - bound segment midpoints: midpoint_velocity, for
+//    PostProc::calculate_static_forces_unsteady, which only adds the
+//    surfaces and the first wake row once gamma is known
+//  - wake vertices of the free wake (if wake_vertices): kept in
+//    far_wake for the convection of the next time step
+//    (convection_scheme == 3)
+// so the wake is streamed once per time step instead of three times.
+template <typename t_zeta,
+          typename t_zeta_col,
+          typename t_zeta_star,
+          typename t_gamma,
+          typename t_gamma_star,
+          typename t_uext_col>
+void UVLM::Unsteady::far_wake_sweep
+(
+    const t_zeta& zeta,
+    const t_zeta_col& zeta_col,
+    const t_zeta_star& zeta_star,
+    const t_gamma& gamma,
+    const t_gamma_star& gamma_star,
+    t_uext_col& uext_col,
+    UVLM::BiotSavart::Points<UVLM::Types::Real>& midpoint_velocity,
+    const bool& wake_vertices,
+    const int& active_rows,
+    UVLM::Unsteady::Utils::FarWakeCache& far_wake
+)
+{
+    const uint n_surf = zeta.size();
+    UVLM::BiotSavart::Segments<UVLM::Types::Real> segments;
+    UVLM::BiotSavart::Points<UVLM::Types::Real> targets;
+    const int wake_rows = UVLM::BiotSavart::shed_rows(gamma_star, active_rows);
+    const int target_rows = UVLM::Unsteady::Utils::convected_wake_limit(gamma_star, active_rows);
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        UVLM::BiotSavart::lattice_segments(zeta_star[i_surf],
+                                           gamma_star[i_surf],
+                                           [wake_rows](const int& i, const int&)
+                                           {
+                                               return i < wake_rows ? 0:-1;
+                                           },
+                                           segments,
+                                           1);
+        UVLM::BiotSavart::Points<UVLM::Types::Real> surface_targets;
+        UVLM::BiotSavart::surface_points(zeta_col[i_surf], surface_targets);
+        targets.append(surface_targets);
+    }
+    UVLM::BiotSavart::sort_segments(segments);
+    const uint n_collocation = targets.size();
+
+    UVLM::BiotSavart::Points<UVLM::Types::Real> midpoints;
+    UVLM::PostProc::segment_midpoints(zeta, gamma, midpoints);
+    targets.append(midpoints);
+    if (wake_vertices)
+    {
+        for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+        {
+            UVLM::BiotSavart::Points<UVLM::Types::Real> surface_targets;
+            UVLM::BiotSavart::surface_points(
+                zeta_star[i_surf],
+                surface_targets,
+                0,
+                UVLM::Unsteady::Utils::limited_rows(zeta_star[i_surf][0].rows(), target_rows));
+            targets.append(surface_targets);
+        }
+    }
+
+    UVLM::BiotSavart::Points<UVLM::Types::Real> velocity;
+    UVLM::BiotSavart::induced_velocity(segments, targets, velocity);
+    UVLM::BiotSavart::wake_closure_velocity(
+        zeta_star,
+        gamma_star,
+        targets,
+        velocity,
+        active_rows);
+
+    uint counter = 0;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        for (uint i=0; i<uext_col[i_surf][0].rows(); ++i)
+        {
+            for (uint j=0; j<uext_col[i_surf][0].cols(); ++j)
+            {
+                uext_col[i_surf][0](i, j) += velocity.x[counter];
+                uext_col[i_surf][1](i, j) += velocity.y[counter];
+                uext_col[i_surf][2](i, j) += velocity.z[counter];
+                ++counter;
+            }
+        }
+    }
+
+    auto slice = [&velocity](const uint& begin,
+                             const uint& end,
+                             UVLM::BiotSavart::Points<UVLM::Types::Real>& out)
+    {
+        out.x.assign(velocity.x.begin() + begin, velocity.x.begin() + end);
+        out.y.assign(velocity.y.begin() + begin, velocity.y.begin() + end);
+        out.z.assign(velocity.z.begin() + begin, velocity.z.begin() + end);
+    };
+    const uint n_midpoints = midpoints.size();
+    slice(n_collocation, n_collocation + n_midpoints, midpoint_velocity);
+
+    far_wake.valid = wake_vertices;
+    if (wake_vertices)
+    {
+        far_wake.target_rows = target_rows;
+        slice(n_collocation + n_midpoints, velocity.size(), far_wake.velocity);
+        UVLM::Unsteady::Utils::far_wake_keys(zeta_star,
+                                             gamma_star,
+                                             far_wake.zeta_star_key,
+                                             far_wake.gamma_star_key);
+    }
+}
+
+
 template <typename t_zeta,
           typename t_zeta_dot,
           typename t_uext,
@@ -163,7 +307,8 @@ void UVLM::Unsteady::solver
     t_forces& forces,
     t_forces& dynamic_forces,
     const UVLM::Types::UVMopts& options,
-    const UVLM::Types::FlightConditions& flightconditions
+    const UVLM::Types::FlightConditions& flightconditions,
+    UVLM::Simulation::State& state
 )
 {
     // SOLVE------------------------------------------
@@ -178,64 +323,134 @@ void UVLM::Unsteady::solver
     UVLM::Types::VecVecMatrixX uext_total_col;
     UVLM::Types::allocate_VecVecMat(uext_total_col, uext, -1);
 
-    // total stream velocity
-    UVLM::Unsteady::Utils::compute_resultant_grid_velocity
-    (
-        zeta,
-        zeta_dot,
-        uext,
-        rbm_velocity,
-        uext_total
-    );
-
     UVLM::Types::VMopts steady_options = UVLM::Types::UVMopts2VMopts(options);
 
-    //  Allocation and mapping
-    UVLM::Geometry::generate_colocationMesh(zeta, zeta_col);
-    UVLM::Geometry::generate_colocationMesh(uext_total, uext_total_col);
+    // velocity induced by the far wake (rows after the first one) at the
+    // force midpoints, from far_wake_sweep
+    UVLM::BiotSavart::Points<UVLM::Types::Real> far_wake_midpoints;
+    const bool far_wake_vertices = options.convect_wake &&
+                                   options.convection_scheme == 3;
 
-    // panel normals
-    // UVLM::Types::VecVecMatrixX normals;
-    // UVLM::Types::allocate_VecVecMat(normals, zeta_col);
-    UVLM::Geometry::generate_surfaceNormal(zeta, normals);
-
-    // std::cout << options.convect_wake << std::endl;
-    if (options.convect_wake)
+    // The assembly of the time step is a task graph:
+    //      {collocation points, normals, total velocity, wake convection}
+    //      -> far wake sweep -> RHS || AIC (Steady::assemble_discretised)
+    // The factorisation and the forces follow the task region, so Eigen
+    // and the loops of the forces use the whole team.
+    UVLM::Steady::System system;
+    #pragma omp parallel default(shared)
+    #pragma omp single
     {
-        // std::cout << "Convecting wake" << std::endl;
-        UVLM::Unsteady::Utils::convect_unsteady_wake
-        (
-            options,
-            zeta,
-            zeta_star,
-            gamma,
-            gamma_star,
-            uext,
-            uext_star,
-            rbm_velocity
-        );
-    }
+        #pragma omp task default(shared) depend(out: zeta_col)
+        {
+            UVLM::Geometry::generate_colocationMesh(zeta, zeta_col);
+        }
+
+        #pragma omp task default(shared) depend(out: uext_total_col)
+        {
+            // total stream velocity
+            UVLM::Unsteady::Utils::compute_resultant_grid_velocity
+            (
+                zeta,
+                zeta_dot,
+                uext,
+                rbm_velocity,
+                uext_total
+            );
+            UVLM::Geometry::generate_colocationMesh(uext_total, uext_total_col);
+        }
 
-    // we can use UVLM::Steady::solve_discretised if uext_col
-    // is the total velocity including non-steady contributions.
-    UVLM::Steady::solve_discretised
+        // panel normals
+        #pragma omp task default(shared) depend(out: normals)
+        {
+            UVLM::Geometry::generate_surfaceNormal(zeta, normals);
+        }
+
+        #pragma omp task default(shared) \
+                         depend(in: zeta_col) \
+                         depend(inout: zeta_star, gamma_star)
+        {
+            if (options.convect_wake)
+            {
+                // the free wake length follows the truncation of the wake
+                // passed in
+                UVLM::Unsteady::Utils::convect_unsteady_wake
+                (
+                    options,
+                    zeta,
+                    zeta_star,
+                    gamma,
+                    gamma_star,
+                    uext,
+                    uext_star,
+                    rbm_velocity,
+                    UVLM::Unsteady::Utils::truncated_rows(zeta_col,
+                                                          zeta_star,
+                                                          gamma_star,
+                                                          flightconditions),
+                    state.far_wake,
+                    state.subcycling,
+                    state.integration
+                );
+            }
+        }
+
+        // the far wake (its active rows) on the collocation points, force
+        // midpoints and wake vertices in one pass
+        #pragma omp task default(shared) \
+                         depend(in: zeta_col, zeta_star, gamma_star) \
+                         depend(inout: uext_total_col) \
+                         depend(out: far_wake_midpoints)
+        {
+            UVLM::Unsteady::far_wake_sweep(zeta,
+                                           zeta_col,
+                                           zeta_star,
+                                           gamma,
+                                           gamma_star,
+                                           uext_total_col,
+                                           far_wake_midpoints,
+                                           far_wake_vertices,
+                                           UVLM::Unsteady::Utils::truncated_rows(zeta_col,
+                                                                                 zeta_star,
+                                                                                 gamma_star,
+                                                                                 flightconditions),
+                                           state.far_wake);
+        }
+
+        // we can use UVLM::Steady::solve_discretised if uext_col
+        // is the total velocity including non-steady contributions
+        // (here also the far wake, so the RHS does not add it again).
+        #pragma omp task default(shared) \
+                         depend(in: zeta_col, uext_total_col, normals, zeta_star, gamma_star)
+        {
+            UVLM::Steady::assemble_discretised
+            (
+                zeta,
+                zeta_col,
+                uext_total_col,
+                zeta_star,
+                gamma_star,
+                normals,
+                steady_options,
+                system,
+                state.blocks,
+                false
+            );
+        }
+    }
+    UVLM::Steady::solve_assembled
     (
-        zeta,
         zeta_col,
-        uext_total_col,
         zeta_star,
         gamma,
         gamma_star,
-        normals,
         steady_options,
-        flightconditions
+        system,
+        state.blocks
     );
 
-
     // forces calculation
     // set forces to 0 just in case
     UVLM::Types::initialise_VecVecMat(forces);
-    // UVLM::Types::
     // static:
     UVLM::PostProc::calculate_static_forces_unsteady
     (
@@ -248,12 +463,13 @@ void UVLM::Unsteady::solver
         rbm_velocity,
         forces,
         steady_options,
-        flightconditions
+        flightconditions,
+        far_wake_midpoints
     );
+    UVLM::Types::initialise_VecVecMat(dynamic_forces);
     // dynamic::
     // if (i_iter > 0)
     // {
-        UVLM::Types::initialise_VecVecMat(dynamic_forces);
         // std::cout << "Max dynamic forces:" << std::endl;
         // std::cout << dynamic_forces[0][2].maxCoeff() << std::endl;
         // calculate dynamic forces
@@ -2,6 +2,9 @@
 
 #include "EigenInclude.h"
 #include "types.h"
+#include "biotsavart.h"
+
+#include <limits>
 
 
 namespace UVLM
@@ -23,6 +26,35 @@ namespace UVLM
                 t_rbm_velocity& rbm_velocity,
                 t_uext_out& uext_out
             );
+
+            // Velocity induced on the wake vertices by the wake rows after
+            // the first one, computed by UVLM::Unsteady::far_wake_sweep
+            // together with the RHS and force targets and reused by the
+            // next convection (convection_scheme == 3) if the wake did not
+            // change in between (keys: far_wake_keys). Kept by the
+            // simulation (UVLM::Simulation::State).
+            struct FarWakeCache
+            {
+                bool valid = false;
+                uint64_t zeta_star_key = 0;
+                uint64_t gamma_star_key = 0;
+                int target_rows = -1;
+                UVLM::BiotSavart::Points<UVLM::Types::Real> velocity;
+            };
+
+            // Full evaluations of the sub-cycled wake self-induction
+            // (latest first, see Subcycling below) and the step of each
+            // one. zeta_star_key is the wake after the last convection, so
+            // any other wake (a new simulation) restarts the history. Kept
+            // by the simulation (UVLM::Simulation::State).
+            struct SubcyclingState
+            {
+                uint step = 0;
+                uint64_t zeta_star_key = 0;
+                std::vector<uint> sample_steps;
+                std::vector<UVLM::Types::VecVecMatrixX> samples;
+            };
+
             template <typename t_zeta,
                       typename t_zeta_star,
                       typename t_gamma,
@@ -39,12 +71,325 @@ namespace UVLM
                 t_gamma_star& gamma_star,
                 const t_uext& uext,
                 const t_uext_star& uext_star,
-                const t_rbm_velocity& rbm_velocity
+                const t_rbm_velocity& rbm_velocity,
+                const int& active_rows,
+                FarWakeCache& far_wake,
+                SubcyclingState& subcycling_state,
+                UVLM::Wake::Discretised::IntegrationState& integration
+            );
+
+            template <typename t_zeta_star,
+                      typename t_gamma_star>
+            void far_wake_keys
+            (
+                const t_zeta_star& zeta_star,
+                const t_gamma_star& gamma_star,
+                uint64_t& zeta_star_key,
+                uint64_t& gamma_star_key
+            );
+
+            // Free wake length with convection_scheme == 3: only the first
+            // n_rows rows of vertices of every wake (-1: all) are convected
+            // with the induced velocity. The older rows are frozen to the
+            // free stream (as in convection_scheme == 2), but still induce
+            // velocity on the rest.
+            struct FreeWake
+            {
+                int n_rows = -1;
+            };
+
+            inline FreeWake& free_wake()
+            {
+                static FreeWake free_wake_length;
+                return free_wake_length;
+            }
+
+            // Adaptive truncation of the wake. Every time step
+            // (Unsteady::solver), the oldest rows of wake rings whose
+            // influence on the collocation points is bounded below
+            // tolerance*uinf are left out as sources (RHS, far wake sweep
+            // and convection) and their vertices are no longer convected
+            // with the induced velocity. The rows kept are found from the
+            // wake of every step (truncated_rows), so nothing is carried
+            // between steps. tolerance 0: no truncation.
+            struct WakeTruncation
+            {
+                double tolerance = 0.0;
+            };
+
+            inline WakeTruncation& wake_truncation()
+            {
+                static WakeTruncation wake_truncation_settings;
+                return wake_truncation_settings;
+            }
+
+            template <typename t_zeta_col,
+                      typename t_zeta_star,
+                      typename t_gamma_star>
+            int active_wake_rows
+            (
+                const t_zeta_col& zeta_col,
+                const t_zeta_star& zeta_star,
+                const t_gamma_star& gamma_star,
+                const UVLM::Types::Real& tolerance
+            );
+
+            template <typename t_zeta_col,
+                      typename t_zeta_star,
+                      typename t_gamma_star>
+            int truncated_rows
+            (
+                const t_zeta_col& zeta_col,
+                const t_zeta_star& zeta_star,
+                const t_gamma_star& gamma_star,
+                const UVLM::Types::FlightConditions& flightconditions
+            );
+
+            // rows of vertices (-1: all) convected with the induced velocity:
+            // the free wake of the active_rows rows of rings kept
+            inline int free_wake_limit
+            (
+                const int& active_rows
+            )
+            {
+                int n_rows = UVLM::Unsteady::Utils::free_wake().n_rows;
+                if (active_rows != -1 && (n_rows == -1 || active_rows + 1 < n_rows))
+                {
+                    n_rows = active_rows + 1;
+                }
+                return n_rows;
+            }
+
+            // the same, also up to the vertices of the last shed row
+            template <typename t_gamma_star>
+            int convected_wake_limit
+            (
+                const t_gamma_star& gamma_star,
+                const int& active_rows
+            )
+            {
+                const int shed_vertices = UVLM::BiotSavart::shed_rows(gamma_star) + 1;
+                const int n_rows = UVLM::Unsteady::Utils::free_wake_limit(active_rows);
+                return n_rows == -1 ? shed_vertices:std::min(n_rows, shed_vertices);
+            }
+
+            // rows of a wake with M rows of vertices for a limit (-1: all)
+            inline uint limited_rows
+            (
+                const uint& M,
+                const int& n_rows
+            )
+            {
+                return n_rows == -1 ? M:std::min<uint>(M, n_rows);
+            }
+
+            // Sub-cycling of the wake self-induction (convection_scheme == 3).
+            // The velocity induced on the wake vertices is evaluated in full
+            // every interval steps (1: every step). In between, it is
+            // extrapolated (order 1: linear, 2: quadratic) along every wake
+            // vertex, which moves one row down per step, from the last
+            // order + 1 full evaluations; only the first fresh_rows rows
+            // (and the rows too young to have that history) are evaluated.
+            // Both orders cost the same per step (order 2 keeps one more
+            // evaluation), but order 1 is much less accurate: on a heaving
+            // wing it gave 4% lift error with interval 2 (order 2: 1.2%).
+            // With tolerance > 0, the extrapolation is checked against the
+            // evaluated rows and a full evaluation is done if they differ
+            // by more than tolerance (relative to the largest velocity).
+            struct Subcycling
+            {
+                uint interval = 1;
+                uint order = 2;
+                double tolerance = 0.0;
+                uint fresh_rows = 2;
+            };
+
+            inline Subcycling& subcycling()
+            {
+                static Subcycling wake_subcycling;
+                return wake_subcycling;
+            }
+
+            template <typename t_zeta,
+                      typename t_zeta_star,
+                      typename t_gamma,
+                      typename t_gamma_star,
+                      typename t_uout>
+            void wake_self_induction
+            (
+                const t_zeta& zeta,
+                const t_zeta_star& zeta_star,
+                const t_gamma& gamma,
+                const t_gamma_star& gamma_star,
+                const int& active_rows,
+                FarWakeCache& far_wake,
+                t_uout& uout
+            );
+
+            template <typename t_zeta,
+                      typename t_zeta_star,
+                      typename t_gamma,
+                      typename t_gamma_star,
+                      typename t_uout>
+            void wake_rows_induced_velocity
+            (
+                const t_zeta& zeta,
+                const t_zeta_star& zeta_star,
+                const t_gamma& gamma,
+                const t_gamma_star& gamma_star,
+                const std::vector<uint>& n_rows,
+                const int& active_rows,
+                t_uout& uout
+            );
+
+            template <typename t_zeta,
+                      typename t_zeta_star,
+                      typename t_gamma,
+                      typename t_gamma_star,
+                      typename t_uout>
+            void subcycled_wake_self_induction
+            (
+                const t_zeta& zeta,
+                const t_zeta_star& zeta_star,
+                const t_gamma& gamma,
+                const t_gamma_star& gamma_star,
+                const int& active_rows,
+                FarWakeCache& far_wake,
+                SubcyclingState& state,
+                t_uout& uout
             );
         }
     }
 }
 
+
+// Hashes of the wake geometry and of the circulation of the wake rows
+// after the first one (the first one is overwritten by every solve)
+template <typename t_zeta_star,
+          typename t_gamma_star>
+void UVLM::Unsteady::Utils::far_wake_keys
+(
+    const t_zeta_star& zeta_star,
+    const t_gamma_star& gamma_star,
+    uint64_t& zeta_star_key,
+    uint64_t& gamma_star_key
+)
+{
+    zeta_star_key = UVLM::Types::hash_VecVecMat(zeta_star);
+    UVLM::Types::VecMatrixX far_gamma_star;
+    for (uint i_surf=0; i_surf<gamma_star.size(); ++i_surf)
+    {
+        far_gamma_star.push_back(gamma_star[i_surf].bottomRows(gamma_star[i_surf].rows() - 1));
+    }
+    gamma_star_key = UVLM::Types::hash_VecMat(far_gamma_star);
+}
+
+// Rows of wake rings (of all the surfaces) to keep so the velocity that
+// the rest could induce on the collocation points is below tolerance
+// (-1: all of them). Far from the collocation points, a vortex ring is a
+// dipole of moment gamma*area, so its velocity is bounded by
+//      2 |gamma| area/(4 pi d^3)
+// with d the distance from the ring to the box of the collocation
+// points (minus the size of the ring). The oldest rows are dropped while
+// the sum of their bounds is below tolerance; the first row (in the AIC)
+// is always kept.
+template <typename t_zeta_col,
+          typename t_zeta_star,
+          typename t_gamma_star>
+int UVLM::Unsteady::Utils::active_wake_rows
+(
+    const t_zeta_col& zeta_col,
+    const t_zeta_star& zeta_star,
+    const t_gamma_star& gamma_star,
+    const UVLM::Types::Real& tolerance
+)
+{
+    const uint n_surf = zeta_star.size();
+    UVLM::Types::Vector3 lower = UVLM::Types::Vector3::Constant(std::numeric_limits<UVLM::Types::Real>::max());
+    UVLM::Types::Vector3 upper = -lower;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+        {
+            lower(i_dim) = std::min(lower(i_dim), zeta_col[i_surf][i_dim].minCoeff());
+            upper(i_dim) = std::max(upper(i_dim), zeta_col[i_surf][i_dim].maxCoeff());
+        }
+    }
+
+    uint max_rows = 0;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        max_rows = std::max<uint>(max_rows, gamma_star[i_surf].rows());
+    }
+    std::vector<UVLM::Types::Real> row_bound(max_rows, 0.0);
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        for (uint i=0; i<gamma_star[i_surf].rows(); ++i)
+        {
+            for (uint j=0; j<gamma_star[i_surf].cols(); ++j)
+            {
+                UVLM::Types::Vector3 corner[4];
+                for (uint i_corner=0; i_corner<4; ++i_corner)
+                {
+                    const uint i_vertex = i + (i_corner == 1 || i_corner == 2);
+                    const uint j_vertex = j + (i_corner >= 2);
+                    for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                    {
+                        corner[i_corner](i_dim) = zeta_star[i_surf][i_dim](i_vertex, j_vertex);
+                    }
+                }
+                const UVLM::Types::Vector3 diagonal_1 = corner[2] - corner[0];
+                const UVLM::Types::Vector3 diagonal_2 = corner[3] - corner[1];
+                const UVLM::Types::Real area = 0.5*diagonal_1.cross(diagonal_2).norm();
+                const UVLM::Types::Vector3 centre = 0.25*(corner[0] + corner[1] +
+                                                          corner[2] + corner[3]);
+                const UVLM::Types::Real distance =
+                    (centre - centre.cwiseMax(lower).cwiseMin(upper)).norm() -
+                    0.5*std::max(diagonal_1.norm(), diagonal_2.norm());
+                if (distance <= 0.0)
+                {
+                    row_bound[i] = std::numeric_limits<UVLM::Types::Real>::max();
+                    continue;
+                }
+                row_bound[i] += 2.0*std::abs(gamma_star[i_surf](i, j))*area/
+                                (UVLM::Constants::PI4*distance*distance*distance);
+            }
+        }
+    }
+
+    int active_rows = max_rows;
+    UVLM::Types::Real dropped = 0.0;
+    while (active_rows > 1 && dropped + row_bound[active_rows - 1] < tolerance)
+    {
+        dropped += row_bound[active_rows - 1];
+        --active_rows;
+    }
+    return active_rows == static_cast<int>(max_rows) ? -1:active_rows;
+}
+
+
+// Rows of wake rings kept by wake_truncation() for the wake zeta_star,
+// gamma_star (-1: all, also without truncation)
+template <typename t_zeta_col,
+          typename t_zeta_star,
+          typename t_gamma_star>
+int UVLM::Unsteady::Utils::truncated_rows
+(
+    const t_zeta_col& zeta_col,
+    const t_zeta_star& zeta_star,
+    const t_gamma_star& gamma_star,
+    const UVLM::Types::FlightConditions& flightconditions
+)
+{
+    const double tolerance = UVLM::Unsteady::Utils::wake_truncation().tolerance;
+    if (tolerance <= 0.0) {return -1;}
+    return UVLM::Unsteady::Utils::active_wake_rows(zeta_col,
+                                                   zeta_star,
+                                                   gamma_star,
+                                                   tolerance*flightconditions.uinf);
+}
+
+
 template <typename t_zeta,
           typename t_zeta_dot,
           typename t_uext,
@@ -94,8 +439,11 @@ void UVLM::Unsteady::Utils::compute_resultant_grid_velocity
 // wake is convected.
 // convection_scheme == 0 => prescribed and fixed
 // convection_scheme == 1 => prescribed following deformations of the wing
+//                            (convected with the trailing edge free stream)
 // convection_scheme == 2 => free, convection based on u_ext
 // convection_scheme == 3 => free, convection based on u_ext and induced velocities.
+// active_rows: rows of wake rings kept by the truncation of the wake passed
+// in (truncated_rows, -1: all), which sets the free wake length.
 template <typename t_zeta,
           typename t_zeta_star,
           typename t_gamma,
@@ -112,7 +460,11 @@ void UVLM::Unsteady::Utils::convect_unsteady_wake
     t_gamma_star& gamma_star,
     const t_uext& uext,
     const t_uext_star& uext_star,
-    const t_rbm_velocity& rbm_velocity
+    const t_rbm_velocity& rbm_velocity,
+    const int& active_rows,
+    UVLM::Unsteady::Utils::FarWakeCache& far_wake,
+    UVLM::Unsteady::Utils::SubcyclingState& subcycling_state,
+    UVLM::Wake::Discretised::IntegrationState& integration
 )
 {
     const uint n_surf = options.NumSurfaces;
@@ -122,10 +474,39 @@ void UVLM::Unsteady::Utils::convect_unsteady_wake
         UVLM::Wake::General::displace_VecMat(gamma_star);
     } else if (options.convection_scheme == 1)
     {
-        std::cerr << "convection_scheme == "
-                  << options.convection_scheme
-                  << " is not yet implemented in the UVLM solver"
-                  << std::endl;
+        // every wake column is convected with the free stream at its
+        // trailing edge vertex (uext minus the rbm translation), so the
+        // wake keeps the history of the trailing edge motion and
+        // deformation without evaluating any velocity in the wake
+        UVLM::Types::VecVecMatrixX u_convection;
+        UVLM::Types::allocate_VecVecMat(u_convection, zeta_star);
+        for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+        {
+            const uint M = zeta[i_surf][0].rows() - 1;
+            for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+            {
+                for (uint j=0; j<u_convection[i_surf][i_dim].cols(); ++j)
+                {
+                    u_convection[i_surf][i_dim].col(j).setConstant
+                    (
+                        uext[i_surf][i_dim](M, j) - rbm_velocity(i_dim)
+                    );
+                }
+            }
+        }
+        UVLM::Wake::Discretised::convect(zeta_star,
+                                         u_convection,
+                                         options.dt);
+        // displace both zeta and gamma
+        UVLM::Wake::General::displace_VecMat(gamma_star);
+        UVLM::Wake::General::displace_VecVecMat(zeta_star);
+
+        // copy last row of zeta into zeta_star
+        UVLM::Wake::Discretised::generate_new_row
+        (
+            zeta_star,
+            zeta
+        );
     } else if (options.convection_scheme == 2)
     {
         UVLM::Types::VecVecMatrixX uext_star_total;
@@ -162,12 +543,6 @@ void UVLM::Unsteady::Utils::convect_unsteady_wake
     } else if (options.convection_scheme == 3)
     {
         // convection with uext + delta u (perturbation) + u_ind
-        UVLM::Types::VecVecMatrixX u_convection;
-        UVLM::Types::allocate_VecVecMat
-        (
-            u_convection,
-            uext_star
-        );
         UVLM::Types::VecVecMatrixX uext_star_total;
         UVLM::Types::allocate_VecVecMat(uext_star_total, uext_star);
         UVLM::Types::VecVecMatrixX zeros;
@@ -184,37 +559,59 @@ void UVLM::Unsteady::Utils::convect_unsteady_wake
             rbm_no_omega,
             uext_star_total
         );
-        // induced velocity by vortex rings
-        UVLM::BiotSavart::total_induced_velocity_on_wake
-        (
-            zeta,
-            zeta_star,
-            gamma,
-            gamma_star,
-            u_convection
-        );
-        // remove first row of convection velocities
-        for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+        // the external velocity is taken at the vertices at the beginning
+        // of the step also for the predicted positions of Heun
+        // (UVLM::Wake::Discretised::convect_wake), which are not
+        // sub-cycled
+        auto velocity = [&](const auto& positions,
+                            UVLM::Types::VecVecMatrixX& u_convection,
+                            const uint& i_evaluation)
         {
-            for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+            // induced velocity by vortex rings
+            if (i_evaluation == 0)
+            {
+                UVLM::Unsteady::Utils::subcycled_wake_self_induction(zeta,
+                                                                     positions,
+                                                                     gamma,
+                                                                     gamma_star,
+                                                                     active_rows,
+                                                                     far_wake,
+                                                                     subcycling_state,
+                                                                     u_convection);
+            } else
             {
-                u_convection[i_surf][i_dim].template topRows<1>().setZero();
+                UVLM::Unsteady::Utils::wake_self_induction(zeta,
+                                                           positions,
+                                                           gamma,
+                                                           gamma_star,
+                                                           active_rows,
+                                                           far_wake,
+                                                           u_convection);
+            }
+            // remove first row of convection velocities
+            for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+            {
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    u_convection[i_surf][i_dim].template topRows<1>().setZero();
+                }
             }
-        }
 
-        // u_convection = u_convection + uext_star;
-        for (uint i_surf=0; i_surf<n_surf; ++i_surf)
-        {
-            for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+            // u_convection = u_convection + uext_star;
+            for (uint i_surf=0; i_surf<n_surf; ++i_surf)
             {
-                u_convection[i_surf][i_dim] = u_convection[i_surf][i_dim] +
-                                              uext_star_total[i_surf][i_dim];
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    u_convection[i_surf][i_dim] = u_convection[i_surf][i_dim] +
+                                                  uext_star_total[i_surf][i_dim];
+                }
             }
-        }
+        };
 
-        UVLM::Wake::Discretised::convect(zeta_star,
-                                         u_convection,
-                                         options.dt);
+        UVLM::Wake::Discretised::convect_wake(zeta_star,
+                                              velocity,
+                                              options.dt,
+                                              integration);
         // displace both zeta and gamma
         UVLM::Wake::General::displace_VecMat(gamma_star);
         UVLM::Wake::General::displace_VecVecMat(zeta_star);
@@ -225,6 +622,13 @@ void UVLM::Unsteady::Utils::convect_unsteady_wake
             zeta_star,
             zeta
         );
+        if (UVLM::Unsteady::Utils::subcycling().interval > 1)
+        {
+            subcycling_state.zeta_star_key =
+                UVLM::Types::hash_VecVecMat(zeta_star);
+        }
+        UVLM::Wake::Discretised::end_convection_step(zeta_star,
+                                                     integration);
     } else
     {
         std::cerr << "convection_scheme == "
@@ -235,3 +639,293 @@ void UVLM::Unsteady::Utils::convect_unsteady_wake
     }
     return;
 }
+
+
+// Velocity induced by all the surfaces and wakes on the wake vertices
+// (added to uout), with the first active_rows rows of wake rings (-1: all)
+// as sources. The far wake part comes from the last far_wake_sweep if
+// the wake is still the same.
+template <typename t_zeta,
+          typename t_zeta_star,
+          typename t_gamma,
+          typename t_gamma_star,
+          typename t_uout>
+void UVLM::Unsteady::Utils::wake_self_induction
+(
+    const t_zeta& zeta,
+    const t_zeta_star& zeta_star,
+    const t_gamma& gamma,
+    const t_gamma_star& gamma_star,
+    const int& active_rows,
+    UVLM::Unsteady::Utils::FarWakeCache& far_wake,
+    t_uout& uout
+)
+{
+    const uint n_surf = zeta.size();
+    const int target_rows = UVLM::Unsteady::Utils::convected_wake_limit(gamma_star, active_rows);
+    bool use_far_wake = false;
+    if (far_wake.valid)
+    {
+        uint64_t zeta_star_key;
+        uint64_t gamma_star_key;
+        UVLM::Unsteady::Utils::far_wake_keys(zeta_star,
+                                             gamma_star,
+                                             zeta_star_key,
+                                             gamma_star_key);
+        use_far_wake = zeta_star_key == far_wake.zeta_star_key &&
+                       gamma_star_key == far_wake.gamma_star_key &&
+                       target_rows == far_wake.target_rows;
+        far_wake.valid = false;
+    }
+    UVLM::BiotSavart::total_induced_velocity_on_wake
+    (
+        zeta,
+        zeta_star,
+        gamma,
+        gamma_star,
+        uout,
+        false,
+        VORTEX_RADIUS,
+        use_far_wake ? 1:active_rows,
+        target_rows
+    );
+    if (use_far_wake)
+    {
+        uint counter = 0;
+        for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+        {
+            const uint free_rows =
+                UVLM::Unsteady::Utils::limited_rows(uout[i_surf][0].rows(), target_rows);
+            for (uint i=0; i<free_rows; ++i)
+            {
+                for (uint j=0; j<uout[i_surf][0].cols(); ++j)
+                {
+                    uout[i_surf][0](i, j) += far_wake.velocity.x[counter];
+                    uout[i_surf][1](i, j) += far_wake.velocity.y[counter];
+                    uout[i_surf][2](i, j) += far_wake.velocity.z[counter];
+                    ++counter;
+                }
+            }
+        }
+    }
+}
+
+
+// Velocity induced by all the surfaces and wakes (only the first active_rows
+// rows of wake rings) on the first n_rows[i_surf] rows of vertices of every
+// wake; the rest of uout is not modified.
+template <typename t_zeta,
+          typename t_zeta_star,
+          typename t_gamma,
+          typename t_gamma_star,
+          typename t_uout>
+void UVLM::Unsteady::Utils::wake_rows_induced_velocity
+(
+    const t_zeta& zeta,
+    const t_zeta_star& zeta_star,
+    const t_gamma& gamma,
+    const t_gamma_star& gamma_star,
+    const std::vector<uint>& n_rows,
+    const int& active_rows,
+    t_uout& uout
+)
+{
+    const uint n_surf = zeta.size();
+    UVLM::BiotSavart::Segments<UVLM::Types::Real> segments;
+    UVLM::BiotSavart::Points<UVLM::Types::Real> targets;
+    auto ring_index = [](const int&, const int&) {return 0;};
+    const int wake_rows = UVLM::BiotSavart::shed_rows(gamma_star, active_rows);
+    auto wake_ring_index = [wake_rows](const int& i, const int&)
+    {
+        return i < wake_rows ? 0:-1;
+    };
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        UVLM::BiotSavart::lattice_segments(zeta_star[i_surf],
+                                           gamma_star[i_surf],
+                                           wake_ring_index,
+                                           segments);
+        UVLM::BiotSavart::lattice_segments(zeta[i_surf],
+                                           gamma[i_surf],
+                                           ring_index,
+                                           segments);
+        UVLM::BiotSavart::Points<UVLM::Types::Real> surface_targets;
+        UVLM::BiotSavart::surface_points(zeta_star[i_surf],
+                                         surface_targets,
+                                         0,
+                                         n_rows[i_surf]);
+        targets.append(surface_targets);
+    }
+    UVLM::BiotSavart::sort_segments(segments);
+    UVLM::BiotSavart::Points<UVLM::Types::Real> velocity;
+    UVLM::BiotSavart::induced_velocity(segments, targets, velocity);
+    UVLM::BiotSavart::wake_closure_velocity(
+        zeta_star,
+        gamma_star,
+        targets,
+        velocity,
+        active_rows);
+
+    uint counter = 0;
+    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+    {
+        for (uint i=0; i<n_rows[i_surf]; ++i)
+        {
+            for (uint j=0; j<zeta_star[i_surf][0].cols(); ++j)
+            {
+                uout[i_surf][0](i, j) = velocity.x[counter];
+                uout[i_surf][1](i, j) = velocity.y[counter];
+                uout[i_surf][2](i, j) = velocity.z[counter];
+                ++counter;
+            }
+        }
+    }
+}
+
+
+// wake_self_induction with the sub-cycling of subcycling() (see above).
+// uout must be zero on input.
+template <typename t_zeta,
+          typename t_zeta_star,
+          typename t_gamma,
+          typename t_gamma_star,
+          typename t_uout>
+void UVLM::Unsteady::Utils::subcycled_wake_self_induction
+(
+    const t_zeta& zeta,
+    const t_zeta_star& zeta_star,
+    const t_gamma& gamma,
+    const t_gamma_star& gamma_star,
+    const int& active_rows,
+    UVLM::Unsteady::Utils::FarWakeCache& far_wake,
+    UVLM::Unsteady::Utils::SubcyclingState& state,
+    t_uout& uout
+)
+{
+    const UVLM::Unsteady::Utils::Subcycling& settings =
+        UVLM::Unsteady::Utils::subcycling();
+    if (settings.interval <= 1)
+    {
+        UVLM::Unsteady::Utils::wake_self_induction(zeta,
+                                                   zeta_star,
+                                                   gamma,
+                                                   gamma_star,
+                                                   active_rows,
+                                                   far_wake,
+                                                   uout);
+        return;
+    }
+
+    const uint n_surf = zeta.size();
+    if (UVLM::Types::hash_VecVecMat(zeta_star) != state.zeta_star_key)
+    {
+        state.step = 0;
+        state.sample_steps.clear();
+        state.samples.clear();
+    }
+    const uint step = ++state.step;
+    const uint order = std::min<uint>(std::max<uint>(settings.order, 1), 2);
+    bool full = state.samples.size() < order + 1 ||
+                step - state.sample_steps[0] >= settings.interval;
+
+    if (!full)
+    {
+        // Lagrange extrapolation in time along every vertex: the vertex at
+        // row i now was at row i - (step - sample_steps[m]) in sample m
+        const uint age = step - state.sample_steps[order];
+        std::vector<UVLM::Types::Real> weights(order + 1, 1.0);
+        for (uint m=0; m<=order; ++m)
+        {
+            for (uint l=0; l<=order; ++l)
+            {
+                if (l == m) {continue;}
+                weights[m] *= (static_cast<UVLM::Types::Real>(step) - state.sample_steps[l])/
+                              (static_cast<UVLM::Types::Real>(state.sample_steps[m]) - state.sample_steps[l]);
+            }
+        }
+        std::vector<uint> n_rows(n_surf);
+        std::vector<uint> first_extrapolated(n_surf);
+        for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+        {
+            const uint free_rows = UVLM::Unsteady::Utils::limited_rows(
+                zeta_star[i_surf][0].rows(),
+                UVLM::Unsteady::Utils::convected_wake_limit(gamma_star, active_rows));
+            first_extrapolated[i_surf] = std::min(free_rows, age);
+            // with a tolerance, at least one extrapolated row is checked
+            n_rows[i_surf] = std::min(free_rows, std::max(settings.fresh_rows,
+                                                          age + (settings.tolerance > 0.0 ? 1:0)));
+            for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+            {
+                for (uint i=first_extrapolated[i_surf]; i<free_rows; ++i)
+                {
+                    for (uint m=0; m<=order; ++m)
+                    {
+                        uout[i_surf][i_dim].row(i) += weights[m]*
+                            state.samples[m][i_surf][i_dim].row(i - (step - state.sample_steps[m]));
+                    }
+                }
+            }
+        }
+
+        // the extrapolation of the rows that are also evaluated
+        // is the error estimate
+        UVLM::Types::Real error = 0.0;
+        UVLM::Types::Real scale = 0.0;
+        UVLM::Types::VecVecMatrixX extrapolated;
+        if (settings.tolerance > 0.0)
+        {
+            UVLM::Types::allocate_VecVecMat(extrapolated, uout);
+            UVLM::Types::copy_VecVecMat(uout, extrapolated);
+        }
+        UVLM::Unsteady::Utils::wake_rows_induced_velocity(zeta,
+                                                          zeta_star,
+                                                          gamma,
+                                                          gamma_star,
+                                                          n_rows,
+                                                          active_rows,
+                                                          uout);
+        if (settings.tolerance > 0.0)
+        {
+            for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+            {
+                // the first row is not convected with the induced velocity
+                const uint begin = std::max<uint>(first_extrapolated[i_surf], 1);
+                for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                {
+                    scale = std::max(scale, uout[i_surf][i_dim].cwiseAbs().maxCoeff());
+                    if (n_rows[i_surf] <= begin) {continue;}
+                    error = std::max(error,
+                        (uout[i_surf][i_dim].middleRows(begin, n_rows[i_surf] - begin) -
+                         extrapolated[i_surf][i_dim].middleRows(begin, n_rows[i_surf] - begin)
+                        ).cwiseAbs().maxCoeff());
+                }
+            }
+            if (error > settings.tolerance*scale)
+            {
+                full = true;
+                UVLM::Types::initialise_VecVecMat(uout);
+            }
+        }
+    }
+
+    if (full)
+    {
+        UVLM::Unsteady::Utils::wake_self_induction(zeta,
+                                                   zeta_star,
+                                                   gamma,
+                                                   gamma_star,
+                                                   active_rows,
+                                                   far_wake,
+                                                   uout);
+        UVLM::Types::VecVecMatrixX sample;
+        UVLM::Types::allocate_VecVecMat(sample, uout);
+        UVLM::Types::copy_VecVecMat(uout, sample);
+        state.samples.insert(state.samples.begin(), sample);
+        state.sample_steps.insert(state.sample_steps.begin(), step);
+        if (state.samples.size() > order + 1)
+        {
+            state.samples.resize(order + 1);
+            state.sample_steps.resize(order + 1);
+        }
+    }
+}
@@ -109,6 +109,146 @@ namespace UVLM
                 }
             }
 
+            // Time integration of the wake convection (convect_wake):
+            //  0: explicit Euler (convect)
+            //  1: second order Adams-Bashforth, with the convection
+            //     velocity of every vertex in the previous step (Euler in
+            //     the first step and for the new row of vertices)
+            //  2: Heun (second order Runge-Kutta): the velocity is
+            //     evaluated again at the Euler positions and averaged
+            struct Integration
+            {
+                uint scheme = 0;
+            };
+
+            inline Integration& integration()
+            {
+                static Integration wake_integration;
+                return wake_integration;
+            }
+
+            // Convection velocities of the last step, by row of vertices
+            // before the rows are displaced (Adams-Bashforth), and counters
+            // of the convection steps and velocity evaluations done.
+            // zeta_star_key is the wake after the last step (see
+            // end_convection_step), so any other wake restarts the history;
+            // restarts counts the Adams-Bashforth steps done with Euler
+            // because of that. Kept by the simulation
+            // (UVLM::Simulation::State).
+            struct IntegrationState
+            {
+                uint64_t zeta_star_key = 0;
+                double delta_t = 0.0;
+                UVLM::Types::VecVecMatrixX u_previous;
+                uint64_t steps = 0;
+                uint64_t evaluations = 0;
+                uint64_t restarts = 0;
+            };
+
+            /*******************************************************************
+            Convects zeta_star one step of delta_t with the scheme of
+            integration(). velocity(positions, u, i_evaluation) gives the
+            convection velocity u (zero on input) of the vertices at
+            positions; i_evaluation is 0 for zeta_star itself and 1 for the
+            predicted positions of Heun.
+            *******************************************************************/
+            template <typename t_zeta_star,
+                      typename t_velocity>
+            void convect_wake
+            (
+                t_zeta_star& zeta_star,
+                const t_velocity& velocity,
+                const double& delta_t,
+                UVLM::Wake::Discretised::IntegrationState& state
+            )
+            {
+                const uint scheme = UVLM::Wake::Discretised::integration().scheme;
+                const uint n_surf = zeta_star.size();
+                UVLM::Types::VecVecMatrixX u;
+                UVLM::Types::allocate_VecVecMat(u, zeta_star);
+                velocity(zeta_star, u, 0);
+                ++state.steps;
+                ++state.evaluations;
+
+                if (scheme == 2)
+                {
+                    UVLM::Types::VecVecMatrixX predicted;
+                    UVLM::Types::allocate_VecVecMat(predicted, zeta_star);
+                    UVLM::Types::copy_VecVecMat(zeta_star, predicted);
+                    UVLM::Wake::Discretised::convect(predicted, u, delta_t);
+                    UVLM::Types::VecVecMatrixX u_predicted;
+                    UVLM::Types::allocate_VecVecMat(u_predicted, zeta_star);
+                    velocity(predicted, u_predicted, 1);
+                    ++state.evaluations;
+                    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+                    {
+                        for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                        {
+                            u[i_surf][i_dim] = 0.5*(u[i_surf][i_dim] +
+                                                    u_predicted[i_surf][i_dim]);
+                        }
+                    }
+                    UVLM::Wake::Discretised::convect(zeta_star, u, delta_t);
+                    return;
+                }
+                if (scheme != 1)
+                {
+                    UVLM::Wake::Discretised::convect(zeta_star, u, delta_t);
+                    return;
+                }
+
+                // Adams-Bashforth: the vertex in row i was in row i - 1 in
+                // the previous step
+                bool history = state.delta_t > 0.0 &&
+                               state.u_previous.size() == n_surf &&
+                               state.zeta_star_key == UVLM::Types::hash_VecVecMat(zeta_star);
+                for (uint i_surf=0; history && i_surf<n_surf; ++i_surf)
+                {
+                    history = state.u_previous[i_surf][0].rows() == u[i_surf][0].rows() &&
+                              state.u_previous[i_surf][0].cols() == u[i_surf][0].cols();
+                }
+                UVLM::Types::VecVecMatrixX u_step;
+                UVLM::Types::allocate_VecVecMat(u_step, zeta_star);
+                UVLM::Types::copy_VecVecMat(u, u_step);
+                if (!history)
+                {
+                    ++state.restarts;
+                } else
+                {
+                    // variable step: u + w*(u - u_previous)
+                    const double w = 0.5*delta_t/state.delta_t;
+                    for (uint i_surf=0; i_surf<n_surf; ++i_surf)
+                    {
+                        const uint n_M = u[i_surf][0].rows();
+                        for (uint i_dim=0; i_dim<UVLM::Constants::NDIM; ++i_dim)
+                        {
+                            u_step[i_surf][i_dim].bottomRows(n_M - 1) +=
+                                w*(u[i_surf][i_dim].bottomRows(n_M - 1) -
+                                   state.u_previous[i_surf][i_dim].topRows(n_M - 1));
+                        }
+                    }
+                }
+                UVLM::Wake::Discretised::convect(zeta_star, u_step, delta_t);
+                state.u_previous = u;
+                state.delta_t = delta_t;
+            }
+
+            // To be called once the wake rows have been displaced and the
+            // new row generated after convect_wake.
+            template <typename t_zeta_star>
+            void end_convection_step
+            (
+                const t_zeta_star& zeta_star,
+                UVLM::Wake::Discretised::IntegrationState& state
+            )
+            {
+                if (UVLM::Wake::Discretised::integration().scheme == 1)
+                {
+                    state.zeta_star_key =
+                        UVLM::Types::hash_VecVecMat(zeta_star);
+                }
+            }
+
         }
         namespace Horseshoe
 
@@ -150,20 +290,23 @@ namespace UVLM
             }
 
             template <typename t_zeta_star,
-                      typename t_gamma_star>
+                      typename t_gamma_star,
+                      typename t_delta_x>
             void to_discretised
             (
                 t_zeta_star& zeta_star,
                 t_gamma_star& gamma_star,
-                const double& delta_x
+                const t_delta_x& delta_x
             )
             {
-                UVLM::Types::Vector3 dir_stream;
+                typedef UVLM::Types::GenericVector3<
+                    typename t_zeta_star::value_type::value_type::Scalar> t_vector;
+                t_vector dir_stream;
                 dir_stream << zeta_star[0][0](1, 0) - zeta_star[0][0](0, 0),
                               zeta_star[0][1](1, 0) - zeta_star[0][1](0, 0),
                               zeta_star[0][2](1, 0) - zeta_star[0][2](0, 0);
                 dir_stream.normalize();
-                UVLM::Types::Vector3 delta_x_vec = dir_stream*delta_x;
+                t_vector delta_x_vec = dir_stream*delta_x;
 
                 const uint n_surf = zeta_star.size();
                 for (uint i_surf=0; i_surf<n_surf; ++i_surf)
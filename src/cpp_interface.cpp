@@ -18,8 +18,7 @@ DLLEXPORT void run_VLM
 {
     // std::cout << options.n_rollup << std::endl;
     // feenableexcept(FE_INVALID | FE_OVERFLOW);
-    // omp_set_nested(1);
-    // omp_set_num_threads(options.NumCores);
+    UVLM::Threads::Configuration threads(options.NumCores);
     unsigned int n_surf;
     n_surf = options.NumSurfaces;
     UVLM::Types::VecDimensions dimensions;
@@ -81,7 +80,255 @@ DLLEXPORT void run_VLM
                          gamma_star,
                          forces,
                          options,
-                         flightconditions);
+                         flightconditions,
+                         UVLM::CppInterface::simulation());
+}
+
+
+// Simulation states (see UVLM::Simulation::State): the caches a
+// simulation keeps between its calls. Every calling thread has one of its
+// own, which is enough for one simulation per thread. Several simulations
+// stepped in the same thread each need a state of their own: bind it
+// before the calls of its simulation (nullptr: back to the state of the
+// thread). A state must not be bound in two threads at the same time, and
+// must not be bound when it is deleted from another thread.
+DLLEXPORT void* new_simulation_UVLM()
+{
+    return new UVLM::Simulation::State;
+}
+
+
+DLLEXPORT void delete_simulation_UVLM
+(
+    void* simulation
+)
+{
+    if (UVLM::CppInterface::bound_simulation() == simulation)
+    {
+        UVLM::CppInterface::bound_simulation() = nullptr;
+    }
+    delete static_cast<UVLM::Simulation::State*>(simulation);
+}
+
+
+DLLEXPORT void bind_simulation_UVLM
+(
+    void* simulation
+)
+{
+    UVLM::CppInterface::bound_simulation() =
+        static_cast<UVLM::Simulation::State*>(simulation);
+}
+
+
+// Pins the thread pool to cores first_core, first_core + 1... from the
+// next call on (see threads.h). pin = false leaves the placement to the
+// OpenMP runtime.
+// Side effects on the host process: the OpenMP worker threads are shared
+// with the host, and stay pinned after the call. The calling thread (the
+// host's own, e.g. the Python interpreter) is only pinned, to first_core,
+// if pin_caller; it then stays pinned too.
+DLLEXPORT void set_threads_affinity_UVLM
+(
+    bool pin,
+    unsigned int first_core,
+    bool pin_caller
+)
+{
+    UVLM::Threads::set_affinity(pin, first_core, pin_caller);
+}
+
+
+// Number of targets and of source segments per tile of the Biot-Savart
+// kernels (see UVLM::BiotSavart::TileSize). 0 keeps the current value.
+DLLEXPORT void set_tile_size_UVLM
+(
+    unsigned int targets,
+    unsigned int segments
+)
+{
+    if (targets != 0) {UVLM::BiotSavart::tile_size().targets = targets;}
+    if (segments != 0) {UVLM::BiotSavart::tile_size().segments = segments;}
+}
+
+
+// Stride of the wake vertices where the induced velocity is evaluated
+// (see UVLM::BiotSavart::WakeStride). 1 (default) evaluates all of them.
+// The vertices next to the trailing edge and the tips (WakeStride::edge
+// rows and columns) are always evaluated.
+DLLEXPORT void set_wake_stride_UVLM
+(
+    unsigned int stride
+)
+{
+    UVLM::BiotSavart::wake_stride().stride = std::max(stride, 1u);
+}
+
+
+// Particle-mesh evaluation of the wake velocities
+// (see UVLM::BiotSavart::ParticleMesh). nodes 0 (default) evaluates them
+// directly.
+DLLEXPORT void set_particle_mesh_UVLM
+(
+    unsigned int nodes,
+    unsigned int near_cells
+)
+{
+    UVLM::BiotSavart::particle_mesh().nodes = nodes;
+    UVLM::BiotSavart::particle_mesh().near_cells = near_cells;
+}
+
+
+// Free wake length with convection_scheme == 3
+// (see UVLM::Unsteady::Utils::FreeWake). -1 (default): all the wake is free.
+DLLEXPORT void set_free_wake_rows_UVLM
+(
+    int n_rows
+)
+{
+    UVLM::Unsteady::Utils::free_wake().n_rows = n_rows;
+}
+
+
+// Adaptive truncation of the wake in the unsteady solver
+// (see UVLM::Unsteady::Utils::WakeTruncation): tolerance on the velocity
+// of the dropped rows, relative to uinf. 0 (default) keeps all the rows.
+DLLEXPORT void set_wake_truncation_UVLM
+(
+    double tolerance
+)
+{
+    UVLM::Unsteady::Utils::wake_truncation().tolerance = tolerance;
+}
+
+
+// Semi-infinite closure of the discretised unsteady wakes
+// (see UVLM::BiotSavart::wake_closure_velocity). false (default): the
+// wakes end after their last row. run_VLM (options.Steady) ignores it.
+DLLEXPORT void set_wake_closure_UVLM
+(
+    bool horseshoe
+)
+{
+    UVLM::BiotSavart::wake_closure().horseshoe = horseshoe;
+}
+
+
+// Sub-cycling of the wake self-induction with convection_scheme == 3
+// (see UVLM::Unsteady::Utils::Subcycling). interval 1 (default) evaluates
+// it every time step. order 0 selects the default quadratic extrapolation;
+// order 1 (linear) loses accuracy quickly as interval grows.
+DLLEXPORT void set_wake_subcycling_UVLM
+(
+    unsigned int interval,
+    unsigned int order,
+    double tolerance,
+    unsigned int fresh_rows
+)
+{
+    UVLM::Unsteady::Utils::Subcycling& subcycling =
+        UVLM::Unsteady::Utils::subcycling();
+    subcycling.interval = std::max(interval, 1u);
+    subcycling.order = order == 0 ? 2u:std::min(order, 2u);
+    subcycling.tolerance = tolerance;
+    subcycling.fresh_rows = fresh_rows;
+}
+
+
+// Time integration of the wake convection (steady rollup and
+// convection_scheme == 3, see UVLM::Wake::Discretised::Integration):
+// 0 (default) Euler, 1 Adams-Bashforth 2, 2 Heun. Resets the history and
+// counters of the simulation of the calling thread
+// (UVLM::CppInterface::simulation).
+DLLEXPORT void set_wake_integration_UVLM
+(
+    unsigned int scheme
+)
+{
+    if (scheme > 2)
+    {
+        std::cerr << "Wake integration scheme " << scheme
+                  << " is not supported, using Euler (0)" << std::endl;
+        scheme = 0;
+    }
+    UVLM::Wake::Discretised::integration().scheme = scheme;
+    UVLM::CppInterface::simulation().integration =
+        UVLM::Wake::Discretised::IntegrationState();
+}
+
+
+// Wake convection steps, evaluations of the convection velocity and
+// Adams-Bashforth steps restarted with Euler (no history of the wake
+// passed in) of the simulation of the calling thread since the last
+// set_wake_integration_UVLM (or reset).
+DLLEXPORT void wake_integration_counters_UVLM
+(
+    unsigned long long* steps,
+    unsigned long long* evaluations,
+    unsigned long long* restarts,
+    bool reset
+)
+{
+    UVLM::Wake::Discretised::IntegrationState& state =
+        UVLM::CppInterface::simulation().integration;
+    *steps = state.steps;
+    *evaluations = state.evaluations;
+    *restarts = state.restarts;
+    if (reset)
+    {
+        state.steps = 0;
+        state.evaluations = 0;
+        state.restarts = 0;
+    }
+}
+
+
+// Acceleration of the steady rollup (see UVLM::Steady::Rollup):
+// method 0 (default) plain fixed point iterations, 1 Anderson mixing with
+// the last depth iterations and relaxation mixing. march applies the
+// convection increments row by row from the trailing edge.
+DLLEXPORT void set_rollup_acceleration_UVLM
+(
+    unsigned int method,
+    unsigned int depth,
+    double mixing,
+    bool march
+)
+{
+    if (method > 1)
+    {
+        std::cerr << "Rollup acceleration " << method
+                  << " is not supported, using fixed point iterations (0)"
+                  << std::endl;
+        method = 0;
+    }
+    UVLM::Steady::Rollup& rollup = UVLM::Steady::rollup();
+    rollup.acceleration = method;
+    rollup.depth = std::max(depth, 1u);
+    rollup.mixing = mixing;
+    rollup.march = march;
+}
+
+
+// Diagnostics of the last steady rollup (see
+// UVLM::Steady::RollupDiagnostics). residual is the one of the last
+// iteration (0 if there was none).
+DLLEXPORT void rollup_diagnostics_UVLM
+(
+    unsigned int* iterations,
+    unsigned int* velocity_evaluations,
+    unsigned int* aic_refreshes,
+    double* residual,
+    bool* converged
+)
+{
+    const UVLM::Steady::RollupDiagnostics& diagnostics =
+        UVLM::Steady::rollup_diagnostics();
+    *iterations = diagnostics.iterations;
+    *velocity_evaluations = diagnostics.velocity_evaluations;
+    *aic_refreshes = diagnostics.aic_refreshes;
+    *residual = diagnostics.residuals.empty() ? 0.0:diagnostics.residuals.back();
+    *converged = diagnostics.converged;
 }
 
 
@@ -104,7 +351,7 @@ DLLEXPORT void init_UVLM
 )
 {
     // feenableexcept(FE_INVALID | FE_OVERFLOW);
-    Eigen::setNbThreads(options.NumCores);
+    UVLM::Threads::Configuration threads(options.NumCores);
     uint n_surf = options.NumSurfaces;
 
     UVLM::Types::VecDimensions dimensions;
@@ -180,7 +427,8 @@ DLLEXPORT void init_UVLM
         rbm_velocity,
         forces,
         options,
-        flightconditions
+        flightconditions,
+        UVLM::CppInterface::simulation()
     );
 }
 
@@ -206,7 +454,7 @@ DLLEXPORT void run_UVLM
     double** p_dynamic_forces
 )
 {
-    Eigen::setNbThreads(options.NumCores);
+    UVLM::Threads::Configuration threads(options.NumCores);
     uint n_surf = options.NumSurfaces;
 
     UVLM::Types::VecDimensions dimensions;
@@ -304,7 +552,130 @@ DLLEXPORT void run_UVLM
         forces,
         dynamic_forces,
         options,
-        flightconditions
+        flightconditions,
+        UVLM::CppInterface::simulation()
+    );
+}
+
+// Ensemble version of run_UVLM.
+// n_members simulations share the lattice (zeta, zeta_dot, zeta_star,
+// rbm_vel, normals). The per-member arrays are stored member after member,
+// each of them with the same layout as in run_UVLM:
+//  p_uext, p_uext_star: n_members*n_surf*3 pointers
+//  p_gamma, p_gamma_star: n_members*n_surf pointers
+//  p_forces, p_dynamic_forces: n_members*n_surf*6 pointers
+DLLEXPORT void run_UVLM_ensemble
+(
+    const UVLM::Types::UVMopts& options,
+    const UVLM::Types::FlightConditions& flightconditions,
+    unsigned int** p_dimensions,
+    unsigned int** p_dimensions_star,
+    unsigned int i_iter,
+    unsigned int n_members,
+    double** p_uext,
+    double** p_uext_star,
+    double** p_zeta,
+    double** p_zeta_star,
+    double** p_zeta_dot,
+    double*  p_rbm_vel,
+    double** p_gamma,
+    double** p_gamma_star,
+    double** p_normals,
+    double** p_forces,
+    double** p_dynamic_forces
+)
+{
+    UVLM::Threads::Configuration threads(options.NumCores);
+    uint n_surf = options.NumSurfaces;
+
+    UVLM::Types::VecDimensions dimensions;
+    UVLM::CppInterface::transform_dimensions(n_surf,
+                                             p_dimensions,
+                                             dimensions);
+    UVLM::Types::VecDimensions dimensions_star;
+    UVLM::CppInterface::transform_dimensions(n_surf,
+                                             p_dimensions_star,
+                                             dimensions_star);
+
+    UVLM::Types::VecVecMapX zeta;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_zeta,
+                                      zeta,
+                                      1);
+
+    UVLM::Types::VecVecMapX zeta_star;
+    UVLM::CppInterface::map_VecVecMat(dimensions_star,
+                                      p_zeta_star,
+                                      zeta_star,
+                                      1);
+
+    UVLM::Types::VecVecMapX zeta_dot;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_zeta_dot,
+                                      zeta_dot,
+                                      1);
+
+    UVLM::Types::MapVectorX rbm_velocity (p_rbm_vel, 2*UVLM::Constants::NDIM);
+
+    UVLM::Types::VecVecMapX normals;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_normals,
+                                      normals,
+                                      0);
+
+    UVLM::Types::VecVecVecMapX uext(n_members);
+    UVLM::Types::VecVecVecMapX uext_star(n_members);
+    std::vector<UVLM::Types::VecMapX> gamma(n_members);
+    std::vector<UVLM::Types::VecMapX> gamma_star(n_members);
+    UVLM::Types::VecVecVecMapX forces(n_members);
+    UVLM::Types::VecVecVecMapX dynamic_forces(n_members);
+    for (uint i_member=0; i_member<n_members; ++i_member)
+    {
+        UVLM::CppInterface::map_VecVecMat(dimensions,
+                                          p_uext + i_member*n_surf*UVLM::Constants::NDIM,
+                                          uext[i_member],
+                                          1);
+        UVLM::CppInterface::map_VecVecMat(dimensions_star,
+                                          p_uext_star + i_member*n_surf*UVLM::Constants::NDIM,
+                                          uext_star[i_member],
+                                          1);
+        UVLM::CppInterface::map_VecMat(dimensions,
+                                       p_gamma + i_member*n_surf,
+                                       gamma[i_member],
+                                       0);
+        UVLM::CppInterface::map_VecMat(dimensions_star,
+                                       p_gamma_star + i_member*n_surf,
+                                       gamma_star[i_member],
+                                       0);
+        UVLM::CppInterface::map_VecVecMat(dimensions,
+                                          p_forces + i_member*n_surf*2*UVLM::Constants::NDIM,
+                                          forces[i_member],
+                                          1,
+                                          2*UVLM::Constants::NDIM);
+        UVLM::CppInterface::map_VecVecMat(dimensions,
+                                          p_dynamic_forces + i_member*n_surf*2*UVLM::Constants::NDIM,
+                                          dynamic_forces[i_member],
+                                          1,
+                                          2*UVLM::Constants::NDIM);
+    }
+
+    UVLM::Ensemble::solver
+    (
+        i_iter,
+        zeta,
+        zeta_dot,
+        uext,
+        uext_star,
+        zeta_star,
+        gamma,
+        gamma_star,
+        normals,
+        rbm_velocity,
+        forces,
+        dynamic_forces,
+        options,
+        flightconditions,
+        UVLM::CppInterface::simulation().ensemble
     );
 }
 
@@ -460,3 +831,596 @@ DLLEXPORT void UVLM_check_incidence_angle
         incidence_angle
     );
 }
+
+// Linearisation of the run_UVLM time step about the given state
+// (see linear.h for the state space and the orderings).
+// p_A, p_B, p_C and p_D are row-major arrays of size:
+//  A: (K + K_star) x (K + K_star)
+//  B: (K + K_star) x 9*K_zeta
+//  C: 3*K_zeta x (K + K_star)
+//  D: 3*K_zeta x 9*K_zeta
+// where K, K_star and K_zeta are the total number of bound panels,
+// wake panels and lattice vertices.
+DLLEXPORT void assemble_linear_UVLM
+(
+    const UVLM::Types::UVMopts& options,
+    const UVLM::Types::FlightConditions& flightconditions,
+    unsigned int** p_dimensions,
+    unsigned int** p_dimensions_star,
+    double** p_uext,
+    double** p_zeta,
+    double** p_zeta_star,
+    double** p_zeta_dot,
+    double*  p_rbm_vel,
+    double** p_gamma,
+    double** p_gamma_star,
+    double*  p_A,
+    double*  p_B,
+    double*  p_C,
+    double*  p_D
+)
+{
+    UVLM::Threads::Configuration threads(options.NumCores);
+    uint n_surf = options.NumSurfaces;
+
+    UVLM::Types::VecDimensions dimensions;
+    UVLM::CppInterface::transform_dimensions(n_surf,
+                                             p_dimensions,
+                                             dimensions);
+    UVLM::Types::VecDimensions dimensions_star;
+    UVLM::CppInterface::transform_dimensions(n_surf,
+                                             p_dimensions_star,
+                                             dimensions_star);
+
+    UVLM::Types::VecVecMapX zeta;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_zeta,
+                                      zeta,
+                                      1);
+
+    UVLM::Types::VecVecMapX zeta_star;
+    UVLM::CppInterface::map_VecVecMat(dimensions_star,
+                                      p_zeta_star,
+                                      zeta_star,
+                                      1);
+
+    UVLM::Types::VecVecMapX zeta_dot;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_zeta_dot,
+                                      zeta_dot,
+                                      1);
+
+    UVLM::Types::MapVectorX rbm_velocity (p_rbm_vel, 2*UVLM::Constants::NDIM);
+
+    UVLM::Types::VecVecMapX uext;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_uext,
+                                      uext,
+                                      1);
+
+    UVLM::Types::VecMapX gamma;
+    UVLM::CppInterface::map_VecMat(dimensions,
+                                   p_gamma,
+                                   gamma,
+                                   0);
+
+    UVLM::Types::VecMapX gamma_star;
+    UVLM::CppInterface::map_VecMat(dimensions_star,
+                                   p_gamma_star,
+                                   gamma_star,
+                                   0);
+
+    UVLM::Linear::Linearisation lin;
+    UVLM::Linear::linearise
+    (
+        zeta,
+        zeta_dot,
+        uext,
+        zeta_star,
+        gamma,
+        gamma_star,
+        rbm_velocity,
+        flightconditions,
+        lin
+    );
+    UVLM::Linear::StateSpace ss;
+    UVLM::Linear::assemble_state_space(lin, ss);
+
+    UVLM::Types::MapMatrixX(p_A, ss.A.rows(), ss.A.cols()) = ss.A;
+    UVLM::Types::MapMatrixX(p_B, ss.B.rows(), ss.B.cols()) = ss.B;
+    UVLM::Types::MapMatrixX(p_C, ss.C.rows(), ss.C.cols()) = ss.C;
+    UVLM::Types::MapMatrixX(p_D, ss.D.rows(), ss.D.cols()) = ss.D;
+}
+
+// Krylov reduction of a linearised UVLM (see assemble_linear_UVLM and
+// rom.h). All the matrices are row-major.
+// p_expansion_points holds n_points complex numbers as (real, imag) pairs,
+// and p_moments the number of moments to match at each of them.
+// The output arrays are allocated by the caller for max_states reduced
+// states (max_states > 0 is required, as it bounds the size of the
+// outputs), and are filled with the p_n_rom states actually generated:
+//  A_r: n_rom x n_rom
+//  B_r: n_rom x n_inputs
+//  C_r: n_outputs x n_rom
+//  D_r: n_outputs x n_inputs
+//  V:   n_states x n_rom, with x = V x_r
+DLLEXPORT void reduce_linear_UVLM
+(
+    const unsigned int n_states,
+    const unsigned int n_inputs,
+    const unsigned int n_outputs,
+    double* p_A,
+    double* p_B,
+    double* p_C,
+    double* p_D,
+    const unsigned int n_points,
+    double* p_expansion_points,
+    unsigned int* p_moments,
+    const unsigned int max_states,
+    const double deflation_tolerance,
+    unsigned int* p_n_rom,
+    double* p_A_rom,
+    double* p_B_rom,
+    double* p_C_rom,
+    double* p_D_rom,
+    double* p_V
+)
+{
+    *p_n_rom = 0;
+    if (max_states == 0)
+    {
+        std::cerr << "reduce_linear_UVLM: max_states must be > 0, it is "
+                  << "the size of the output arrays" << std::endl;
+        return;
+    }
+
+    UVLM::Linear::StateSpace ss;
+    ss.A = UVLM::Types::MapMatrixX(p_A, n_states, n_states);
+    ss.B = UVLM::Types::MapMatrixX(p_B, n_states, n_inputs);
+    ss.C = UVLM::Types::MapMatrixX(p_C, n_outputs, n_states);
+    ss.D = UVLM::Types::MapMatrixX(p_D, n_outputs, n_inputs);
+
+    std::vector<UVLM::Types::Complex> expansion_points(n_points);
+    std::vector<uint> n_moments(n_points);
+    for (uint i_point=0; i_point<n_points; ++i_point)
+    {
+        expansion_points[i_point] = UVLM::Types::Complex(
+            p_expansion_points[2*i_point],
+            p_expansion_points[2*i_point + 1]);
+        n_moments[i_point] = p_moments[i_point];
+    }
+
+    UVLM::Linear::StateSpace rom;
+    UVLM::Types::MatrixX V;
+    UVLM::ROM::krylov(ss,
+                      expansion_points,
+                      n_moments,
+                      rom,
+                      V,
+                      max_states,
+                      deflation_tolerance);
+
+    const uint n_rom = V.cols();
+    *p_n_rom = n_rom;
+    UVLM::Types::MapMatrixX(p_A_rom, n_rom, n_rom) = rom.A;
+    UVLM::Types::MapMatrixX(p_B_rom, n_rom, n_inputs) = rom.B;
+    UVLM::Types::MapMatrixX(p_C_rom, n_outputs, n_rom) = rom.C;
+    UVLM::Types::MapMatrixX(p_D_rom, n_outputs, n_inputs) = rom.D;
+    UVLM::Types::MapMatrixX(p_V, n_states, n_rom) = V;
+}
+
+// Generalised aerodynamic forces of harmonic modal motion about the given
+// state (see frequency.h).
+// p_modes: row-major 3*K_zeta x n_modes vertex displacements, with the
+//          vertices ordered as in assemble_linear_UVLM.
+// p_reduced_frequencies: k = omega*c_ref/(2*uinf), n_freq of them.
+// p_gaf: n_freq row-major n_modes x n_modes complex matrices, stored as
+//        (real, imag) pairs.
+DLLEXPORT void generalised_forces_UVLM
+(
+    const UVLM::Types::UVMopts& options,
+    const UVLM::Types::FlightConditions& flightconditions,
+    unsigned int** p_dimensions,
+    unsigned int** p_dimensions_star,
+    double** p_uext,
+    double** p_zeta,
+    double** p_zeta_star,
+    double** p_zeta_dot,
+    double*  p_rbm_vel,
+    double** p_gamma,
+    double** p_gamma_star,
+    const unsigned int n_modes,
+    double*  p_modes,
+    const unsigned int n_freq,
+    double*  p_reduced_frequencies,
+    const bool unsteady_forces,
+    double*  p_gaf
+)
+{
+    UVLM::Threads::Configuration threads(options.NumCores);
+    uint n_surf = options.NumSurfaces;
+
+    UVLM::Types::VecDimensions dimensions;
+    UVLM::CppInterface::transform_dimensions(n_surf,
+                                             p_dimensions,
+                                             dimensions);
+    UVLM::Types::VecDimensions dimensions_star;
+    UVLM::CppInterface::transform_dimensions(n_surf,
+                                             p_dimensions_star,
+                                             dimensions_star);
+
+    UVLM::Types::VecVecMapX zeta;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_zeta,
+                                      zeta,
+                                      1);
+
+    UVLM::Types::VecVecMapX zeta_star;
+    UVLM::CppInterface::map_VecVecMat(dimensions_star,
+                                      p_zeta_star,
+                                      zeta_star,
+                                      1);
+
+    UVLM::Types::VecVecMapX zeta_dot;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_zeta_dot,
+                                      zeta_dot,
+                                      1);
+
+    UVLM::Types::MapVectorX rbm_velocity (p_rbm_vel, 2*UVLM::Constants::NDIM);
+
+    UVLM::Types::VecVecMapX uext;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_uext,
+                                      uext,
+                                      1);
+
+    UVLM::Types::VecMapX gamma;
+    UVLM::CppInterface::map_VecMat(dimensions,
+                                   p_gamma,
+                                   gamma,
+                                   0);
+
+    UVLM::Types::VecMapX gamma_star;
+    UVLM::CppInterface::map_VecMat(dimensions_star,
+                                   p_gamma_star,
+                                   gamma_star,
+                                   0);
+
+    UVLM::Linear::Linearisation lin;
+    UVLM::Linear::linearise
+    (
+        zeta,
+        zeta_dot,
+        uext,
+        zeta_star,
+        gamma,
+        gamma_star,
+        rbm_velocity,
+        flightconditions,
+        lin
+    );
+
+    const UVLM::Types::MatrixX modes =
+        UVLM::Types::MapMatrixX(p_modes, 3*lin.indices.K_zeta, n_modes);
+    std::vector<UVLM::Types::Real> omega(n_freq);
+    for (uint i_freq=0; i_freq<n_freq; ++i_freq)
+    {
+        omega[i_freq] = UVLM::Frequency::reduced_to_circular
+        (
+            p_reduced_frequencies[i_freq],
+            flightconditions
+        );
+    }
+
+    std::vector<UVLM::Types::MatrixXc> gaf;
+    UVLM::Frequency::generalised_forces(lin,
+                                        modes,
+                                        omega,
+                                        options.dt,
+                                        gaf,
+                                        unsteady_forces);
+
+    UVLM::Types::Complex* p_gaf_complex =
+        reinterpret_cast<UVLM::Types::Complex*>(p_gaf);
+    for (uint i_freq=0; i_freq<n_freq; ++i_freq)
+    {
+        Eigen::Map<UVLM::Types::MatrixXc>
+            (p_gaf_complex + i_freq*n_modes*n_modes, n_modes, n_modes) = gaf[i_freq];
+    }
+}
+
+// Adjoint gradients of the solution of run_VLM (see adjoint.h).
+// p_zeta_star, p_gamma and p_gamma_star are the outputs of run_VLM.
+// p_objectives: drag, side force, lift and moment about
+//               p_reference_point (3 doubles).
+// p_dobjectives_dzeta: row-major 6 x 3*K_zeta, with the vertices ordered
+//                      as in assemble_linear_UVLM.
+DLLEXPORT void adjoint_VLM
+(
+    const UVLM::Types::VMopts& options,
+    const UVLM::Types::FlightConditions& flightconditions,
+    unsigned int** p_dimensions,
+    unsigned int** p_dimensions_star,
+    double** p_zeta,
+    double** p_zeta_star,
+    double** p_u_ext,
+    double** p_gamma,
+    double** p_gamma_star,
+    double*  p_reference_point,
+    double*  p_objectives,
+    double*  p_dobjectives_dzeta
+)
+{
+    unsigned int n_surf;
+    n_surf = options.NumSurfaces;
+    UVLM::Types::VecDimensions dimensions;
+    UVLM::CppInterface::transform_dimensions(n_surf,
+                                             p_dimensions,
+                                             dimensions);
+    UVLM::Types::VecDimensions dimensions_star;
+    UVLM::CppInterface::transform_dimensions(n_surf,
+                                             p_dimensions_star,
+                                             dimensions_star);
+
+    UVLM::Types::VecVecMapX zeta;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_zeta,
+                                      zeta,
+                                      1);
+
+    UVLM::Types::VecVecMapX zeta_star;
+    UVLM::CppInterface::map_VecVecMat(dimensions_star,
+                                      p_zeta_star,
+                                      zeta_star,
+                                      1);
+
+    UVLM::Types::VecVecMapX u_ext;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_u_ext,
+                                      u_ext,
+                                      1);
+
+    UVLM::Types::VecMapX gamma;
+    UVLM::CppInterface::map_VecMat(dimensions,
+                                   p_gamma,
+                                   gamma,
+                                   0);
+
+    UVLM::Types::VecMapX gamma_star;
+    UVLM::CppInterface::map_VecMat(dimensions_star,
+                                   p_gamma_star,
+                                   gamma_star,
+                                   0);
+
+    UVLM::Types::Vector3 reference_point(p_reference_point);
+
+    UVLM::Types::VectorX objectives;
+    UVLM::Types::MatrixX dobjectives_dzeta;
+    UVLM::Adjoint::steady(zeta,
+                          zeta_star,
+                          gamma,
+                          gamma_star,
+                          u_ext,
+                          reference_point,
+                          options,
+                          flightconditions,
+                          objectives,
+                          dobjectives_dzeta);
+
+    UVLM::Types::MapVectorX(p_objectives, objectives.size()) = objectives;
+    UVLM::Types::MapMatrixX(p_dobjectives_dzeta,
+                            dobjectives_dzeta.rows(),
+                            dobjectives_dzeta.cols()) = dobjectives_dzeta;
+}
+
+
+
+// Steady VLM (as run_VLM, without wake rollup) and its derivatives along
+// n_directions tangents.
+// p_seeds: 6*K_zeta x n_directions, [dzeta; du_ext] per direction
+// p_dgamma: K x n_directions
+// p_dforces: 3*K_zeta x n_directions
+// with the ordering of assemble_linear_UVLM.
+DLLEXPORT void directional_derivatives_VLM
+(
+    const UVLM::Types::VMopts& options,
+    const UVLM::Types::FlightConditions& flightconditions,
+    unsigned int** p_dimensions,
+    unsigned int** p_dimensions_star,
+    double** p_zeta,
+    double** p_zeta_star,
+    double** p_u_ext,
+    double** p_gamma,
+    double** p_gamma_star,
+    double** p_forces,
+    unsigned int n_directions,
+    double*  p_seeds,
+    double*  p_dgamma,
+    double*  p_dforces
+)
+{
+    unsigned int n_surf;
+    n_surf = options.NumSurfaces;
+    UVLM::Types::VecDimensions dimensions;
+    UVLM::CppInterface::transform_dimensions(n_surf,
+                                             p_dimensions,
+                                             dimensions);
+    UVLM::Types::VecDimensions dimensions_star;
+    UVLM::CppInterface::transform_dimensions(n_surf,
+                                             p_dimensions_star,
+                                             dimensions_star);
+
+    UVLM::Types::VecVecMapX zeta;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_zeta,
+                                      zeta,
+                                      1);
+
+    UVLM::Types::VecVecMapX zeta_star;
+    UVLM::CppInterface::map_VecVecMat(dimensions_star,
+                                      p_zeta_star,
+                                      zeta_star,
+                                      1);
+
+    UVLM::Types::VecVecMapX u_ext;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_u_ext,
+                                      u_ext,
+                                      1);
+
+    UVLM::Types::VecMapX gamma;
+    UVLM::CppInterface::map_VecMat(dimensions,
+                                   p_gamma,
+                                   gamma,
+                                   0);
+
+    UVLM::Types::VecMapX gamma_star;
+    UVLM::CppInterface::map_VecMat(dimensions_star,
+                                   p_gamma_star,
+                                   gamma_star,
+                                   0);
+
+    UVLM::Types::VecVecMapX forces;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_forces,
+                                      forces,
+                                      1,
+                                      2*UVLM::Constants::NDIM);
+
+    UVLM::Linear::Indices indices;
+    UVLM::Linear::generate_indices(zeta, zeta_star, indices);
+    const UVLM::Types::MatrixX seeds =
+        UVLM::Types::MapMatrixX(p_seeds, 6*indices.K_zeta, n_directions);
+
+    UVLM::Types::MatrixX dgamma;
+    UVLM::Types::MatrixX dforces;
+    UVLM::AutoDiff::steady_derivatives(zeta,
+                                       u_ext,
+                                       zeta_star,
+                                       gamma,
+                                       gamma_star,
+                                       forces,
+                                       seeds,
+                                       dgamma,
+                                       dforces,
+                                       options,
+                                       flightconditions);
+
+    UVLM::Types::MapMatrixX(p_dgamma, dgamma.rows(), dgamma.cols()) = dgamma;
+    UVLM::Types::MapMatrixX(p_dforces, dforces.rows(), dforces.cols()) = dforces;
+}
+
+
+
+// Trim of the steady VLM (see trim.h).
+// p_variables: UVLM::Trim::alpha, beta or control per trim variable
+// p_objectives: UVLM::Adjoint objective index per trim variable
+// p_trim_values: initial guess, overwritten with the trimmed values
+// p_control_panels: panels of the control surface, numbered as gamma in
+// assemble_linear_UVLM
+// zeta, u_ext, zeta_star, gamma, gamma_star and forces are overwritten
+// with the trimmed state. Returns false if it does not converge.
+DLLEXPORT bool trim_VLM
+(
+    const UVLM::Types::VMopts& options,
+    const UVLM::Types::FlightConditions& flightconditions,
+    unsigned int** p_dimensions,
+    unsigned int** p_dimensions_star,
+    double** p_zeta,
+    double** p_zeta_star,
+    double** p_u_ext,
+    double** p_gamma,
+    double** p_gamma_star,
+    double** p_forces,
+    unsigned int n_trim,
+    unsigned int* p_variables,
+    unsigned int* p_objectives,
+    double*  p_targets,
+    double*  p_reference_point,
+    unsigned int n_control_panels,
+    unsigned int* p_control_panels,
+    double*  p_hinge_point,
+    double*  p_hinge_axis,
+    unsigned int max_iterations,
+    double   tolerance,
+    double*  p_trim_values
+)
+{
+    unsigned int n_surf;
+    n_surf = options.NumSurfaces;
+    UVLM::Types::VecDimensions dimensions;
+    UVLM::CppInterface::transform_dimensions(n_surf,
+                                             p_dimensions,
+                                             dimensions);
+    UVLM::Types::VecDimensions dimensions_star;
+    UVLM::CppInterface::transform_dimensions(n_surf,
+                                             p_dimensions_star,
+                                             dimensions_star);
+
+    UVLM::Types::VecVecMapX zeta;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_zeta,
+                                      zeta,
+                                      1);
+
+    UVLM::Types::VecVecMapX zeta_star;
+    UVLM::CppInterface::map_VecVecMat(dimensions_star,
+                                      p_zeta_star,
+                                      zeta_star,
+                                      1);
+
+    UVLM::Types::VecVecMapX u_ext;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_u_ext,
+                                      u_ext,
+                                      1);
+
+    UVLM::Types::VecMapX gamma;
+    UVLM::CppInterface::map_VecMat(dimensions,
+                                   p_gamma,
+                                   gamma,
+                                   0);
+
+    UVLM::Types::VecMapX gamma_star;
+    UVLM::CppInterface::map_VecMat(dimensions_star,
+                                   p_gamma_star,
+                                   gamma_star,
+                                   0);
+
+    UVLM::Types::VecVecMapX forces;
+    UVLM::CppInterface::map_VecVecMat(dimensions,
+                                      p_forces,
+                                      forces,
+                                      1,
+                                      2*UVLM::Constants::NDIM);
+
+    UVLM::Trim::Settings settings;
+    settings.variables.assign(p_variables, p_variables + n_trim);
+    settings.objectives.assign(p_objectives, p_objectives + n_trim);
+    settings.targets = UVLM::Types::MapVectorX(p_targets, n_trim);
+    settings.reference_point = UVLM::Types::Vector3(p_reference_point);
+    settings.control_surface.panels.assign(p_control_panels,
+                                           p_control_panels + n_control_panels);
+    if (n_control_panels > 0)
+    {
+        settings.control_surface.hinge_point = UVLM::Types::Vector3(p_hinge_point);
+        settings.control_surface.hinge_axis = UVLM::Types::Vector3(p_hinge_axis);
+    }
+    settings.max_iterations = max_iterations;
+    settings.tolerance = tolerance;
+
+    UVLM::Types::VectorX trim_values = UVLM::Types::MapVectorX(p_trim_values, n_trim);
+    const bool converged = UVLM::Trim::trim(zeta,
+                                            u_ext,
+                                            zeta_star,
+                                            gamma,
+                                            gamma_star,
+                                            forces,
+                                            settings,
+                                            options,
+                                            flightconditions,
+                                            trim_values);
+    UVLM::Types::MapVectorX(p_trim_values, n_trim) = trim_values;
+    return converged;
+}